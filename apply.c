@@ -43,6 +43,7 @@
 #include "fenmatcher.h"
 #include "zobrist.h"
 #include "end.h"
+#include "minhash.h"
 
 /* Define a positional search depth that should look at the
  * full length of a game.  This is used in play_moves().
@@ -51,15 +52,17 @@
 
 /* Prototypes of functions limited to this file. */
 static Boolean check_move_validity(Game *game_details, Board *board, Move *moves, Boolean mainline);
-static Boolean check_variation_validity(const Game *game_details, const Board *board, Variation *variation);
+static Boolean check_variation_validity(const Game *game_details, Board *board, Variation *variation);
 static const char *position_matches(const Board *board);
 static Boolean play_moves(Game *game_details, Board *board, Move *moves,
         unsigned max_depth, Boolean check_move_validity,
         Boolean mainline);
-static Boolean apply_variations(const Game *game_details, const Board *board,
+static Boolean apply_variations(const Game *game_details, Board *board,
         Variation *variation, Boolean check_move_validity);
 static void replace_with_FEN_comment(const Board *board, StringList *comment_to_replace);
-static Boolean rewrite_variations(const Board *board, Variation *variation);
+static Boolean rewrite_variations(Board *board, Variation *variation);
+static void begin_undoable_move(const Board *board);
+static void unmake_moves(Board *board, unsigned undo_base);
 static Boolean rewrite_moves(Game *game, Board *board, Move *move_details);
 static void build_FEN_components(const Board *board, char *epd, char *fen_suffix);
 static unsigned plies_in_move_sequence(Move *moves);
@@ -168,6 +171,14 @@ void set_output_piece_characters(const char *letters)
 }
 
 
+/* Undo records for the moves played in variations, so that
+ * the board can be returned to the position at the start of each
+ * variation rather than each being played on a copy.
+ */
+static MoveUndo *undo_stack = NULL;
+static unsigned undo_stack_size = 0;
+static unsigned undo_stack_capacity = 0;
+
 /* Allocate space for a new board. */
 static Board *
 allocate_new_board(void)
@@ -333,7 +344,6 @@ new_fen_board(const char *fen)
         FALSE, 0, 0,
         /* Initial hash value. */
         0ul,
-        0ul,
         /* half-move_clock */
         0,
     };
@@ -601,6 +611,7 @@ new_fen_board(const char *fen)
     if (*fen_char != '\0') {
         Ok = FALSE;
     }
+    set_bitboards(new_board);
     if (Ok) {
         /* Check whether either side is in check and, if so, whether that
          * is consistent with the side to move.
@@ -716,9 +727,6 @@ new_game_board(const char *fen)
         /* half-move_clock */
         0,
     };
-    /* Iterate over the columns. */
-    Col col;
-
     if (fen != NULL) {
         new_board = new_fen_board(fen);
     }
@@ -729,24 +737,11 @@ new_game_board(const char *fen)
         /* Use the initial board setup. */
         new_board = allocate_new_board();
         *new_board = initial_board;
+        set_bitboards(new_board);
     }
 
     /* Generate the hash value for the initial position. */
-    for (col = FIRSTCOL; col <= LASTCOL; col++) {
-        Rank rank;
-
-        for (rank = FIRSTRANK; rank <= LASTRANK; rank++) {
-            /* Find the basic components. */
-            Piece coloured_piece = new_board->board[
-                    RankConvert(rank)][ColConvert(col)];
-            Piece piece = EXTRACT_PIECE(coloured_piece);
-            Colour colour = EXTRACT_COLOUR(coloured_piece);
-
-            if (coloured_piece != EMPTY) {
-                new_board->weak_hash_value ^= hash_lookup(col, rank, piece, colour);
-            }
-        }
-    }
+    new_board->zobrist = generate_zobrist_hash_from_board(new_board);
     return new_board;
 }
 
@@ -878,6 +873,9 @@ apply_move(Move *move_details, Board *board)
                       move_details->to_col, move_details->to_rank,
                       piece_to_move, colour, board);
         }
+        else {
+            make_null_move(colour, board);
+        }
         /* See if there are any subsidiary actions. */
         switch (move_details->class) {
             case PAWN_MOVE:
@@ -912,8 +910,13 @@ apply_move(Move *move_details, Board *board)
         if (Ok) {
             move_details->check_status =
                     king_is_in_check(board, OPPOSITE_COLOUR(colour));
-            if (move_details->check_status == CHECK) {
-                /* See whether it is checkmate. */
+            /* See whether it is checkmate.
+             * In a game of trusted moves, only a move that is not
+             * followed by another real move can be mate.
+             */
+            if (move_details->check_status == CHECK &&
+                    (!GlobalState.trusted_input || move_details->next == NULL ||
+                     move_details->next->class == NULL_MOVE)) {
                 if (king_is_in_checkmate(OPPOSITE_COLOUR(colour), board)) {
                     move_details->check_status = CHECKMATE;
                 }
@@ -984,6 +987,12 @@ play_moves(Game *game_details, Board *board, Move *moves, unsigned max_depth,
             game_details->prefix_comment = comment;
         }
     }
+    if (mainline) {
+        /* The material and piece-count criteria are searched for
+         * in the same pass.
+         */
+        start_material_search(board);
+    }
 
     /* Ensure that the RESULT_TAG (if present) is valid. */
     if(game_details->tags[RESULT_TAG] != NULL &&
@@ -1020,8 +1029,17 @@ play_moves(Game *game_details, Board *board, Move *moves, unsigned max_depth,
                 check_move_validity = FALSE;
 #endif
             }
+            if (!mainline) {
+                begin_undoable_move(board);
+            }
             if (check_move_validity) {
-                if (apply_move(next_move, board)) {
+                Boolean move_ok = apply_move(next_move, board);
+
+                end_undo_record();
+                if (move_ok) {
+                    if (mainline) {
+                        continue_material_search(board, next_move);
+                    }
                     /* Don't try for a positional match if we already have one. */
                     if (check_for_match && !game_matches && (match_label = position_matches(board)) != NULL) {
                         game_matches = TRUE;
@@ -1031,12 +1049,12 @@ play_moves(Game *game_details, Board *board, Move *moves, unsigned max_depth,
                         }
                     }
                     /* Combine this hash value with the cumulative one. */
-                    game_details->cumulative_hash_value += board->weak_hash_value;
+                    game_details->cumulative_hash_value += board->zobrist;
                     if (check_for_match && GlobalState.fuzzy_match_duplicates) {
                         /* Consider remembering this hash value for fuzzy matches. */
                         if (GlobalState.fuzzy_match_depth == plies) {
                             /* Remember it. */
-                            game_details->fuzzy_duplicate_hash = board->weak_hash_value;
+                            game_details->fuzzy_duplicate_hash = board->zobrist;
                         }
                     }
 
@@ -1050,6 +1068,11 @@ play_moves(Game *game_details, Board *board, Move *moves, unsigned max_depth,
                         }
                     }
 
+                    if (check_for_match && game_details->near_duplicate_signature != NULL) {
+                        add_to_minhash_signature(game_details->near_duplicate_signature,
+                                                 board->zobrist);
+                    }
+
                     if (check_for_match && GlobalState.check_for_N_move_rule > 0 && mainline) {
                         if (board->halfmove_clock >= 2 * GlobalState.check_for_N_move_rule) {
                             /* N moves by both players with no pawn move or capture. */
@@ -1072,7 +1095,7 @@ play_moves(Game *game_details, Board *board, Move *moves, unsigned max_depth,
                         /* End of the game. */
                         if (check_for_match && GlobalState.fuzzy_match_duplicates &&
                                 GlobalState.fuzzy_match_depth == 0) {
-                            game_details->fuzzy_duplicate_hash = board->weak_hash_value;
+                            game_details->fuzzy_duplicate_hash = board->zobrist;
                         }
                         /* Ensure that the result tag is consistent with the
                          * final status of the game.
@@ -1248,6 +1271,7 @@ play_moves(Game *game_details, Board *board, Move *moves, unsigned max_depth,
                 if (board->to_move == WHITE) {
                     board->move_number++;
                 }
+                end_undo_record();
                 next_move = next_move->next;
             }
         }
@@ -1327,7 +1351,7 @@ play_moves(Game *game_details, Board *board, Move *moves, unsigned max_depth,
         }
     }
     /* Fill in the hash value of the final position reached. */
-    game_details->final_hash_value = board->weak_hash_value;
+    game_details->final_hash_value = board->zobrist;
     game_details->moves_ok = game_ok;
     game_details->error_ply = error_ply;
     if (! game_ok) {
@@ -1400,9 +1424,15 @@ check_move_validity(Game *game_details, Board *board, Move *moves, Boolean mainl
                  * subsequent moves.
                  */
             }
-            if (game_ok && apply_move(next_move, board)) {
+            if (!mainline) {
+                begin_undoable_move(board);
+            }
+            Boolean move_ok = game_ok && apply_move(next_move, board);
+
+            end_undo_record();
+            if (move_ok) {
                 /* Combine this hash value with the cumulative one. */
-                game_details->cumulative_hash_value += board->weak_hash_value;
+                game_details->cumulative_hash_value += board->zobrist;
                 if (next_move->next == NULL && mainline) {
                     /* End of the game. */
                     /* Ensure that the result tag is consistent with the
@@ -1622,7 +1652,7 @@ check_move_validity(Game *game_details, Board *board, Move *moves, Boolean mainl
         }
     }
     /* Fill in the hash value of the final position reached. */
-    game_details->final_hash_value = board->weak_hash_value;
+    game_details->final_hash_value = board->zobrist;
     game_details->moves_ok = game_ok;
     game_details->error_ply = error_ply;
     return game_ok;;
@@ -1649,7 +1679,7 @@ play_eco_moves(Game *game_details, Board *board, Move *moves)
             /* Ignore variations. */
             if (apply_move(next_move, board)) {
                 /* Combine this hash value to the cumulative one. */
-                game_details->cumulative_hash_value += board->weak_hash_value;
+                game_details->cumulative_hash_value += board->zobrist;
                 next_move = next_move->next;
             }
             else {
@@ -1688,7 +1718,7 @@ play_eco_moves(Game *game_details, Board *board, Move *moves)
     /* Record whether the full game was checked or not. */
     game_details->moves_checked = next_move == NULL;
     /* Fill in the hash value of the final position reached. */
-    game_details->final_hash_value = board->weak_hash_value;
+    game_details->final_hash_value = board->zobrist;
     game_details->moves_ok = game_ok;
     game_details->error_ply = error_ply;
 }
@@ -1700,41 +1730,70 @@ play_eco_moves(Game *game_details, Board *board, Move *moves)
  * we are looking for.
  */
 static Boolean
-apply_variations(const Game *game_details, const Board *board, Variation *variation,
+apply_variations(const Game *game_details, Board *board, Variation *variation,
         Boolean check_move_validity)
 {
     /* Force a match if we aren't looking for positional variations. */
     Boolean variation_matches = GlobalState.positional_variations ? FALSE : TRUE;
-    /* Allocate space for the copies.
-     * Allocation is done, rather than relying on local copies in the body
+    /* Allocate space for the copy.
+     * Allocation is done, rather than relying on a local copy in the body
      * of the loop because the recursive nature of this function has
      * resulted in stack overflow on the PC version.
      */
     Game *copy_game = (Game *) malloc_or_die(sizeof (*copy_game));
-    Board *copy_board = allocate_new_board();
 
     while (variation != NULL) {
-        /* Work on the copies. */
+        unsigned undo_base = undo_stack_size;
+
+        /* Work on a copy of the game. */
         *copy_game = *game_details;
-        *copy_board = *board;
-        /* Don't look for repetitions. */
+        /* Don't look for repetitions or near duplicates. */
         copy_game->position_counts = NULL;
+        copy_game->near_duplicate_signature = NULL;
 
         /* We only need one variation to match to declare a match.
          * Play out the variation to its full depth, because we
          * will want the full move information if the main line
          * later matches.
          */
-        variation_matches |= play_moves(copy_game, copy_board, variation->moves,
+        variation_matches |= play_moves(copy_game, board, variation->moves,
                 DEFAULT_POSITIONAL_DEPTH,
                 check_move_validity, FALSE);
+        /* Return to the position at the start of the variation. */
+        unmake_moves(board, undo_base);
         variation = variation->next;
     }
     (void) free((void *) copy_game);
-    free_board(copy_board);
     return variation_matches;
 }
 
+/* Save the state of board on the undo stack and record there
+ * the changes made by the next move.
+ */
+static void
+begin_undoable_move(const Board *board)
+{
+    if (undo_stack_size == undo_stack_capacity) {
+        undo_stack_capacity = undo_stack_capacity == 0 ? 64 : 2 * undo_stack_capacity;
+        undo_stack = (MoveUndo *) realloc_or_die((void *) undo_stack,
+                undo_stack_capacity * sizeof (*undo_stack));
+    }
+    begin_undo_record(&undo_stack[undo_stack_size], board);
+    undo_stack_size++;
+}
+
+/* Unmake the moves recorded on the undo stack since it held
+ * undo_base records.
+ */
+static void
+unmake_moves(Board *board, unsigned undo_base)
+{
+    while (undo_stack_size > undo_base) {
+        undo_stack_size--;
+        unmake_move(&undo_stack[undo_stack_size], board);
+    }
+}
+
 /* game_details contains a complete move score.
  * Try to apply each move on a new board.
  * Store in plycount the number of ply played.
@@ -1758,7 +1817,11 @@ apply_move_list(Game *game_details,unsigned *plycount, unsigned max_depth, Boole
     game_details->cumulative_hash_value = 0;
 
     if (check_for_a_match && GlobalState.check_for_repetition > 0 && game_details->position_counts == NULL) {
-        game_details->position_counts = new_position_count_list(board);
+        game_details->position_counts = new_position_counts(board);
+    }
+    if (check_for_a_match && GlobalState.near_duplicate_similarity > 0 &&
+            game_details->near_duplicate_signature == NULL) {
+        game_details->near_duplicate_signature = new_minhash_signature(board);
     }
 
     /* Play through the moves and see if we have a match.
@@ -1782,6 +1845,10 @@ apply_move_list(Game *game_details,unsigned *plycount, unsigned max_depth, Boole
     }
 
     if(check_for_a_match) {
+        /* Start fetching the game's slot in the duplicate table
+         * while the remaining criteria are checked.
+         */
+        prefetch_previous_occurance(game_details);
         if (game_matches) {
             game_matches = check_for_only_stalemate(board, moves);
         }
@@ -1798,33 +1865,35 @@ apply_move_list(Game *game_details,unsigned *plycount, unsigned max_depth, Boole
  * Return TRUE if the variation is valid.
  */
 static Boolean
-check_variation_validity(const Game *game_details, const Board *board, Variation *variation)
+check_variation_validity(const Game *game_details, Board *board, Variation *variation)
 {
     Boolean valid = TRUE;
-    /* Allocate space for the copies.
-     * Allocation is done, rather than relying on local copies in the body
+    /* Allocate space for the copy.
+     * Allocation is done, rather than relying on a local copy in the body
      * of the loop because the recursive nature of this function has
      * resulted in stack overflow on the PC version.
      */
     Game *copy_game = (Game *) malloc_or_die(sizeof (*copy_game));
-    Board *copy_board = allocate_new_board();
 
     while (valid && variation != NULL) {
-        /* Work on the copies. */
+        unsigned undo_base = undo_stack_size;
+
+        /* Work on a copy of the game. */
         *copy_game = *game_details;
-        *copy_board = *board;
-        /* Don't look for repetitions. */
+        /* Don't look for repetitions or near duplicates. */
         copy_game->position_counts = NULL;
+        copy_game->near_duplicate_signature = NULL;
 
         /* All variations must be valid.
          * Play out the variation to its full depth, because we
          * will want the full move information.
          */
-        valid &= check_move_validity(copy_game, copy_board, variation->moves, FALSE);
+        valid &= check_move_validity(copy_game, board, variation->moves, FALSE);
+        /* Return to the position at the start of the variation. */
+        unmake_moves(board, undo_base);
         variation = variation->next;
     }
     (void) free((void *) copy_game);
-    free_board(copy_board);
     return valid;
 }
 
@@ -2121,6 +2190,9 @@ rewrite_move(Game *game, Colour colour, Move *move_details, Board *board)
                 move_details->to_col = castling_rook_col;
             }
         }
+        else {
+            make_null_move(colour, board);
+        }
         /* See if there are any subsidiary actions. */
         switch (class) {
             case PAWN_MOVE:
@@ -2189,7 +2261,14 @@ rewrite_moves(Game *game, Board *board, Move *moves)
                 /* Something wrong with the variations. */
                 game_ok = FALSE;
             }
-            if (rewrite_move(game, board->to_move, move_details, board)) {
+            if (game == NULL) {
+                /* Variations are rewritten without a game and are unmade afterwards. */
+                begin_undoable_move(board);
+            }
+            Boolean move_ok = rewrite_move(game, board->to_move, move_details, board);
+
+            end_undo_record();
+            if (move_ok) {
                 if(move_details->class == NULL_MOVE && game != NULL) {
                     /* NULL_MOVE not allowed in the main line. */
                 }
@@ -2206,7 +2285,7 @@ rewrite_moves(Game *game, Board *board, Move *moves)
                     /* Append a hashcode comment using the new state of the board
                      * with the move having been played.
                      */
-                    move_details->zobrist = generate_zobrist_hash_from_board(board);
+                    move_details->zobrist = board->zobrist;
                 }
                 
                 if(GlobalState.drop_comment_pattern != NULL &&
@@ -2261,7 +2340,7 @@ rewrite_moves(Game *game, Board *board, Move *moves)
     if (!game_ok) {
         if(GlobalState.keep_broken_games && move_details != NULL) {
             /* Try to place the remaining moves into a comment. */
-            CommentList *comment = (CommentList*) malloc_or_die(sizeof (*comment));
+            CommentList *comment = (CommentList*) game_malloc_or_die(sizeof (*comment));
             /* Break the link from the previous move. */
             Move *prev;
             StringList *commented_move_list = NULL;
@@ -2283,7 +2362,12 @@ rewrite_moves(Game *game, Board *board, Move *moves)
             /* Build the comment string. */
             char *terminating_result = NULL;
             while (move_details != NULL) {
-                commented_move_list = save_string_list_item(commented_move_list, (char *) move_details->move);
+                /* The text is copied because the move's node may belong
+                 * to the game arena, whereas the comment's strings
+                 * are freed individually.
+                 */
+                commented_move_list = save_string_list_item(commented_move_list,
+                        copy_string((const char *) move_details->move));
                 if (move_details->next == NULL) {
                     /* Remove the terminating result. */
                     terminating_result = move_details->terminating_result;
@@ -2329,19 +2413,18 @@ rewrite_moves(Game *game, Board *board, Move *moves)
  * Return TRUE if the variation are ok. a position that
  */
 static Boolean
-rewrite_variations(const Board *board, Variation *variation)
+rewrite_variations(Board *board, Variation *variation)
 {
-    Board *copy_board = allocate_new_board();
     Boolean variations_ok = TRUE;
 
     while ((variation != NULL) && variations_ok) {
-        /* Work on the copy. */
-        *copy_board = *board;
+        unsigned undo_base = undo_stack_size;
 
-        variations_ok = rewrite_moves((Game *) NULL, copy_board, variation->moves);
+        variations_ok = rewrite_moves((Game *) NULL, board, variation->moves);
+        /* Return to the position at the start of the variation. */
+        unmake_moves(board, undo_base);
         variation = variation->next;
     }
-    free_board(copy_board);
     return variations_ok;
 }
 
@@ -2457,19 +2540,21 @@ drop_plies_from_start(Game *game, Move *moves, int plies_to_drop)
     return game_ok;
 }
 
-/* Define a table to hold the positional hash codes of interest.
+/* Define a table to hold the positional hash codes of interest,
+ * both those of positions reached by variations and
+ * polyglot hash codes given explicitly.
  * Size should be a prime number for collision avoidance.
  */
-#define MAX_NON_POLYGLOT_CODE 541
-static HashLog *non_polyglot_codes_of_interest[MAX_NON_POLYGLOT_CODE];
-/* Whether or not the non-polyglot hashcodes are in use. */
-Boolean using_non_polyglot = FALSE;
+#define MAX_CODE_OF_INTEREST 541
+static HashLog *codes_of_interest[MAX_CODE_OF_INTEREST];
+/* Whether or not any hashcodes are of interest. */
+static Boolean using_codes_of_interest = FALSE;
 
 /* move_details is either the start of a variation in which we are interested
  * or it is NULL.
  * fen is either a position we are interested in or it is NULL.
  * Generate and store the hash value for the variation, or the FEN
- * position in non_polyglot_codes_of_interest.
+ * position in codes_of_interest.
  */
 void
 store_hash_value(Move *move_details, const char *fen)
@@ -2499,17 +2584,17 @@ store_hash_value(Move *move_details, const char *fen)
 
     if (Ok) {
         HashLog *entry = (HashLog *) malloc_or_die(sizeof (*entry));
-        unsigned ix = board->weak_hash_value % MAX_NON_POLYGLOT_CODE;
+        unsigned ix = board->zobrist % MAX_CODE_OF_INTEREST;
 
         /* We don't include the cumulative hash value as the sequence
          * of moves to reach this position is not important.
          */
         entry->cumulative_hash_value = 0;
-        entry->final_hash_value = board->weak_hash_value;
+        entry->final_hash_value = board->zobrist;
         /* Link it into the head at this index. */
-        entry->next = non_polyglot_codes_of_interest[ix];
-        non_polyglot_codes_of_interest[ix] = entry;
-        using_non_polyglot = TRUE;
+        entry->next = codes_of_interest[ix];
+        codes_of_interest[ix] = entry;
+        using_codes_of_interest = TRUE;
     }
     else {
         exit(1);
@@ -2517,14 +2602,6 @@ store_hash_value(Move *move_details, const char *fen)
     free_board(board);
 }
 
-/* Define a table to hold the positional hash codes of interest.
- * Size should be a prime number for collision avoidance.
- */
-#define MAX_POLYGLOT_CODE 541
-static HashLog *polyglot_codes_of_interest[MAX_POLYGLOT_CODE];
-/* Whether or not the polyglot hashcodes are in use. */
-static Boolean using_polyglot = FALSE;
-
 /**
  * Convert the given hex string to an int and save it
  * for position matching. 
@@ -2547,7 +2624,7 @@ Boolean save_polyglot_hashcode(const char *value)
             Ok = (errno == 0 && *end == '\0');
             if (Ok) {
                 HashLog *entry = (HashLog *) malloc_or_die(sizeof (*entry));
-                unsigned ix = hash % MAX_POLYGLOT_CODE;
+                unsigned ix = hash % MAX_CODE_OF_INTEREST;
 
                 /* We don't include the cumulative hash value as the sequence
                  * of moves to reach this position is not important.
@@ -2555,9 +2632,9 @@ Boolean save_polyglot_hashcode(const char *value)
                 entry->cumulative_hash_value = 0;
                 entry->final_hash_value = hash;
                 /* Link it into the head at this index. */
-                entry->next = polyglot_codes_of_interest[ix];
-                polyglot_codes_of_interest[ix] = entry;
-                using_polyglot = TRUE;
+                entry->next = codes_of_interest[ix];
+                codes_of_interest[ix] = entry;
+                using_codes_of_interest = TRUE;
             }
             else {
                 fprintf(GlobalState.logfile, "Unrecognised hash value %s\n", value);
@@ -2584,21 +2661,10 @@ position_matches(const Board *board)
 {
     Boolean found = FALSE;
     
-    if(using_non_polyglot) {
-        HashCode current_hash_value = board->weak_hash_value;
-        unsigned ix = current_hash_value % MAX_NON_POLYGLOT_CODE;
-        for (HashLog *entry = non_polyglot_codes_of_interest[ix]; !found && (entry != NULL);
-                entry = entry->next) {
-            /* We can test against just the position value. */
-            if (entry->final_hash_value == current_hash_value) {
-                found = TRUE;
-            }
-        }
-    }
-    if(!found && using_polyglot) {
-        uint64_t current_hash_value = generate_zobrist_hash_from_board(board);
-        unsigned ix = current_hash_value % MAX_POLYGLOT_CODE;
-        for (HashLog *entry = polyglot_codes_of_interest[ix]; !found && (entry != NULL);
+    if(using_codes_of_interest) {
+        HashCode current_hash_value = board->zobrist;
+        unsigned ix = current_hash_value % MAX_CODE_OF_INTEREST;
+        for (HashLog *entry = codes_of_interest[ix]; !found && (entry != NULL);
                 entry = entry->next) {
             /* We can test against just the position value. */
             if (entry->final_hash_value == current_hash_value) {
@@ -2926,7 +2992,7 @@ build_FEN_components(const Board *board, char *epd, char *fen_suffix)
 static void
 append_FEN_comment(Move *move_details, const Board *board)
 {
-    CommentList *comment = (CommentList*) malloc_or_die(sizeof (*comment));
+    CommentList *comment = (CommentList*) game_malloc_or_die(sizeof (*comment));
     StringList *current_comment = save_string_list_item(NULL, get_FEN_string(board));
 
     comment->comment = current_comment;
@@ -2947,9 +3013,9 @@ append_FEN_comment(Move *move_details, const Board *board)
 static void
 append_hashcode_comment(Move *move_details, Board *board)
 {
-    uint64_t hash = generate_zobrist_hash_from_board(board);
+    uint64_t hash = board->zobrist;
     char *hashcode_comment = (char *) malloc_or_die(HASH_64_BIT_SPACE + 1);
-    CommentList *comment = (CommentList*) malloc_or_die(sizeof (*comment));
+    CommentList *comment = (CommentList*) game_malloc_or_die(sizeof (*comment));
     StringList *current_comment = save_string_list_item(NULL, hashcode_comment);
     
     sprintf(hashcode_comment, "%016" PRIx64, hash);
@@ -2966,7 +3032,7 @@ append_hashcode_comment(Move *move_details, Board *board)
 static void
 append_evaluation(Move *move_details, const Board *board)
 {
-    CommentList *comment = (CommentList*) malloc_or_die(sizeof (*comment));
+    CommentList *comment = (CommentList*) game_malloc_or_die(sizeof (*comment));
     /* Space template for the value.
      * @@@ There is a buffer-overflow risk here if the evaluation value
      * is too large.
@@ -3006,7 +3072,7 @@ create_match_comment(const Board *board)
         match_comment = get_FEN_string(board);
     }
     StringList *current_comment = save_string_list_item(NULL, match_comment);
-    CommentList *comment = (CommentList*) malloc_or_die(sizeof (*comment));
+    CommentList *comment = (CommentList*) game_malloc_or_die(sizeof (*comment));
 
     comment->comment = current_comment;
     comment->next = NULL;
@@ -3020,14 +3086,33 @@ evaluate(const Board *board)
     return shannonEvaluation(board);
 }
 
+/* Return the number of moves available to colour on board,
+ * counting each promotion as a single move.
+ */
+static int
+mobility(const Board *board, Colour colour)
+{
+    CompactMove moves[MAX_MOVES];
+    unsigned num_moves = generate_legal_moves(board, colour, moves);
+    int count = 0;
+
+    for (unsigned ix = 0; ix < num_moves; ix++) {
+        MoveFlag flag = COMPACT_FLAG(moves[ix]);
+
+        if (flag != KNIGHT_PROMOTION && flag != BISHOP_PROMOTION && flag != ROOK_PROMOTION) {
+            count++;
+        }
+    }
+    return count;
+}
+
 /* Return an evaluation of board based on
  * Claude Shannon's technique.
  */
 static double
 shannonEvaluation(const Board *board)
 {
-    MovePair *white_moves, *black_moves;
-    int whiteMoveCount = 0, blackMoveCount = 0;
+    int whiteMoveCount, blackMoveCount;
     int whitePieceCount = 0, blackPieceCount = 0;
     double shannonValue = 0.0;
 
@@ -3035,24 +3120,8 @@ shannonEvaluation(const Board *board)
     Col col;
 
     /* Determine the mobilities. */
-    white_moves = find_all_moves(board, WHITE);
-    if (white_moves != NULL) {
-        MovePair *m;
-        for (m = white_moves; m != NULL; m = m->next) {
-            whiteMoveCount++;
-        }
-        free_move_pair_list(white_moves);
-    }
-
-    black_moves = find_all_moves(board, BLACK);
-    if (black_moves != NULL) {
-        MovePair *m;
-        for (m = black_moves; m != NULL; m = m->next) {
-            blackMoveCount++;
-        }
-        free_move_pair_list(black_moves);
-    }
-
+    whiteMoveCount = mobility(board, WHITE);
+    blackMoveCount = mobility(board, BLACK);
 
     /* Pick up each piece of the required colour. */
     for (rank = LASTRANK; rank >= FIRSTRANK; rank--) {
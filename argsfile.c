@@ -212,8 +212,11 @@ usage_and_exit(void)
         "--detag tag - don't include tag in the output",
         "--dropbefore - drop opening ply before a matching comment string",
         "--dropply - drop the given number of ply from the beginning of the game",
+        "--dupdb file - detect duplicates of games met in earlier runs, recorded in file",
         "--duplicates - see -d",
+        "--ecotable file - with -e, use the ECO lines compiled into file, compiling them if file is missing or out of date",
         "--evaluation - include a position evaluation after each move",
+        "--externaldupes - detect duplicates by sorting in two passes over the input files, rather than in memory.",
         "--fencommentformat - format for FEN comments",
         "--fencomments - include a FEN string after each move",
         "--fenpattern pattern - match games reaching a position matching the given FEN pattern",
@@ -227,6 +230,7 @@ usage_and_exit(void)
         "--hashcomments - include a hashcode string after each move",
         "--help - see -h",
         "--higherratedwinner - match only if the winner has the higher rating",
+        "--index - use or build a .pgi index of each input file to skip games before --firstgame.",
         "--insufficient - only output games that end with insufficient mating material.",
         "--json - output the game in JSON format",
         "--keepbroken - retain games with errors",
@@ -242,6 +246,7 @@ usage_and_exit(void)
         "--minply N - only output games with at least N ply.",
         "--maxmoves N - only output games with at N or fewer moves.",
         "--maxply N - only output games with at N or fewer ply.",
+        "--nearduplicates percent - treat games whose positions are at least percent similar as duplicates",
         "--nestedcomments - allow nested comments.",
         "--nobadresults - reject games with inconsistent result indications.",
         "--nochecks - don't output + and # after moves.",
@@ -269,6 +274,7 @@ usage_and_exit(void)
         "--seven - see -7",
         "--seventyfive - only output games that include seventy-five moves with no capture or pawn move.",
         "--skipmatching range[,range ...] - don't output the selected matched game(s)",
+        "--splitsize N - divide input files into sections of about N kilobytes for --threads.",
         "--splitvariants [depth] - output each variation (to the given depth) as a separate game.",
         "--stalemate - only output games that end in stalemate.",
         "--startply N - only start matching after N ply (N >= 1).",
@@ -276,7 +282,9 @@ usage_and_exit(void)
         "--summary - report the number of matched games on program exit.",
         "--suppressmatched - don't output matched games (see -n).",
         "--tagsubstr - match in any part of a tag (see -T and -t).",
+        "--threads N - process up to N input files, or sections of them, in parallel.",
         "--totalplycount - include a tag with the total number of plies in a game.",
+        "--trusted - the input contains only legal moves, so skip unnecessary legality checks.",
         "--underpromotion - match only games that contain an underpromotion.",
         "--version - print the current version number and exit.",
         "--vanywhere - apply variation matching (-v) through the whole game.",
@@ -1156,15 +1164,41 @@ process_long_form_argument(const char *argument, const char *associated_value)
         }
         return 2;
     }
+    else if (stringcompare(argument, "dupdb") == 0) {
+        if (*associated_value != '\0') {
+            GlobalState.duplicate_database = copy_string(associated_value);
+        }
+        else {
+            fprintf(GlobalState.logfile,
+                    "--%s requires a file name following it.\n", argument);
+            exit(1);
+        }
+        return 2;
+    }
     else if (stringcompare(argument, "duplicates") == 0) {
         process_argument(DUPLICATES_FILE_ARGUMENT, associated_value);
         return 2;
     }
+    else if (stringcompare(argument, "ecotable") == 0) {
+        if (*associated_value != '\0') {
+            GlobalState.eco_table_file = copy_string(associated_value);
+        }
+        else {
+            fprintf(GlobalState.logfile,
+                    "--%s requires a file name following it.\n", argument);
+            exit(1);
+        }
+        return 2;
+    }
     else if (stringcompare(argument, "evaluation") == 0) {
         /* Output an evaluation is required with each move. */
         GlobalState.output_evaluation = TRUE;
         return 1;
     }
+    else if (stringcompare(argument, "externaldupes") == 0) {
+        GlobalState.external_duplicates = TRUE;
+        return 1;
+    }
     else if (stringcompare(argument, "fencommentformat") == 0) {
         /* The format to be used when outputting FEN comments.
          *  The assumption is that it will contain %s embedded in additional
@@ -1300,6 +1334,10 @@ process_long_form_argument(const char *argument, const char *associated_value)
         }
         return 1;
     }
+    else if (stringcompare(argument, "index") == 0) {
+        GlobalState.use_game_index = TRUE;
+        return 1;
+    }
     else if (stringcompare(argument, "insufficient") == 0) {
         if(GlobalState.match_only_checkmate) {
             fprintf(GlobalState.logfile,
@@ -1500,6 +1538,21 @@ process_long_form_argument(const char *argument, const char *associated_value)
         }
         return 2;
     }
+    else if (stringcompare(argument, "nearduplicates") == 0) {
+        /* Extract the percentage. */
+        unsigned similarity = 0;
+
+        if (sscanf(associated_value, "%u", &similarity) == 1 &&
+                similarity >= 1 && similarity <= 100) {
+            GlobalState.near_duplicate_similarity = similarity;
+        }
+        else {
+            fprintf(GlobalState.logfile,
+                    "--%s requires a percentage between 1 and 100 following it.\n", argument);
+            exit(1);
+        }
+        return 2;
+    }
     else if (stringcompare(argument, "nestedcomments") == 0) {
         GlobalState.allow_nested_comments = TRUE;
         return 1;
@@ -1729,6 +1782,20 @@ process_long_form_argument(const char *argument, const char *associated_value)
         GlobalState.verbosity |= COUNT_SUMMARY;
         return 1;
     }
+    else if (stringcompare(argument, "splitsize") == 0) {
+        unsigned long kilobytes = 0;
+
+        /* Extract the size of the sections for --threads. */
+        if (sscanf(associated_value, "%lu", &kilobytes) == 1 && kilobytes > 0) {
+            GlobalState.split_size = (size_t) kilobytes * 1024;
+        }
+        else {
+            fprintf(GlobalState.logfile,
+                    "--%s requires a number greater than zero to follow it.\n", argument);
+            exit(1);
+        }
+        return 2;
+    }
     else if (stringcompare(argument, "splitvariants") == 0) {
         if(GlobalState.keep_variations) {
             GlobalState.split_variants = TRUE;
@@ -1825,10 +1892,28 @@ process_long_form_argument(const char *argument, const char *associated_value)
         GlobalState.tag_match_anywhere = TRUE;
         return 1;
     }
+    else if (stringcompare(argument, "threads") == 0) {
+        int number = 0;
+
+        /* Extract the number of files to process in parallel. */
+        if (sscanf(associated_value, "%d", &number) == 1 && number > 0) {
+            GlobalState.num_threads = number;
+        }
+        else {
+            fprintf(GlobalState.logfile,
+                    "--%s requires a number greater than zero to follow it.\n", argument);
+            exit(1);
+        }
+        return 2;
+    }
     else if (stringcompare(argument, "totalplycount") == 0) {
         GlobalState.output_total_plycount = TRUE;
         return 1;
     }
+    else if (stringcompare(argument, "trusted") == 0) {
+        GlobalState.trusted_input = TRUE;
+        return 1;
+    }
     else if (stringcompare(argument, "underpromotion") == 0) {
         GlobalState.match_underpromotion = TRUE;
         return 1;
@@ -0,0 +1,344 @@
+/*
+ *  This file is part of pgn-extract: a Portable Game Notation (PGN) extractor.
+ *  Copyright (C) 1994-2026 David J. Barnes
+ *
+ *  pgn-extract is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  pgn-extract is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with pgn-extract. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  David J. Barnes may be contacted as d.j.barnes@kent.ac.uk
+ *  https://www.cs.kent.ac.uk/people/staff/djb/
+ */
+
+/* A benchmark of the move generation and move application code,
+ * built by 'make bench' rather than as part of pgn-extract.
+ *
+ * Usage: pgn-extract-bench [-d depth] [corpus-file ...]
+ *
+ * A perft count of the legal move tree is made to the given depth
+ * (default 4) from a set of standard and Chess960 positions.
+ * Each count is checked against its known value.
+ * Each corpus file contains one game per line, as written by
+ *     pgn-extract --notags -C -N -V -w 100000
+ * from games starting in the standard position, and is used to time
+ * apply_move_list and rewrite_game.
+ * The exit status is 1 if a perft count is wrong.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include "bool.h"
+#include "mymalloc.h"
+#include "defs.h"
+#include "typedef.h"
+#include "taglist.h"
+#include "tokens.h"
+#include "lex.h"
+#include "decode.h"
+#include "map.h"
+#include "apply.h"
+#include "lists.h"
+#include "grammar.h"
+#include "globalstate.h"
+
+/* The deepest perft for which node counts are held. */
+#define MAX_PERFT_DEPTH 5
+/* The minimum time, in seconds, for which each replay is timed. */
+#define MIN_REPLAY_TIME 1.0
+
+/* A position for perft and its node counts at depths 1 to MAX_PERFT_DEPTH. */
+typedef struct {
+    const char *fen;
+    unsigned long nodes[MAX_PERFT_DEPTH];
+} PerftPosition;
+
+/* Widely published perft results. */
+static const PerftPosition Standard_positions[] = {
+    { "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+      { 20, 400, 8902, 197281, 4865609 } },
+    { "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+      { 48, 2039, 97862, 4085603, 193690690 } },
+    { "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+      { 14, 191, 2812, 43238, 674624 } },
+    { "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+      { 6, 264, 9467, 422333, 15833292 } },
+    { "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+      { 44, 1486, 62379, 2103487, 89941194 } },
+    { "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+      { 46, 2079, 89890, 3894594, 164075551 } },
+};
+
+static const PerftPosition Chess960_positions[] = {
+    { "bqnb1rkr/pp3ppp/3ppn2/2p5/5P2/P2P4/NPP1P1PP/BQ1BNRKR w HFhf - 2 9",
+      { 21, 528, 12189, 326672, 8146062 } },
+    { "2nnrbkr/p1qppppp/8/1ppb4/6PP/3PP3/PPP2P2/BQNNRBKR w HEhe - 1 9",
+      { 21, 807, 18002, 667366, 16253601 } },
+    { "b1q1rrkb/pppppppp/3nn3/8/P7/1PPP4/4PPPP/BQNNRKRB w GE - 1 9",
+      { 20, 479, 10471, 273318, 6417013 } },
+    { "qbbnnrkr/2pp2pp/p7/1p2pp2/8/P3PP2/1PPP1KPP/QBBNNR1R w hf - 0 9",
+      { 22, 593, 13440, 382958, 9183776 } },
+    { "1nbbnrkr/p1p1ppp1/3p4/1p3P1p/3Pq2P/8/PPP1P1P1/QNBBNRKR w HFhf - 0 9",
+      { 28, 1120, 31058, 1171749, 34030312 } },
+};
+
+#define NUM_POSITIONS(positions) (sizeof (positions) / sizeof (positions[0]))
+
+static unsigned long perft(Board *board, unsigned depth);
+static Boolean run_perft(const char *description, const PerftPosition positions[],
+        unsigned num_positions, unsigned depth);
+static Move *read_game_moves(char *line);
+static Game *read_corpus(const char *filename, Game *games, unsigned *num_games,
+        unsigned long *num_plies);
+static void run_replays(const Game *games, unsigned num_games, unsigned long num_plies);
+static double seconds_since(clock_t start);
+
+/* Return the number of leaf nodes of the legal move tree of the
+ * given depth from board.
+ */
+static unsigned long
+perft(Board *board, unsigned depth)
+{
+    CompactMove moves[MAX_MOVES];
+    unsigned num_moves = generate_legal_moves(board, board->to_move, moves);
+    unsigned long nodes = 0;
+
+    if (depth <= 1) {
+        return depth == 1 ? num_moves : 1;
+    }
+    for (unsigned ix = 0; ix < num_moves; ix++) {
+        MoveUndo undo;
+
+        begin_undo_record(&undo, board);
+        make_compact_move(moves[ix], board);
+        end_undo_record();
+        nodes += perft(board, depth - 1);
+        unmake_move(&undo, board);
+    }
+    return nodes;
+}
+
+/* Run perft to depth from each of the positions and report the speed.
+ * Return TRUE if every node count is correct.
+ */
+static Boolean
+run_perft(const char *description, const PerftPosition positions[],
+        unsigned num_positions, unsigned depth)
+{
+    Boolean all_correct = TRUE;
+    unsigned long total_nodes = 0;
+    clock_t start = clock();
+    double seconds;
+
+    for (unsigned ix = 0; ix < num_positions; ix++) {
+        Board *board = new_fen_board(positions[ix].fen);
+        unsigned long nodes, expected = positions[ix].nodes[depth - 1];
+
+        if (board == NULL) {
+            fprintf(GlobalState.logfile, "Unable to set up %s\n", positions[ix].fen);
+            exit(1);
+        }
+        nodes = perft(board, depth);
+        if (nodes != expected) {
+            fprintf(GlobalState.logfile,
+                    "Perft mismatch at depth %u for %s: %lu nodes instead of %lu.\n",
+                    depth, positions[ix].fen, nodes, expected);
+            all_correct = FALSE;
+        }
+        total_nodes += nodes;
+        free_board(board);
+    }
+    seconds = seconds_since(start);
+    printf("perft %-9s depth %u: %11lu nodes in %6.2fs, %11.0f nodes/sec\n",
+            description, depth, total_nodes, seconds,
+            seconds > 0 ? total_nodes / seconds : 0.0);
+    return all_correct;
+}
+
+/* Decode the moves in line, skipping move numbers and results.
+ * Return NULL if line holds no moves or one that cannot be decoded.
+ */
+static Move *
+read_game_moves(char *line)
+{
+    Move *head = NULL, *tail = NULL;
+    Boolean Ok = TRUE;
+
+    for (char *text = strtok(line, " \t"); Ok && text != NULL; text = strtok(NULL, " \t")) {
+        if (isdigit((unsigned char) *text) || *text == '*') {
+            /* A move number or result. */
+        }
+        else if (strlen(text) > MAX_MOVE_LEN) {
+            Ok = FALSE;
+        }
+        else {
+            Move *move = decode_move((const unsigned char *) text);
+
+            if (move->class == UNKNOWN_MOVE) {
+                Ok = FALSE;
+            }
+            if (tail == NULL) {
+                head = move;
+            }
+            else {
+                tail->next = move;
+                move->prev = tail;
+            }
+            tail = move;
+        }
+    }
+    if (!Ok) {
+        free_move_list(head);
+        head = NULL;
+    }
+    return head;
+}
+
+/* Add the valid games in filename to games, growing it as necessary.
+ * Update num_games and num_plies for the games added and return games.
+ */
+static Game *
+read_corpus(const char *filename, Game *games, unsigned *num_games,
+        unsigned long *num_plies)
+{
+    FILE *fp = fopen(filename, "r");
+    char *line;
+
+    if (fp == NULL) {
+        fprintf(GlobalState.logfile, "Unable to open %s\n", filename);
+        exit(1);
+    }
+    while ((line = read_line(fp)) != NULL) {
+        Move *moves = read_game_moves(line);
+
+        if (moves != NULL) {
+            Game game;
+            unsigned plycount;
+
+            memset((void *) &game, 0, sizeof (game));
+            game.tags_length = ORIGINAL_NUMBER_OF_TAGS;
+            game.tags = (char **) malloc_or_die(game.tags_length * sizeof (*game.tags));
+            memset((void *) game.tags, 0, game.tags_length * sizeof (*game.tags));
+            game.moves = moves;
+            (void) apply_move_list(&game, &plycount, 0, FALSE);
+            if (game.moves_ok) {
+                games = (Game *) realloc_or_die((void *) games, (*num_games + 1) * sizeof (*games));
+                games[*num_games] = game;
+                (*num_games)++;
+                *num_plies += plycount;
+            }
+            else {
+                free_move_list(moves);
+                (void) free((void *) game.tags);
+            }
+        }
+        (void) free((void *) line);
+    }
+    (void) fclose(fp);
+    return games;
+}
+
+/* Time apply_move_list and rewrite_game over the games,
+ * repeating each until at least MIN_REPLAY_TIME has elapsed.
+ */
+static void
+run_replays(const Game *games, unsigned num_games, unsigned long num_plies)
+{
+    Game game;
+    unsigned rounds = 0;
+    clock_t start = clock();
+    double seconds;
+
+    do {
+        for (unsigned ix = 0; ix < num_games; ix++) {
+            unsigned plycount;
+
+            game = games[ix];
+            (void) apply_move_list(&game, &plycount, 0, TRUE);
+        }
+        rounds++;
+    } while ((seconds = seconds_since(start)) < MIN_REPLAY_TIME);
+    printf("apply_move_list: %u games, %lu plies x %u in %6.2fs, %11.0f plies/sec\n",
+            num_games, num_plies, rounds, seconds, num_plies * rounds / seconds);
+
+    rounds = 0;
+    start = clock();
+    do {
+        for (unsigned ix = 0; ix < num_games; ix++) {
+            Board *board;
+
+            game = games[ix];
+            board = rewrite_game(&game);
+            if (board != NULL) {
+                free_board(board);
+            }
+        }
+        rounds++;
+    } while ((seconds = seconds_since(start)) < MIN_REPLAY_TIME);
+    printf("rewrite_game:    %u games, %lu plies x %u in %6.2fs, %11.0f plies/sec\n",
+            num_games, num_plies, rounds, seconds, num_plies * rounds / seconds);
+}
+
+/* Return the processor time used since start. */
+static double
+seconds_since(clock_t start)
+{
+    return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+int
+main(int argc, char *argv[])
+{
+    unsigned depth = 4;
+    Game *games = NULL;
+    unsigned num_games = 0;
+    unsigned long num_plies = 0;
+    Boolean all_correct;
+    int argnum = 1;
+
+    init_default_global_state();
+    init_game_header();
+    init_tag_lists();
+    init_hashtab();
+    init_bitboards();
+    init_lex_tables();
+
+    if (argnum + 1 < argc && strcmp(argv[argnum], "-d") == 0) {
+        depth = (unsigned) atoi(argv[argnum + 1]);
+        argnum += 2;
+    }
+    if (depth < 1 || depth > MAX_PERFT_DEPTH) {
+        fprintf(GlobalState.logfile, "The perft depth must be between 1 and %d.\n",
+                MAX_PERFT_DEPTH);
+        exit(1);
+    }
+
+    all_correct = run_perft("standard", Standard_positions,
+            NUM_POSITIONS(Standard_positions), depth);
+    all_correct &= run_perft("Chess960", Chess960_positions,
+            NUM_POSITIONS(Chess960_positions), depth);
+
+    for (; argnum < argc; argnum++) {
+        games = read_corpus(argv[argnum], games, &num_games, &num_plies);
+    }
+    if (num_games > 0) {
+        run_replays(games, num_games, num_plies);
+    }
+    for (unsigned ix = 0; ix < num_games; ix++) {
+        free_move_list(games[ix].moves);
+        (void) free((void *) games[ix].tags);
+    }
+    (void) free((void *) games);
+    return all_correct ? 0 : 1;
+}
@@ -132,7 +132,7 @@ is_check(char c)
 Move *
 new_move_structure(void)
 {
-    Move *move = (Move *) malloc_or_die(sizeof (Move));
+    Move *move = (Move *) game_malloc_or_die(sizeof (Move));
 
     move->terminating_result = NULL;
     move->piece_to_move = EMPTY;
@@ -80,11 +80,16 @@ typedef char Col;
 
 /* Define a type for position hashing.
  * The original type for this is unsigned long.
- * @@@ At some point, it would be worth moving this to uint64_t to be
- * consistent with the polyglot/zobrist hashing function.
+ * It is now uint64_t to be consistent with the polyglot/zobrist
+ * hashing function.
  */
 typedef uint64_t HashCode;
 
+/* A set of squares, one bit per square, with a1 as bit 0,
+ * b1 as bit 1, ..., h8 as bit 63.
+ */
+typedef uint64_t Bitboard;
+
 typedef struct {
     Piece board[HEDGE+BOARDSIZE+HEDGE][HEDGE+BOARDSIZE+HEDGE];
     /* Who has the next move. */
@@ -107,20 +112,52 @@ typedef struct {
     Boolean EnPassant;
     Rank ep_rank;
     Col ep_col;
-    /* NB: @@@
-     * This value is based on a relatively weak hashing approach
-     * that really needs updating to properly use the Zobrist hash.
-     */
-    HashCode weak_hash_value;
-    /* Provision for storing a Zobrist hash value. However,
-     * this is only set if GlobalState.add_hashcode_comments.
-     * At some point, it should supersede the weak_hash_value.
+    /* The polyglot Zobrist hash value of the position.
+     * This is maintained incrementally by make_move and is
+     * the hash value used for duplicate, ECO and positional matching.
      */
-    uint64_t zobrist;
+    HashCode zobrist;
     /* The half-move clock since the last pawn move or capture. */
     unsigned halfmove_clock;
+    /* The squares occupied by each piece of each colour, and by
+     * all the pieces of each colour.
+     * These mirror board and are maintained alongside it by make_move.
+     */
+    Bitboard pieces[2][NUM_PIECE_VALUES];
+    Bitboard occupied[2];
 } Board;
 
+/* The most squares changed by a single move: a promotion changes
+ * two squares twice.
+ */
+#define MAX_UNDO_SQUARES 6
+
+/* A record of the state of a Board before a move was made,
+ * from which unmake_move can restore it.
+ */
+typedef struct {
+    /* The previous occupants of the squares changed by the move,
+     * in the order in which they were changed.
+     */
+    struct {
+        signed char r, c;
+        Piece occupant;
+    } squares[MAX_UNDO_SQUARES];
+    unsigned num_squares;
+    /* The rest of the Board's state. */
+    Colour to_move;
+    unsigned move_number;
+    Col WKingCastle, WQueenCastle;
+    Col BKingCastle, BQueenCastle;
+    Col WKingCol; Rank WKingRank;
+    Col BKingCol; Rank BKingRank;
+    Boolean EnPassant;
+    Rank ep_rank;
+    Col ep_col;
+    HashCode zobrist;
+    unsigned halfmove_clock;
+} MoveUndo;
+
 /* Define a type that can be used to create a list of possible source
  * squares for a move.
  */
@@ -131,6 +168,22 @@ typedef struct move_pair {
     Rank to_rank;
     struct move_pair *next;
 } MovePair;
+
+/* A move encoded in 16 bits for the move generator: the bitboard
+ * index of the from square in bits 0-5, that of the to square in bits 6-11
+ * and a MoveFlag in bits 12-15.
+ */
+typedef uint16_t CompactMove;
+typedef enum {
+    ORDINARY_MOVE, EN_PASSANT_MOVE, KINGSIDE_CASTLING, QUEENSIDE_CASTLING,
+    KNIGHT_PROMOTION, BISHOP_PROMOTION, ROOK_PROMOTION, QUEEN_PROMOTION
+} MoveFlag;
+#define COMPACT_MOVE(from, to, flag) ((CompactMove) ((from) | ((to) << 6) | ((flag) << 12)))
+#define COMPACT_FROM(move) ((move) & 0x3f)
+#define COMPACT_TO(move) (((move) >> 6) & 0x3f)
+#define COMPACT_FLAG(move) ((MoveFlag) ((move) >> 12))
+/* More than the number of legal moves in any position. */
+#define MAX_MOVES 256
     
 /* Conversion macros. */
 #define PIECE_SHIFT 3
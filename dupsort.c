@@ -0,0 +1,519 @@
+/*
+ *  This file is part of pgn-extract: a Portable Game Notation (PGN) extractor.
+ *  Copyright (C) 1994-2026 David J. Barnes
+ *
+ *  pgn-extract is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  pgn-extract is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with pgn-extract. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  David J. Barnes may be contacted as d.j.barnes@kent.ac.uk
+ *  https://www.cs.kent.ac.uk/people/staff/djb/
+ */
+
+/* Detect duplicate games without holding a table of all the games
+ * in memory (--externaldupes).
+ *
+ * The input is read twice. In the first pass, nothing is output.
+ * Instead, a DuplicateRecord is noted for each game that would be
+ * checked for being a duplicate, numbering the games in the order
+ * in which they are met. The records are sorted by their hash values,
+ * in runs of bounded size that are spilled to temporary files and
+ * then merged. In the sorted order, the first record of each group
+ * with the same hash values is the original, and the rest are its
+ * duplicates. A record of each duplicate, holding the file number
+ * of its original, is then sorted again by game number.
+ *
+ * In the second pass the games are processed as usual, except that
+ * external_previous_occurance takes the place of the duplicate table:
+ * a game is a duplicate if it is the next in the sorted list of
+ * duplicates.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bool.h"
+#include "mymalloc.h"
+#include "defs.h"
+#include "typedef.h"
+#include "tokens.h"
+#include "taglist.h"
+#include "lex.h"
+#include "grammar.h"
+#include "gameindex.h"
+#include "dupsort.h"
+
+/* The number of records sorted in memory before a run is
+ * spilled to a temporary file.
+ */
+#define DUPLICATE_RUN_LENGTH (1 << 20)
+/* The most runs merged at once. If there are more, they are
+ * merged in groups of this size until there are few enough.
+ */
+#define MAX_MERGED_RUNS 16
+
+/* What is noted about a game for duplicate detection. */
+typedef struct {
+    /* The hash values that must both match for a duplicate. */
+    HashCode final_hash_value, cumulative_hash_value;
+    /* The position of the game in the order in which the games
+     * are checked, counting from 1.
+     */
+    unsigned long game_number;
+    /* The file list index of the file containing the game or,
+     * for a duplicate, the one containing its original.
+     */
+    unsigned file_number;
+} DuplicateRecord;
+
+typedef int (*RecordComparison)(const void *, const void *);
+
+/* The state of a sort of DuplicateRecords. */
+typedef struct {
+    RecordComparison compare;
+    /* The records not yet spilled to a run. */
+    DuplicateRecord *buffer;
+    size_t num_buffered;
+    /* The runs spilled so far. */
+    FILE **runs;
+    unsigned num_runs, run_space;
+    /* Once the sort is finished:
+     *  + with no runs, the next record to be read from buffer;
+     *  + otherwise, the next record of each run,
+     *    and whether there is one.
+     */
+    size_t next_buffered;
+    DuplicateRecord *heads;
+    Boolean *head_valid;
+} RecordSorter;
+
+/* Whether the first pass is in progress. */
+static Boolean first_pass = FALSE;
+/* The number of games checked so far in the current pass. */
+static unsigned long games_checked = 0;
+/* The records of the first pass, by hash values. */
+static RecordSorter games_by_hash;
+/* The duplicates, by game number, for the second pass. */
+static RecordSorter duplicates_by_number;
+/* The next duplicate to be met in the second pass, if any. */
+static DuplicateRecord next_duplicate;
+static Boolean have_next_duplicate = FALSE;
+
+/* Order DuplicateRecords by their hash values and then by game number. */
+static int
+compare_by_hash(const void *r1, const void *r2)
+{
+    const DuplicateRecord *d1 = (const DuplicateRecord *) r1;
+    const DuplicateRecord *d2 = (const DuplicateRecord *) r2;
+
+    if (d1->final_hash_value != d2->final_hash_value) {
+        return d1->final_hash_value < d2->final_hash_value ? -1 : 1;
+    }
+    else if (d1->cumulative_hash_value != d2->cumulative_hash_value) {
+        return d1->cumulative_hash_value < d2->cumulative_hash_value ? -1 : 1;
+    }
+    else if (d1->game_number != d2->game_number) {
+        return d1->game_number < d2->game_number ? -1 : 1;
+    }
+    else {
+        return 0;
+    }
+}
+
+/* Order DuplicateRecords by game number. */
+static int
+compare_by_number(const void *r1, const void *r2)
+{
+    const DuplicateRecord *d1 = (const DuplicateRecord *) r1;
+    const DuplicateRecord *d2 = (const DuplicateRecord *) r2;
+
+    if (d1->game_number != d2->game_number) {
+        return d1->game_number < d2->game_number ? -1 : 1;
+    }
+    else {
+        return 0;
+    }
+}
+
+static void
+init_sorter(RecordSorter *sorter, RecordComparison compare)
+{
+    sorter->compare = compare;
+    sorter->buffer = (DuplicateRecord *)
+            malloc_or_die(DUPLICATE_RUN_LENGTH * sizeof (*sorter->buffer));
+    sorter->num_buffered = 0;
+    sorter->runs = NULL;
+    sorter->num_runs = sorter->run_space = 0;
+    sorter->next_buffered = 0;
+    sorter->heads = NULL;
+    sorter->head_valid = NULL;
+}
+
+/* Add run to the runs of sorter. */
+static void
+add_run(RecordSorter *sorter, FILE *run)
+{
+    if (sorter->num_runs == sorter->run_space) {
+        sorter->run_space = sorter->run_space == 0 ? 16 : 2 * sorter->run_space;
+        sorter->runs = (FILE **) realloc_or_die((void *) sorter->runs,
+                sorter->run_space * sizeof (*sorter->runs));
+    }
+    sorter->runs[sorter->num_runs] = run;
+    sorter->num_runs++;
+}
+
+/* Return a new temporary file for a run. */
+static FILE *
+new_run(void)
+{
+    FILE *run = tmpfile();
+
+    if (run == NULL) {
+        fprintf(GlobalState.logfile,
+                "Unable to create a temporary file for --externaldupes.\n");
+        exit(1);
+    }
+    return run;
+}
+
+/* Write record to run. */
+static void
+write_run_record(FILE *run, const DuplicateRecord *record)
+{
+    if (fwrite((const void *) record, sizeof (*record), 1, run) != 1) {
+        fprintf(GlobalState.logfile,
+                "Unable to write to a temporary file for --externaldupes.\n");
+        exit(1);
+    }
+}
+
+/* Sort the buffered records of sorter and write them out as a new run. */
+static void
+spill_run(RecordSorter *sorter)
+{
+    FILE *run = new_run();
+    size_t i;
+
+    qsort((void *) sorter->buffer, sorter->num_buffered,
+          sizeof (*sorter->buffer), sorter->compare);
+    for (i = 0; i < sorter->num_buffered; i++) {
+        write_run_record(run, &sorter->buffer[i]);
+    }
+    sorter->num_buffered = 0;
+    add_run(sorter, run);
+}
+
+static void
+add_record(RecordSorter *sorter, const DuplicateRecord *record)
+{
+    if (sorter->num_buffered == DUPLICATE_RUN_LENGTH) {
+        spill_run(sorter);
+    }
+    sorter->buffer[sorter->num_buffered] = *record;
+    sorter->num_buffered++;
+}
+
+/* Rewind the num_runs runs and read the first record of each
+ * into heads.
+ */
+static void
+start_merge(FILE **runs, unsigned num_runs, DuplicateRecord *heads, Boolean *head_valid)
+{
+    unsigned r;
+
+    for (r = 0; r < num_runs; r++) {
+        rewind(runs[r]);
+        head_valid[r] = fread((void *) &heads[r], sizeof (heads[r]), 1, runs[r]) == 1;
+    }
+}
+
+/* Set *record to the least of the heads of the runs, and replace it
+ * with the next record of its run.
+ * Return FALSE if all of the runs are exhausted.
+ */
+static Boolean
+next_merged_record(FILE **runs, unsigned num_runs, DuplicateRecord *heads,
+        Boolean *head_valid, RecordComparison compare, DuplicateRecord *record)
+{
+    unsigned least = num_runs;
+    unsigned r;
+
+    for (r = 0; r < num_runs; r++) {
+        if (head_valid[r] &&
+                (least == num_runs || (*compare)(&heads[r], &heads[least]) < 0)) {
+            least = r;
+        }
+    }
+    if (least == num_runs) {
+        return FALSE;
+    }
+    *record = heads[least];
+    head_valid[least] = fread((void *) &heads[least], sizeof (heads[least]), 1,
+                              runs[least]) == 1;
+    return TRUE;
+}
+
+/* Finish adding records to sorter, ready for them to be read back
+ * in order with next_record.
+ */
+static void
+finish_sorting(RecordSorter *sorter)
+{
+    if (sorter->num_runs == 0) {
+        /* Everything fits in memory. */
+        qsort((void *) sorter->buffer, sorter->num_buffered,
+              sizeof (*sorter->buffer), sorter->compare);
+        sorter->next_buffered = 0;
+        return;
+    }
+    if (sorter->num_buffered > 0) {
+        spill_run(sorter);
+    }
+    (void) free((void *) sorter->buffer);
+    sorter->buffer = NULL;
+    sorter->heads = (DuplicateRecord *)
+            malloc_or_die(MAX_MERGED_RUNS * sizeof (*sorter->heads));
+    sorter->head_valid = (Boolean *)
+            malloc_or_die(MAX_MERGED_RUNS * sizeof (*sorter->head_valid));
+    /* Reduce the number of runs to one that can be merged at once. */
+    while (sorter->num_runs > MAX_MERGED_RUNS) {
+        FILE **runs = sorter->runs;
+        unsigned num_runs = sorter->num_runs;
+        unsigned first;
+
+        sorter->runs = NULL;
+        sorter->num_runs = sorter->run_space = 0;
+        for (first = 0; first < num_runs; first += MAX_MERGED_RUNS) {
+            unsigned group = num_runs - first < MAX_MERGED_RUNS ?
+                    num_runs - first : MAX_MERGED_RUNS;
+            FILE *merged = new_run();
+            DuplicateRecord record;
+            unsigned r;
+
+            start_merge(&runs[first], group, sorter->heads, sorter->head_valid);
+            while (next_merged_record(&runs[first], group, sorter->heads,
+                                      sorter->head_valid, sorter->compare, &record)) {
+                write_run_record(merged, &record);
+            }
+            for (r = first; r < first + group; r++) {
+                (void) fclose(runs[r]);
+            }
+            add_run(sorter, merged);
+        }
+        (void) free((void *) runs);
+    }
+    start_merge(sorter->runs, sorter->num_runs, sorter->heads, sorter->head_valid);
+}
+
+/* Set *record to the next record of sorter in order.
+ * Return FALSE if there are no more.
+ */
+static Boolean
+next_record(RecordSorter *sorter, DuplicateRecord *record)
+{
+    if (sorter->num_runs == 0) {
+        if (sorter->next_buffered < sorter->num_buffered) {
+            *record = sorter->buffer[sorter->next_buffered];
+            sorter->next_buffered++;
+            return TRUE;
+        }
+        else {
+            return FALSE;
+        }
+    }
+    else {
+        return next_merged_record(sorter->runs, sorter->num_runs, sorter->heads,
+                                  sorter->head_valid, sorter->compare, record);
+    }
+}
+
+/* Release everything held by sorter. */
+static void
+free_sorter(RecordSorter *sorter)
+{
+    unsigned r;
+
+    for (r = 0; r < sorter->num_runs; r++) {
+        (void) fclose(sorter->runs[r]);
+    }
+    if (sorter->runs != NULL) {
+        (void) free((void *) sorter->runs);
+    }
+    if (sorter->buffer != NULL) {
+        (void) free((void *) sorter->buffer);
+    }
+    if (sorter->heads != NULL) {
+        (void) free((void *) sorter->heads);
+        (void) free((void *) sorter->head_valid);
+    }
+    memset((void *) sorter, 0, sizeof (*sorter));
+}
+
+/* Return TRUE if duplicates are to be detected with --externaldupes.
+ * Those options that need the duplicate table, or input that
+ * cannot be read twice, prevent it, in which case the table is
+ * used as usual.
+ */
+Boolean
+external_duplicates_possible(void)
+{
+    if (!GlobalState.external_duplicates) {
+        return FALSE;
+    }
+    else if (!GlobalState.suppress_duplicates && !GlobalState.suppress_originals &&
+            !GlobalState.fuzzy_match_duplicates && GlobalState.duplicate_file == NULL) {
+        /* There is no duplicate detection to be done. */
+        GlobalState.external_duplicates = FALSE;
+        return FALSE;
+    }
+    else if (num_input_files() == 0) {
+        fprintf(GlobalState.logfile,
+                "--externaldupes cannot be used with standard input, so duplicates will be detected in memory.\n");
+        GlobalState.external_duplicates = FALSE;
+        return FALSE;
+    }
+    else if ((GlobalState.fuzzy_match_duplicates && GlobalState.fuzzy_match_depth > 0) ||
+            GlobalState.use_virtual_hash_table ||
+            GlobalState.near_duplicate_similarity > 0 ||
+            GlobalState.duplicate_database != NULL ||
+            GlobalState.delete_same_setup) {
+        fprintf(GlobalState.logfile,
+                "--externaldupes cannot be used with the other options given, so duplicates will be detected in memory.\n");
+        GlobalState.external_duplicates = FALSE;
+        return FALSE;
+    }
+    else {
+        return TRUE;
+    }
+}
+
+/* Return TRUE if this is the first pass of --externaldupes,
+ * in which games are noted rather than output.
+ */
+Boolean
+recording_external_duplicates(void)
+{
+    return first_pass;
+}
+
+/* Note the hash values of a game in the first pass, if it is one
+ * that will be checked for being a duplicate.
+ */
+void
+note_game_for_external_duplicates(const Game *game_details, Boolean criteria_met)
+{
+    if (criteria_met) {
+        DuplicateRecord record;
+
+        games_checked++;
+        memset((void *) &record, 0, sizeof (record));
+        record.final_hash_value = game_details->final_hash_value;
+        /* A fuzzy match at depth 0 is on the final position alone. */
+        record.cumulative_hash_value = GlobalState.fuzzy_match_duplicates ?
+                0 : game_details->cumulative_hash_value;
+        record.game_number = games_checked;
+        record.file_number = current_file_number();
+        add_record(&games_by_hash, &record);
+    }
+}
+
+/* Find the duplicates among the games noted in the first pass,
+ * and sort them by game number for the second pass.
+ */
+static void
+find_external_duplicates(void)
+{
+    DuplicateRecord record, original;
+    Boolean have_original = FALSE;
+
+    finish_sorting(&games_by_hash);
+    init_sorter(&duplicates_by_number, compare_by_number);
+    while (next_record(&games_by_hash, &record)) {
+        if (have_original &&
+                record.final_hash_value == original.final_hash_value &&
+                record.cumulative_hash_value == original.cumulative_hash_value) {
+            record.file_number = original.file_number;
+            add_record(&duplicates_by_number, &record);
+        }
+        else {
+            original = record;
+            have_original = TRUE;
+        }
+    }
+    free_sorter(&games_by_hash);
+    finish_sorting(&duplicates_by_number);
+    have_next_duplicate = next_record(&duplicates_by_number, &next_duplicate);
+}
+
+/* Return the name of the file in which the next game to be checked
+ * in the second pass was first found, if it is a duplicate,
+ * otherwise return NULL.
+ */
+const char *
+external_previous_occurance(void)
+{
+    const char *original_filename = NULL;
+
+    games_checked++;
+    if (have_next_duplicate && next_duplicate.game_number == games_checked) {
+        original_filename = input_file_name(next_duplicate.file_number);
+        have_next_duplicate = next_record(&duplicates_by_number, &next_duplicate);
+    }
+    return original_filename;
+}
+
+/* Process the input files in two passes to detect duplicates. */
+void
+process_files_with_external_duplicates(void)
+{
+    FILE *logfile = GlobalState.logfile;
+    unsigned verbosity = GlobalState.verbosity;
+
+    /* In the first pass, the log is discarded, because everything
+     * written to it will be written again in the second pass.
+     */
+    GlobalState.logfile = tmpfile();
+    if (GlobalState.logfile == NULL) {
+        GlobalState.logfile = logfile;
+        fprintf(GlobalState.logfile,
+                "Unable to create a temporary file for --externaldupes.\n");
+        exit(1);
+    }
+    GlobalState.verbosity &= ~RUNNING_STATUS;
+    init_sorter(&games_by_hash, compare_by_hash);
+    games_checked = 0;
+    first_pass = TRUE;
+    if (!open_first_file()) {
+        GlobalState.logfile = logfile;
+        fprintf(GlobalState.logfile, "Unable to open the PGN file: %s\n",
+                input_file_name(0));
+        exit(1);
+    }
+    yyparse(GlobalState.current_file_type);
+    abandon_game_index();
+    first_pass = FALSE;
+    (void) fclose(GlobalState.logfile);
+    GlobalState.logfile = logfile;
+    GlobalState.verbosity = verbosity;
+
+    find_external_duplicates();
+
+    /* The second pass. */
+    GlobalState.num_games_processed = 0;
+    games_checked = 0;
+    if (!reopen_first_file()) {
+        exit(1);
+    }
+    yyparse(GlobalState.current_file_type);
+    abandon_game_index();
+    free_sorter(&duplicates_by_number);
+}
@@ -0,0 +1,36 @@
+/*
+ *  This file is part of pgn-extract: a Portable Game Notation (PGN) extractor.
+ *  Copyright (C) 1994-2026 David J. Barnes
+ *
+ *  pgn-extract is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  pgn-extract is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with pgn-extract. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  David J. Barnes may be contacted as d.j.barnes@kent.ac.uk
+ *  https://www.cs.kent.ac.uk/people/staff/djb/
+ */
+
+        /* Detect duplicates in two passes over the input, by sorting
+         * the hash values of the games in bounded memory
+         * (--externaldupes).
+         */
+#ifndef DUPSORT_H
+#define DUPSORT_H
+
+Boolean external_duplicates_possible(void);
+const char *external_previous_occurance(void);
+void note_game_for_external_duplicates(const Game *game_details, Boolean criteria_met);
+void process_files_with_external_duplicates(void);
+Boolean recording_external_duplicates(void);
+
+#endif	// DUPSORT_H
+
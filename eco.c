@@ -19,10 +19,21 @@
  *  https://www.cs.kent.ac.uk/people/staff/djb/
  */
 
+#if defined(__unix__) || defined(__linux__) || defined(__APPLE__)
+/* A compiled ECO table is accessed via mmap() rather than being
+ * read into memory.
+ */
+#define MAP_ECO_TABLE
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#ifdef MAP_ECO_TABLE
+#include <sys/types.h>
+#include <sys/mman.h>
+#endif
 #include "bool.h"
 #include "mymalloc.h"
 #include "defs.h"
@@ -52,6 +63,30 @@ static unsigned maximum_half_moves = ECO_HALF_MOVE_LIMIT;
 #define ECO_TABLE_SIZE 4096
 static EcoLog **EcoTable;
 
+/* Once the ECO lines have been read, EcoTable no longer changes,
+ * so it is frozen into FrozenEcoTable for eco_matches.
+ * This is a flat array of the entries, sorted by bucket, in which each
+ * element holds all of the fields of an entry needed to decide a match.
+ * The entries of bucket b are those from FrozenEcoBuckets[b] up to
+ * FrozenEcoBuckets[b + 1], so a lookup reads one offset pair and
+ * then a few adjacent elements, rather than following a chain.
+ * Entries with the same required_hash_value are kept in the order
+ * of their EcoTable chain, so matches are chosen exactly as they
+ * would be from the chain.
+ */
+typedef struct {
+    HashCode required_hash_value;
+    HashCode cumulative_hash_value;
+    const EcoLog *entry;
+    unsigned half_moves;
+    Colour to_move;
+} FrozenEcoEntry;
+
+static FrozenEcoEntry *FrozenEcoTable = NULL;
+static uint32_t *FrozenEcoBuckets = NULL;
+/* One less than the number of buckets, which is a power of two. */
+static unsigned long frozen_eco_mask = 0;
+
 #if INCLUDE_UNUSED_FUNCTIONS
 
 static void
@@ -268,6 +303,68 @@ save_eco_details(const Game *game_details, const Board *final_position, unsigned
     }
 }
 
+/* Build FrozenEcoTable from the entries of EcoTable.
+ * This must be called once all of the ECO lines have been read,
+ * and before eco_matches is used.
+ */
+void
+freeze_eco_table(void)
+{
+    unsigned long num_entries = 0, num_buckets = 16, bucket;
+    FrozenEcoEntry *frozen;
+    unsigned ix;
+
+    for (ix = 0; ix < ECO_TABLE_SIZE; ix++) {
+        const EcoLog *entry;
+        for (entry = EcoTable[ix]; entry != NULL; entry = entry->next) {
+            num_entries++;
+        }
+    }
+    /* Aim for an average of no more than one entry in every two buckets. */
+    while (num_buckets < 2 * num_entries) {
+        num_buckets *= 2;
+    }
+    frozen_eco_mask = num_buckets - 1;
+    FrozenEcoTable = (FrozenEcoEntry *) malloc_or_die((num_entries + 1) * sizeof (*FrozenEcoTable));
+    FrozenEcoBuckets = (uint32_t *) malloc_or_die((num_buckets + 1) * sizeof (*FrozenEcoBuckets));
+
+    /* Count the entries of each bucket in the slot of the next bucket,
+     * then turn the counts into the offsets at which the buckets start.
+     */
+    memset((void *) FrozenEcoBuckets, 0, (num_buckets + 1) * sizeof (*FrozenEcoBuckets));
+    for (ix = 0; ix < ECO_TABLE_SIZE; ix++) {
+        const EcoLog *entry;
+        for (entry = EcoTable[ix]; entry != NULL; entry = entry->next) {
+            FrozenEcoBuckets[(entry->required_hash_value & frozen_eco_mask) + 1]++;
+        }
+    }
+    for (bucket = 1; bucket <= num_buckets; bucket++) {
+        FrozenEcoBuckets[bucket] += FrozenEcoBuckets[bucket - 1];
+    }
+    /* Fill the buckets, advancing the offset of each bucket past
+     * every entry placed in it.
+     * Entries with the same required_hash_value share a chain, so
+     * their order is kept.
+     * This leaves each offset at the start of the next bucket,
+     * so the offsets are then moved along by one.
+     */
+    for (ix = 0; ix < ECO_TABLE_SIZE; ix++) {
+        const EcoLog *entry;
+        for (entry = EcoTable[ix]; entry != NULL; entry = entry->next) {
+            bucket = entry->required_hash_value & frozen_eco_mask;
+            frozen = &FrozenEcoTable[FrozenEcoBuckets[bucket]++];
+            frozen->required_hash_value = entry->required_hash_value;
+            frozen->cumulative_hash_value = entry->cumulative_hash_value;
+            frozen->entry = entry;
+            frozen->half_moves = entry->half_moves;
+            frozen->to_move = entry->to_move;
+        }
+    }
+    memmove((void *) &FrozenEcoBuckets[1], (void *) &FrozenEcoBuckets[0],
+            num_buckets * sizeof (*FrozenEcoBuckets));
+    FrozenEcoBuckets[0] = 0;
+}
+
 /* Look in EcoTable for current_hash_value.
  * Use cumulative_hash_value to refine the match.
  * An exact match is preferable to a partial match.
@@ -276,27 +373,29 @@ EcoLog *
 eco_matches(const Board *board, HashCode cumulative_hash_value,
             unsigned half_moves_played)
 {
-    HashCode current_hash_value = board->weak_hash_value;
-    EcoLog *possible = NULL;
+    HashCode current_hash_value = board->zobrist;
+    const EcoLog *possible = NULL;
 
     /* Don't bother trying if we are too far on in the game.  */
     if (half_moves_played <= maximum_half_moves) {
         /* Where to look. */
-        unsigned ix = current_hash_value % ECO_TABLE_SIZE;
-        EcoLog *entry;
+        const FrozenEcoEntry *frozen, *end;
+        unsigned long bucket;
 
-        for (entry = EcoTable[ix]; entry != NULL; entry = entry->next) {
-            if (entry->required_hash_value == current_hash_value) {
+        bucket = current_hash_value & frozen_eco_mask;
+        end = &FrozenEcoTable[FrozenEcoBuckets[bucket + 1]];
+        for (frozen = &FrozenEcoTable[FrozenEcoBuckets[bucket]]; frozen < end; frozen++) {
+            if (frozen->required_hash_value == current_hash_value) {
                 /* See if we have a full match. */
-                if (half_moves_played == entry->half_moves &&
-                        board->to_move == entry->to_move &&
-                        entry->cumulative_hash_value == cumulative_hash_value) {
-                    return entry;
+                if (half_moves_played == frozen->half_moves &&
+                        board->to_move == frozen->to_move &&
+                        frozen->cumulative_hash_value == cumulative_hash_value) {
+                    return (EcoLog *) frozen->entry;
                 }
-                else if ((half_moves_played - entry->half_moves) <=
-                        ECO_HALF_MOVE_LIMIT && board->to_move == entry->to_move) {
+                else if ((half_moves_played - frozen->half_moves) <=
+                        ECO_HALF_MOVE_LIMIT && board->to_move == frozen->to_move) {
                     /* Retain this as a possible. */
-                    possible = entry;
+                    possible = frozen->entry;
                 }
                 else {
                     /* Ignore it, as the lines are too distant. */
@@ -304,7 +403,317 @@ eco_matches(const Board *board, HashCode cumulative_hash_value,
             }
         }
     }
-    return possible;
+    return (EcoLog *) possible;
+}
+
+/* A compiled ECO table (--ecotable) holds the entries of EcoTable,
+ * so that the ECO file need not be parsed on every run.
+ * It consists of an EcoTableHeader, followed by num_records
+ * EcoTableRecords and then string_bytes of nul-terminated tag strings.
+ * The records of each bucket are in the order in which they were
+ * added, so that reloading them recreates the same chains.
+ * The file records the size and a checksum of the contents of the
+ * ECO file from which it was compiled, and is ignored if these
+ * no longer match.
+ * It is in the byte order of the machine that wrote it.
+ */
+#define ECO_TABLE_MAGIC "pgn-extract eco"
+#define ECO_TABLE_VERSION 2
+/* Identifies the byte order of the machine that wrote the table. */
+#define ECO_TABLE_BYTE_ORDER 0x01020304
+/* The string offset of an absent tag. */
+#define ECO_TABLE_NO_TAG 0xFFFFFFFF
+
+typedef struct {
+    char magic[sizeof (ECO_TABLE_MAGIC)];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t record_size;
+    uint32_t num_records;
+    uint32_t string_bytes;
+    uint32_t maximum_half_moves;
+    uint64_t eco_file_size;
+    uint64_t eco_file_checksum;
+} EcoTableHeader;
+
+typedef struct {
+    HashCode required_hash_value;
+    HashCode cumulative_hash_value;
+    uint32_t half_moves;
+    uint32_t to_move;
+    /* Offsets of the ECO, Opening, Variation and SubVariation tags. */
+    uint32_t tags[4];
+} EcoTableRecord;
+
+/* Set the size and checksum of the contents of eco_file in header.
+ * The checksum is the 64-bit FNV-1a hash, which is cheap enough that
+ * reading the whole file costs far less than parsing it.
+ * Return FALSE if the file cannot be read.
+ */
+static Boolean
+set_eco_file_details(EcoTableHeader *header, const char *eco_file)
+{
+    FILE *fp = fopen(eco_file, "rb");
+    unsigned char buffer[BUFSIZ];
+    uint64_t size = 0, checksum = 0xcbf29ce484222325ULL;
+    size_t num_read, i;
+    Boolean ok;
+
+    if (fp == NULL) {
+        return FALSE;
+    }
+    while ((num_read = fread((void *) buffer, 1, sizeof (buffer), fp)) > 0) {
+        for (i = 0; i < num_read; i++) {
+            checksum = (checksum ^ buffer[i]) * 0x100000001b3ULL;
+        }
+        size += num_read;
+    }
+    ok = !ferror(fp);
+    (void) fclose(fp);
+    header->eco_file_size = size;
+    header->eco_file_checksum = checksum;
+    return ok;
+}
+
+/* Return the tag at offset in strings, or NULL if it is absent. */
+static const char *
+eco_table_tag(const char *strings, uint32_t offset)
+{
+    return offset == ECO_TABLE_NO_TAG ? NULL : strings + offset;
+}
+
+/* Return the contents of file, of the given length, either
+ * mapped or read into memory.
+ * Return NULL if they cannot be obtained.
+ */
+static const unsigned char *
+read_eco_table_file(FILE *fp, size_t length)
+{
+#ifdef MAP_ECO_TABLE
+    void *addr = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+    return addr == MAP_FAILED ? NULL : (const unsigned char *) addr;
+#else
+    unsigned char *contents = (unsigned char *) malloc_or_die(length);
+    if (fseek(fp, 0L, SEEK_SET) != 0 ||
+            fread((void *) contents, 1, length, fp) != length) {
+        (void) free((void *) contents);
+        contents = NULL;
+    }
+    return contents;
+#endif
+}
+
+/* Release the contents obtained by read_eco_table_file. */
+static void
+release_eco_table_file(const unsigned char *contents, size_t length)
+{
+#ifdef MAP_ECO_TABLE
+    (void) munmap((void *) contents, length);
+#else
+    (void) length;
+    (void) free((void *) contents);
+#endif
+}
+
+/* Fill EcoTable from the compiled table in table_file, provided
+ * that it was compiled from the current version of eco_file.
+ * Return TRUE if it was, or FALSE if the ECO file must be parsed instead.
+ */
+Boolean
+load_eco_table(const char *table_file, const char *eco_file)
+{
+    FILE *fp = fopen(table_file, "rb");
+    EcoTableHeader header, expected;
+    Boolean loaded = FALSE;
+
+    if (fp == NULL) {
+        /* It has yet to be created. */
+        return FALSE;
+    }
+    if (!set_eco_file_details(&expected, eco_file)) {
+        /* The table cannot be checked without the ECO file.
+         * Its absence is reported when it is opened to be parsed instead.
+         */
+        (void) fclose(fp);
+        return FALSE;
+    }
+    if (fread((void *) &header, sizeof (header), 1, fp) == 1 &&
+            memcmp(header.magic, ECO_TABLE_MAGIC, sizeof (header.magic)) == 0 &&
+            header.version == ECO_TABLE_VERSION &&
+            header.byte_order == ECO_TABLE_BYTE_ORDER &&
+            header.record_size == sizeof (EcoTableRecord) &&
+            header.eco_file_size == expected.eco_file_size &&
+            header.eco_file_checksum == expected.eco_file_checksum) {
+        size_t strings_start = sizeof (header) +
+                (size_t) header.num_records * sizeof (EcoTableRecord);
+        size_t length = strings_start + header.string_bytes;
+        const unsigned char *contents = NULL;
+
+        if (fseek(fp, 0L, SEEK_END) == 0 && ftell(fp) == (long) length &&
+                header.string_bytes > 0 &&
+                (contents = read_eco_table_file(fp, length)) != NULL) {
+            const EcoTableRecord *records =
+                    (const EcoTableRecord *) (contents + sizeof (header));
+            const char *strings = (const char *) contents + strings_start;
+            uint32_t i;
+            int t;
+
+            /* Check that every tag lies within the strings. */
+            loaded = strings[header.string_bytes - 1] == '\0';
+            for (i = 0; i < header.num_records && loaded; i++) {
+                for (t = 0; t < 4; t++) {
+                    if (records[i].tags[t] != ECO_TABLE_NO_TAG &&
+                            records[i].tags[t] >= header.string_bytes) {
+                        loaded = FALSE;
+                    }
+                }
+            }
+            if (loaded) {
+                EcoLog *entries = (EcoLog *)
+                        malloc_or_die(header.num_records * sizeof (*entries));
+
+                for (i = 0; i < header.num_records; i++) {
+                    const EcoTableRecord *record = &records[i];
+                    EcoLog *entry = &entries[i];
+                    unsigned ix = record->required_hash_value % ECO_TABLE_SIZE;
+
+                    entry->required_hash_value = record->required_hash_value;
+                    entry->cumulative_hash_value = record->cumulative_hash_value;
+                    entry->half_moves = record->half_moves;
+                    entry->to_move = (Colour) record->to_move;
+                    entry->ECO_tag = eco_table_tag(strings, record->tags[0]);
+                    entry->Opening_tag = eco_table_tag(strings, record->tags[1]);
+                    entry->Variation_tag = eco_table_tag(strings, record->tags[2]);
+                    entry->Sub_Variation_tag = eco_table_tag(strings, record->tags[3]);
+                    entry->next = EcoTable[ix];
+                    EcoTable[ix] = entry;
+                }
+                maximum_half_moves = header.maximum_half_moves;
+                /* The contents are retained because the entries
+                 * refer to their strings.
+                 */
+            }
+            else {
+                release_eco_table_file(contents, length);
+            }
+        }
+    }
+    (void) fclose(fp);
+    if (!loaded) {
+        fprintf(GlobalState.logfile,
+                "The ECO table %s does not match %s, so it will be rebuilt.\n",
+                table_file, eco_file);
+    }
+    return loaded;
+}
+
+/* Write tag to fp as part of the strings of a compiled table,
+ * updating *string_bytes, and return its offset.
+ */
+static uint32_t
+write_eco_table_tag(FILE *fp, const char *tag, uint32_t *string_bytes)
+{
+    if (tag == NULL) {
+        return ECO_TABLE_NO_TAG;
+    }
+    else {
+        uint32_t offset = *string_bytes;
+        size_t length = strlen(tag) + 1;
+
+        (void) fwrite((void *) tag, 1, length, fp);
+        *string_bytes += (uint32_t) length;
+        return offset;
+    }
+}
+
+/* Compile the contents of EcoTable, read from eco_file, into table_file.
+ * It is written to a temporary file that then replaces table_file,
+ * so that a concurrent run never sees a partial table.
+ * Failure is reported but is not fatal.
+ */
+void
+save_eco_table(const char *table_file, const char *eco_file)
+{
+    char *new_filename = replacement_file_name(table_file);
+    FILE *fp;
+    EcoTableHeader header;
+    EcoTableRecord *records;
+    uint32_t num_records = 0;
+    uint32_t string_bytes = 0;
+    Boolean written = FALSE;
+    unsigned ix;
+
+    memset((void *) &header, 0, sizeof (header));
+    if (!set_eco_file_details(&header, eco_file) ||
+            (fp = fopen(new_filename, "wb")) == NULL) {
+        fprintf(GlobalState.logfile, "Unable to write the ECO table %s.\n",
+                table_file);
+        (void) free((void *) new_filename);
+        return;
+    }
+
+    for (ix = 0; ix < ECO_TABLE_SIZE; ix++) {
+        const EcoLog *entry;
+        for (entry = EcoTable[ix]; entry != NULL; entry = entry->next) {
+            num_records++;
+        }
+    }
+    records = (EcoTableRecord *) malloc_or_die((num_records + 1) * sizeof (*records));
+
+    /* The strings follow the records, so they are written first. */
+    if (fseek(fp, (long) (sizeof (header) + num_records * sizeof (*records)), SEEK_SET) == 0) {
+        uint32_t next = 0;
+
+        for (ix = 0; ix < ECO_TABLE_SIZE; ix++) {
+            /* Chains hold the most recent entry first, so
+             * fill this bucket's records from its end.
+             */
+            uint32_t bucket_records = 0;
+            const EcoLog *entry;
+
+            for (entry = EcoTable[ix]; entry != NULL; entry = entry->next) {
+                bucket_records++;
+            }
+            next += bucket_records;
+            for (entry = EcoTable[ix]; entry != NULL; entry = entry->next) {
+                EcoTableRecord *record = &records[--next];
+
+                memset((void *) record, 0, sizeof (*record));
+                record->required_hash_value = entry->required_hash_value;
+                record->cumulative_hash_value = entry->cumulative_hash_value;
+                record->half_moves = entry->half_moves;
+                record->to_move = (uint32_t) entry->to_move;
+                record->tags[0] = write_eco_table_tag(fp, entry->ECO_tag, &string_bytes);
+                record->tags[1] = write_eco_table_tag(fp, entry->Opening_tag, &string_bytes);
+                record->tags[2] = write_eco_table_tag(fp, entry->Variation_tag, &string_bytes);
+                record->tags[3] = write_eco_table_tag(fp, entry->Sub_Variation_tag, &string_bytes);
+            }
+            next += bucket_records;
+        }
+        /* Ensure that the strings are never empty. */
+        (void) write_eco_table_tag(fp, "", &string_bytes);
+
+        memcpy((void *) header.magic, ECO_TABLE_MAGIC, sizeof (header.magic));
+        header.version = ECO_TABLE_VERSION;
+        header.byte_order = ECO_TABLE_BYTE_ORDER;
+        header.record_size = sizeof (EcoTableRecord);
+        header.num_records = num_records;
+        header.string_bytes = string_bytes;
+        header.maximum_half_moves = maximum_half_moves;
+        written = fseek(fp, 0L, SEEK_SET) == 0 &&
+                fwrite((void *) &header, sizeof (header), 1, fp) == 1 &&
+                fwrite((void *) records, sizeof (*records), num_records, fp) == num_records;
+    }
+    if (fclose(fp) != 0) {
+        written = FALSE;
+    }
+    if (!written || !replace_file(new_filename, table_file)) {
+        fprintf(GlobalState.logfile, "Unable to write the ECO table %s.\n",
+                table_file);
+        (void) remove(new_filename);
+    }
+    (void) free((void *) records);
+    (void) free((void *) new_filename);
 }
 
 /* Depending upon the ECO_level and the eco string of the
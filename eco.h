@@ -45,9 +45,12 @@ typedef struct EcoLog {
 EcoLog *eco_matches(const Board *board, HashCode cumulative_hash_value,
                     unsigned half_moves_played);
 Boolean add_ECO(Game game_details);
+void freeze_eco_table(void);
 FILE *open_eco_output_file(EcoDivision ECO_level,const char *eco);
 void initEcoTable(void);
+Boolean load_eco_table(const char *table_file, const char *eco_file);
 void save_eco_details(const Game *game_details, const Board *final_position, unsigned number_of_moves);
+void save_eco_table(const char *table_file, const char *eco_file);
 
 #endif	// ECO_H
 
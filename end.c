@@ -51,8 +51,6 @@ static Material_details *endings_to_match = NULL;
 /* Define pseudo-letter for minor pieces, used later. */
 #define MINOR_PIECE 'L'
 
-static void add_match_comment(Game *game_details, const Board *board, Move *move_for_comment);
-static Boolean look_for_number_of_pieces(Game *game_details, unsigned target_number_of_pieces);
 static Boolean opposite_colour_bishops(const Board *board);
 
 static Piece
@@ -541,110 +539,135 @@ void extract_pieces_from_board(int num_pieces[2][NUM_PIECE_VALUES], const Board
     }
 }
 
-/* Check to see whether the given moves lead to a position
- * that matches the given 'ending' position.
- * In other words, a position with the required balance
- * of pieces.
+/* The state of the searches for a material match and a piece count,
+ * which are made on each position of a game's main line as
+ * it is played out by play_moves.  The results are reported by
+ * check_for_material_match and check_for_piece_count_match.
+ * A match comment is only added to the game if it is one of the
+ * criteria the game must meet.
  */
-static Boolean
-look_for_material_match(Game *game_details)
-{
-    Boolean game_ok = TRUE;
-    Boolean match_comment_added = FALSE;
-    Move *next_move = game_details->moves;
-    Move *move_for_comment = NULL;
-    Colour colour = WHITE;
-    /* The initial game position has the full set of piece details. */
-    int num_pieces[2][NUM_PIECE_VALUES] = {
-        /* Dummies for OFF and EMPTY at the start. */
-        /*     P  N  B  R  Q  K */
-        {0, 0, 8, 2, 2, 2, 1, 1},
-        {0, 0, 8, 2, 2, 2, 1, 1}
-    };
-    Board *board = new_game_board(game_details->tags[FEN_TAG]);
-
-    if(game_details->tags[FEN_TAG] != NULL) {
-        extract_pieces_from_board(num_pieces, board);
-        colour = board->to_move;
-    }
-    /* Ensure that all previous match indications are cleared. */
-    reset_match_depths(endings_to_match);
+/* The numbers of pieces in the current position. */
+static int search_num_pieces[2][NUM_PIECE_VALUES];
+static unsigned search_piece_count;
+static Boolean material_found, piece_count_found;
+/* Which colour the pieces of the material match were found for. */
+static Boolean white_material_found;
+/* The positions at which the matches were found, for match comments,
+ * and the moves that produced them (NULL for the start of the game).
+ */
+static Board material_board, piece_count_board;
+static Move *material_comment_move, *piece_count_comment_move;
 
-    /* Keep going while the game is ok, and we have some more
-     * moves and we haven't exceeded the search depth without finding
-     * a match.
-     */
-    Boolean matches = FALSE;
-    Boolean end_of_game = FALSE;
-    Boolean white_matches = FALSE, black_matches = FALSE;
-    while (game_ok && !matches && !end_of_game) {
-        for (Material_details *details_to_find = endings_to_match; !matches && (details_to_find != NULL);
+/* Try the position in board for a material match and the required
+ * number of pieces. move_for_comment is the move that produced it.
+ */
+static void
+search_position(const Board *board, Move *move_for_comment)
+{
+    if (!material_found) {
+        for (Material_details *details_to_find = endings_to_match;
+                !material_found && (details_to_find != NULL);
                 details_to_find = details_to_find->next) {
-            /* Try before applying each move.
-             * Note, that we wish to try both ways around because we might
+            /* Note, that we wish to try both ways around because we might
              * have WT,BT WF,BT ... If we don't try BLACK on WHITE success
              * then we might miss a match because a full match takes several
              * separate individual match steps.
              */
-            white_matches = material_match(details_to_find, num_pieces, WHITE);
+            Boolean white_matches = material_match(details_to_find, search_num_pieces, WHITE);
+            Boolean black_matches;
             if(details_to_find->both_colours) {
-                black_matches = material_match(details_to_find, num_pieces, BLACK);
+                black_matches = material_match(details_to_find, search_num_pieces, BLACK);
             }
             else {
                 black_matches = FALSE;
             }
             if (white_matches || black_matches) {
-                matches = TRUE;
-                /* See whether a matching comment is required. */
-                if (GlobalState.add_position_match_comments && !match_comment_added) {
-                    add_match_comment(game_details, board, move_for_comment);
+                material_found = TRUE;
+                white_material_found = white_matches;
+                if (GlobalState.add_position_match_comments) {
+                    material_board = *board;
+                    material_comment_move = move_for_comment;
                 }
             }
         }
-        if(matches) {
-            /* Nothing required. */
-        }
-        else if(next_move == NULL) {
-            end_of_game = TRUE;
+    }
+    if (!piece_count_found && GlobalState.piece_count > 0 &&
+            search_piece_count == GlobalState.piece_count) {
+        piece_count_found = TRUE;
+        if (GlobalState.add_position_match_comments) {
+            piece_count_board = *board;
+            piece_count_comment_move = move_for_comment;
         }
-        else if (*(next_move->move) != '\0') {
-            /* Try the next position. */
-            if (apply_move(next_move, board)) {
-                /* Remove any captured pieces. */
-                if (next_move->captured_piece != EMPTY) {
-                    num_pieces[OPPOSITE_COLOUR(colour)][next_move->captured_piece]--;
-                }
-                if (next_move->promoted_piece != EMPTY) {
-                    num_pieces[colour][next_move->promoted_piece]++;
-                    /* Remove the promoting pawn. */
-                    num_pieces[colour][PAWN]--;
-                }
+    }
+}
 
-                move_for_comment = next_move;
-                colour = OPPOSITE_COLOUR(colour);
-                next_move = next_move->next;
-            }
-            else {
-                game_ok = FALSE;
-            }
+/* Start the searches for a material match and piece count
+ * from the initial position of a game.
+ */
+void
+start_material_search(const Board *board)
+{
+    material_comment_move = piece_count_comment_move = NULL;
+    material_found = endings_to_match == NULL;
+    piece_count_found = GlobalState.piece_count == 0;
+    if (!material_found || !piece_count_found) {
+        extract_pieces_from_board(search_num_pieces, board);
+        search_piece_count = 0;
+        for(int n = 0; n < NUM_PIECE_VALUES; n++) {
+            search_piece_count += search_num_pieces[0][n] + search_num_pieces[1][n];
+        }
+        /* Ensure that all previous match indications are cleared. */
+        reset_match_depths(endings_to_match);
+        search_position(board, NULL);
+    }
+}
+
+/* Continue the searches with the position reached by the
+ * main-line move that has just been played on board.
+ */
+void
+continue_material_search(const Board *board, Move *move)
+{
+    if (!material_found || !piece_count_found) {
+        /* The colour that has just moved. */
+        Colour colour = OPPOSITE_COLOUR(board->to_move);
+
+        /* Remove any captured pieces. */
+        if (move->captured_piece != EMPTY) {
+            search_num_pieces[OPPOSITE_COLOUR(colour)][move->captured_piece]--;
+            search_piece_count--;
         }
-        else {
-            /* An empty move. */
-            fprintf(GlobalState.logfile,
-                    "Internal error: Empty move in look_for_material_match.\n");
-            game_ok = FALSE;
+        if (move->promoted_piece != EMPTY) {
+            search_num_pieces[colour][move->promoted_piece]++;
+            /* Remove the promoting pawn. */
+            search_num_pieces[colour][PAWN]--;
         }
+        search_position(board, move);
     }
-    (void) free((void *) board);
-    if(game_ok && matches) {
-        if(GlobalState.add_match_tag) {
-            game_details->tags[MATERIAL_MATCH_TAG] =
-                copy_string(white_matches ? "White" : "Black");
-        }
-        return TRUE;
+}
+
+/*
+ * Add a comment documenting a match to the given move_for_comment.
+ * If there is no move, add it as a prefix comment to the game.
+ */
+static void
+add_match_comment(Game *game_details, const Board *board, Move *move_for_comment)
+{
+    CommentList *match_comment = create_match_comment(board);
+    if (move_for_comment != NULL) {
+        append_comments_to_move(move_for_comment, match_comment);
     }
     else {
-        return FALSE;
+        if(game_details->prefix_comment == NULL) {
+            game_details->prefix_comment = match_comment;
+        }
+        else {
+            CommentList *comm = game_details->prefix_comment;
+            while(comm->next != NULL) {
+                comm = comm->next;
+            }
+            comm->next = match_comment;
+        }
     }
 }
 
@@ -658,7 +681,16 @@ check_for_material_match(Game *game)
 {
     /* Match if there are no endings to match. */
     if(endings_to_match != NULL) {
-        return look_for_material_match(game);
+        if (material_found) {
+            if (GlobalState.add_position_match_comments) {
+                add_match_comment(game, &material_board, material_comment_move);
+            }
+            if(GlobalState.add_match_tag) {
+                game->tags[MATERIAL_MATCH_TAG] =
+                    copy_string(white_material_found ? "White" : "Black");
+            }
+        }
+        return material_found;
     }
     else {
         return TRUE;
@@ -673,7 +705,10 @@ check_for_piece_count_match(Game *game)
 {
     /* Match if there are no endings to match. */
     if(GlobalState.piece_count > 0) {
-        return look_for_number_of_pieces(game, GlobalState.piece_count);
+        if (piece_count_found && GlobalState.add_position_match_comments) {
+            add_match_comment(game, &piece_count_board, piece_count_comment_move);
+        }
+        return piece_count_found;
     }
     else {
         return TRUE;
@@ -705,80 +740,6 @@ constraint_material_match(Material_details *details_to_find, const Board *board)
     return white_matches || black_matches;
 }
 
-/* Check to see whether the game reaches a point where there
- * exactly the given number of pieces (including kings).
- */
-static Boolean
-look_for_number_of_pieces(Game *game_details, unsigned target_number_of_pieces)
-{
-    Boolean game_ok = TRUE;
-    Move *next_move = game_details->moves;
-    Move *move_for_comment = NULL;
-    Colour colour = WHITE;
-    /* The initial game position has the full set of piece details. */
-    int num_pieces[2][NUM_PIECE_VALUES] = {
-        /* Dummies for OFF and EMPTY at the start. */
-        /*     P  N  B  R  Q  K */
-        {0, 0, 8, 2, 2, 2, 1, 1},
-        {0, 0, 8, 2, 2, 2, 1, 1}
-    };
-    Board *board = new_game_board(game_details->tags[FEN_TAG]);
-
-    if(game_details->tags[FEN_TAG] != NULL) {
-        extract_pieces_from_board(num_pieces, board);
-        colour = board->to_move;
-    }
-
-    unsigned piece_count = 0;
-    for(int n = 0; n < NUM_PIECE_VALUES; n++) {
-        piece_count += num_pieces[0][n] + num_pieces[1][n];
-    }
-
-    /* Keep going while the game is ok, and we have some more
-     * moves without finding a match.
-     */
-    Boolean matches = FALSE;
-    if(piece_count == target_number_of_pieces) {
-        matches = TRUE;
-    }
-    while (game_ok && ! matches && next_move != NULL) {
-        if (*(next_move->move) != '\0') {
-            /* Try the next position. */
-            if (apply_move(next_move, board)) {
-                /* Remove any captured pieces. */
-                if (next_move->captured_piece != EMPTY) {
-                    piece_count--;
-                    if(piece_count == target_number_of_pieces) {
-                        matches = TRUE;
-                        move_for_comment = next_move;
-                    }
-                }
-                colour = OPPOSITE_COLOUR(colour);
-                next_move = next_move->next;
-            }
-            else {
-                game_ok = FALSE;
-            }
-        }
-        else {
-            /* An empty move. */
-            fprintf(GlobalState.logfile,
-                    "Internal error: Empty move in look_for_number_of_pieces.\n");
-            game_ok = FALSE;
-        }
-    }
-    if(game_ok && matches) {
-        if (GlobalState.add_position_match_comments) {
-            add_match_comment(game_details, board, move_for_comment);
-        }
-        return TRUE;
-    }
-    else {
-        (void) free((void *) board);
-        return FALSE;
-    }
-}
-
 /* Decompose the text of line to extract two sets of
  * piece configurations.
  * If both_colours is TRUE then matches will be tried
@@ -916,27 +877,3 @@ opposite_colour_bishops(const Board *board)
     }
 }
 
-/*
- * Add a comment documenting a match to the given move_for_comment.
- * If there is no move, add it as a prefix comment to the game.
- */
-static void
-add_match_comment(Game *game_details, const Board *board, Move *move_for_comment)
-{
-    CommentList *match_comment = create_match_comment(board);
-    if (move_for_comment != NULL) {
-        append_comments_to_move(move_for_comment, match_comment);
-    }
-    else {
-        if(game_details->prefix_comment == NULL) {
-            game_details->prefix_comment = match_comment;
-        }
-        else {
-            CommentList *comm = game_details->prefix_comment;
-            while(comm->next != NULL) {
-                comm = comm->next;
-            }
-            comm->next = match_comment;
-        }
-    }
-}
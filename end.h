@@ -65,9 +65,11 @@ Boolean build_endings(const char *infile, Boolean both_colours);
 Boolean check_for_material_match(Game *game);
 Boolean check_for_piece_count_match(Game *game);
 Boolean constraint_material_match(Material_details *details_to_find, const Board *board);
+void continue_material_search(const Board *board, Move *move);
 void extract_pieces_from_board(int num_pieces[2][NUM_PIECE_VALUES], const Board *board);
 Boolean insufficient_material(const Board *board);
 Material_details *process_material_description(const char *line, Boolean both_colours, Boolean pattern_constraint);
+void start_material_search(const Board *board);
 
 #endif	// END_H
 
@@ -0,0 +1,224 @@
+/*
+ *  This file is part of pgn-extract: a Portable Game Notation (PGN) extractor.
+ *  Copyright (C) 1994-2026 David J. Barnes
+ *
+ *  pgn-extract is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  pgn-extract is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with pgn-extract. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  David J. Barnes may be contacted as d.j.barnes@kent.ac.uk
+ *  https://www.cs.kent.ac.uk/people/staff/djb/
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "bool.h"
+#include "mymalloc.h"
+#include "defs.h"
+#include "typedef.h"
+#include "gameindex.h"
+
+/* The layout of an index file is a GameIndexHeader followed by
+ * one GameIndexEntry for each game, in the order of the games.
+ * Both are written in the native byte order.
+ * The size and modification time of the PGN file are recorded so
+ * that an index that no longer matches its file is not used.
+ */
+typedef struct {
+    char magic[8];
+    uint64_t entry_size;
+    uint64_t file_size;
+    int64_t modification_time;
+    uint64_t num_games;
+} GameIndexHeader;
+
+static const char INDEX_MAGIC[8] = { 'P', 'G', 'N', 'I', 'D', 'X', '1', '\n' };
+#define INDEX_SUFFIX ".pgi"
+
+/* The index currently being built, if any. */
+static FILE *index_file = NULL;
+static char *index_filename = NULL;
+static GameIndexHeader index_header;
+/* The game most recently indexed, which is only written
+ * once the start of the next one is known.
+ */
+static GameIndexEntry pending_entry;
+
+/* Return the name of the index file for pgn_file:
+ * the .pgn suffix, if any, is replaced by .pgi.
+ */
+static char *
+index_file_name(const char *pgn_file)
+{
+    size_t len = strlen(pgn_file);
+    char *name = (char *) malloc_or_die(len + sizeof(INDEX_SUFFIX));
+
+    strcpy(name, pgn_file);
+    if (len > 4 && strcmp(name + len - 4, ".pgn") == 0) {
+        name[len - 4] = '\0';
+    }
+    strcat(name, INDEX_SUFFIX);
+    return name;
+}
+
+/* Fill in the details of pgn in header.
+ * Return FALSE if they are not available.
+ */
+static Boolean
+describe_pgn_file(FILE *pgn, GameIndexHeader *header)
+{
+    struct stat info;
+
+    if (fstat(fileno(pgn), &info) != 0) {
+        return FALSE;
+    }
+    memset((void *) header, 0, sizeof(*header));
+    memcpy((void *) header->magic, (const void *) INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    header->entry_size = sizeof(GameIndexEntry);
+    header->file_size = (uint64_t) info.st_size;
+    header->modification_time = (int64_t) info.st_mtime;
+    return TRUE;
+}
+
+/* Start building an index of pgn_file, which is open as pgn.
+ * Games are added with index_game and the index is written by
+ * complete_game_index once the whole file has been read.
+ */
+void
+begin_game_index(const char *pgn_file, FILE *pgn)
+{
+    abandon_game_index();
+    if (describe_pgn_file(pgn, &index_header)) {
+        index_filename = index_file_name(pgn_file);
+        index_file = fopen(index_filename, "wb");
+        if (index_file == NULL) {
+            fprintf(GlobalState.logfile, "Unable to write the index file %s.\n",
+                    index_filename);
+            (void) free((void *) index_filename);
+            index_filename = NULL;
+        }
+        else {
+            /* The header is written properly on completion.
+             * Until then, a zeroed one marks the index as incomplete.
+             */
+            GameIndexHeader placeholder;
+
+            memset((void *) &placeholder, 0, sizeof(placeholder));
+            (void) fwrite((void *) &placeholder, sizeof(placeholder), 1, index_file);
+            memset((void *) &pending_entry, 0, sizeof(pending_entry));
+        }
+    }
+}
+
+/* Write the pending entry, now that its length is known. */
+static void
+write_pending_entry(uint64_t next_offset)
+{
+    if (pending_entry.game_number > 0) {
+        pending_entry.length = next_offset - pending_entry.offset;
+        (void) fwrite((void *) &pending_entry, sizeof(pending_entry), 1, index_file);
+    }
+}
+
+/* Add the next game of the file being indexed, which starts on
+ * the line numbered start_line, at the given byte offset.
+ */
+void
+index_game(unsigned long start_line, uint64_t offset)
+{
+    if (index_file != NULL) {
+        write_pending_entry(offset);
+        pending_entry.game_number++;
+        pending_entry.offset = offset;
+        pending_entry.start_line = start_line;
+    }
+}
+
+/* The whole of the file being indexed has been read, so the
+ * index can be written.
+ */
+void
+complete_game_index(uint64_t file_length)
+{
+    if (index_file != NULL) {
+        write_pending_entry(file_length);
+        index_header.num_games = pending_entry.game_number;
+        if (fseek(index_file, 0, SEEK_SET) != 0 ||
+                fwrite((void *) &index_header, sizeof(index_header), 1, index_file) != 1 ||
+                fclose(index_file) != 0) {
+            fprintf(GlobalState.logfile, "Unable to write the index file %s.\n",
+                    index_filename);
+            (void) remove(index_filename);
+        }
+        index_file = NULL;
+        (void) free((void *) index_filename);
+        index_filename = NULL;
+    }
+}
+
+/* Discard any index being built, because its file will not
+ * be read to the end.
+ */
+void
+abandon_game_index(void)
+{
+    if (index_file != NULL) {
+        (void) fclose(index_file);
+        (void) remove(index_filename);
+        index_file = NULL;
+        (void) free((void *) index_filename);
+        index_filename = NULL;
+    }
+}
+
+/* Read the entry for the game with the given number from the index of pgn_file,
+ * which is open as pgn, and set *num_games to the number of games
+ * in the file.
+ * If number is greater than the number of games then
+ * only *num_games is set.
+ * Return FALSE if there is no up-to-date index for the file.
+ */
+Boolean
+read_game_index(const char *pgn_file, FILE *pgn, unsigned long number,
+                GameIndexEntry *entry, unsigned long *num_games)
+{
+    Boolean ok = FALSE;
+    GameIndexHeader expected, header;
+    char *filename = index_file_name(pgn_file);
+    FILE *fp = fopen(filename, "rb");
+
+    if (fp != NULL) {
+        if (describe_pgn_file(pgn, &expected) &&
+                fread((void *) &header, sizeof(header), 1, fp) == 1 &&
+                memcmp((void *) header.magic, (void *) expected.magic, sizeof(header.magic)) == 0 &&
+                header.entry_size == expected.entry_size &&
+                header.file_size == expected.file_size &&
+                header.modification_time == expected.modification_time) {
+            *num_games = (unsigned long) header.num_games;
+            if (number == 0 || number > header.num_games) {
+                ok = TRUE;
+            }
+            else if (fseek(fp, (long) (sizeof(header) + (number - 1) * sizeof(*entry)),
+                            SEEK_SET) == 0 &&
+                    fread((void *) entry, sizeof(*entry), 1, fp) == 1 &&
+                    entry->game_number == number) {
+                ok = TRUE;
+            }
+        }
+        (void) fclose(fp);
+    }
+    (void) free((void *) filename);
+    return ok;
+}
@@ -0,0 +1,50 @@
+/*
+ *  This file is part of pgn-extract: a Portable Game Notation (PGN) extractor.
+ *  Copyright (C) 1994-2026 David J. Barnes
+ *
+ *  pgn-extract is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  pgn-extract is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with pgn-extract. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  David J. Barnes may be contacted as d.j.barnes@kent.ac.uk
+ *  https://www.cs.kent.ac.uk/people/staff/djb/
+ */
+
+        /* An index of the games in a PGN file, kept alongside it
+         * in a file with the suffix .pgi (--index), so that games
+         * can be found without lexing all of those before them.
+         */
+#ifndef GAMEINDEX_H
+#define GAMEINDEX_H
+
+#include <stdint.h>
+
+/* The index entry for a single game. */
+typedef struct {
+    /* The byte offset in the file of the line on which the game starts. */
+    uint64_t offset;
+    /* The number of bytes from there to the start of the next game. */
+    uint64_t length;
+    /* The line number on which the game starts. */
+    uint64_t start_line;
+    /* The number of the game within the file, from 1. */
+    uint64_t game_number;
+} GameIndexEntry;
+
+void abandon_game_index(void);
+void begin_game_index(const char *pgn_file, FILE *pgn);
+void complete_game_index(uint64_t file_length);
+void index_game(unsigned long start_line, uint64_t offset);
+Boolean read_game_index(const char *pgn_file, FILE *pgn, unsigned long number,
+                        GameIndexEntry *entry, unsigned long *num_games);
+
+#endif	// GAMEINDEX_H
@@ -0,0 +1,168 @@
+/*
+ *  This file is part of pgn-extract: a Portable Game Notation (PGN) extractor.
+ *  Copyright (C) 1994-2026 David J. Barnes
+ *
+ *  pgn-extract is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  pgn-extract is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with pgn-extract. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  David J. Barnes may be contacted as d.j.barnes@kent.ac.uk
+ *  https://www.cs.kent.ac.uk/people/staff/djb/
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "bool.h"
+#include "defs.h"
+#include "typedef.h"
+#include "taglist.h"
+#include "output.h"
+#include "globalstate.h"
+
+/* The maximum length of an output line.  This is conservatively
+ * slightly smaller than the PGN export standard of 80.
+ */
+#define MAX_LINE_LENGTH 75
+
+/* Define a file name relative to the current directory representing
+ * a file of ECO classificiations.
+ */
+#ifndef DEFAULT_ECO_FILE
+#define DEFAULT_ECO_FILE "eco.pgn"
+#endif
+
+/* This structure holds details of the program state
+ * available to all parts of the program.
+ * This goes against the grain of good structured programming
+ * principles, but most of these fields are set from the program's
+ * arguments and are read-only thereafter. If I had done this in
+ * C++ there would have been a cleaner interface!
+ */
+StateInfo GlobalState = {
+    FALSE,              /* skipping_current_game */
+    FALSE,              /* check_only (-r) */
+    PER_GAME_SUMMARY | RUNNING_STATUS | COUNT_SUMMARY, /* verbosity level (-s and --quiet) */
+    TRUE,               /* keep_NAGs (-N) */
+    TRUE,               /* keep_comments (-C) */
+    TRUE,               /* keep_variations (-V) */
+    ALL_TAGS,           /* tag_output_form (-7, --notags) */
+    TRUE,               /* match_permutations (-v) */
+    FALSE,              /* positional_variations (-x) */
+    FALSE,              /* use_soundex (-S) */
+    FALSE,              /* suppress_duplicates (-D) */
+    FALSE,              /* suppress_originals (-U) */
+    FALSE,              /* fuzzy_match_duplicates (--fuzzy) */
+    0,                  /* fuzzy_match_depth (--fuzzy) */
+    0,                  /* near_duplicate_similarity (--nearduplicates) */
+    FALSE,              /* check_tags */
+    FALSE,              /* add_ECO (-e) */
+    FALSE,              /* parsing_ECO_file (-e) */
+    FALSE,              /* --addelotags */
+    FALSE,              /* --addfideidtags */
+    DONT_DIVIDE,        /* ECO_level (-E) */
+    SAN,                /* output_format (-W) */
+    MAX_LINE_LENGTH,    /* max_line_length (-w) */
+    FALSE,              /* use_virtual_hash_table (-Z) */
+    FALSE,              /* check_move_bounds (-b) */
+    FALSE,              /* match_only_checkmate (-M) */
+    FALSE,              /* match_only_stalemate (--stalemate) */
+    FALSE,              /* match_only_insufficient_material (--insufficient) */
+    TRUE,               /* keep_move_numbers (--nomovenumbers) */
+    TRUE,               /* keep_results (--noresults) */
+    TRUE,               /* keep_checks (--nochecks) */
+    FALSE,              /* output_evaluation (--evaluation) */
+    FALSE,              /* keep_broken_games (--keepbroken) */
+    FALSE,              /* suppress_redundant_ep_info (--nofauxep) */
+    FALSE,              /* json_format (--json) */
+    FALSE,              /* tag_match_anywhere (--tagsubstr) */
+    FALSE,              /* match_underpromotion (--underpromotion) */
+    FALSE,              /* suppress_matched (--suppressmatched) */
+    FALSE,              /* higher_rated_winner (--higherratedwinner) */
+    FALSE,              /* lower_rated_winner (--lowerratedwinner) */
+    FALSE,              /* find_odds_games (--odds) */
+    0,                  /* depth_of_positional_search */
+    0,                  /* num_games_processed */
+    0,                  /* num_games_matched */
+    0,                  /* num_non_matching_games */
+    0,                  /* games_per_file (-#) */
+    1,                  /* next_file_number */
+    0,                  /* lower_move_bound */
+    10000,              /* upper_move_bound */
+    -1,                 /* output_ply_limit (--plylimit) */
+    0,                  /* stability_threshold (--stable) */
+    1,                  /* first */
+    ~0,                 /* game_limit */
+    0,                  /* maximum_matches */
+    0,                  /* drop_ply_number (--dropply) */
+    1,                  /* startply (--startply) */
+    0,                  /* check_for_repetition (--repetition) */
+    0,                  /* check_for_N_move_rule (--fifty, --seventyfive) */
+    0,                  /* piece_count (--piececount) */
+    1,                  /* num_threads (--threads) */
+    16 * 1024 * 1024,   /* split_size (--splitsize) */
+    FALSE,              /* use_game_index (--index) */
+    FALSE,              /* output_FEN_string */
+    FALSE,              /* add_FEN_comments (--fencomments) */
+    FALSE,              /* add_hashcode_comments (--hashcomments) */
+    FALSE,              /* add_position_match_comments (--markmatches) */
+    FALSE,              /* output_plycount (--plycount) */
+    FALSE,              /* output_total_plycount (--totalplycount) */
+    FALSE,              /* add_hashcode_tag (--addhashcode) */
+    FALSE,              /* fix_result_tags (--fixresulttags) */
+    FALSE,              /* fix_tag_strings (--fixtagstrings) */
+    FALSE,              /* add_fen_castling (--addfencastling) */
+    FALSE,              /* separate_comment_lines (--commentlines) */
+    FALSE,              /* split_variants (--separatevariants) */
+    FALSE,              /* reject_inconsistent_results (--nobadresults) */
+    FALSE,              /* allow_null_moves (--allownullmoves) */
+    FALSE,              /* allow_nested_comments (--nestedcomments) */
+    FALSE,              /* add_match_tag (--addmatchtag) */
+    FALSE,              /* add_matchlabel_tag (--addlabeltag) */
+    FALSE,              /* only_output_wanted_tags (--xroster) */
+    FALSE,              /* delete_same_setup (--deletesamesetup) */
+    FALSE,              /* lichess_comment_fix (--lichesscommentfix) */
+    FALSE,              /* keep_only_commented_games (--only_commented_games) */
+    FALSE,              /* variation_match_anywhere (--anywhere) */
+    FALSE,              /* trusted_input (--trusted) */
+    FALSE,              /* external_duplicates (--externaldupes) */
+    0,                  /* split_depth_limit */
+    NORMALFILE,         /* current_file_type */
+    SETUP_TAG_OK,       /* setup_status */
+    EITHER_TO_MOVE,     /* whose_move */
+    "MATCH",            /* position_match_comment (--markmatches) */
+    (char *) NULL,      /* FEN_comment_pattern (-Fpattern) */
+    (char *) NULL, /* FEN_comment_format (--fencommentformat) */
+    (char *) NULL,      /* drop_comment_pattern (--dropbefore) */
+    (char *) NULL,      /* line_number_marker (--linenumbers) */
+    (char *) NULL,      /* current_input_file */
+    DEFAULT_ECO_FILE,   /* eco_file (-e) */
+    (char *) NULL,      /* eco_table_file (--ecotable) */
+    (char *) NULL,      /* duplicate_database (--dupdb) */
+    (FILE *) NULL,      /* outputfile (-o, -a). Default is stdout */
+    (char *) NULL,      /* output_filename (-o, -a) */
+    (FILE *) NULL,      /* logfile (-l). Default is stderr */
+    (FILE *) NULL,      /* duplicate_file (-d) */
+    (FILE *) NULL,      /* non_matching_file (-n) */
+    NULL,               /* matching_game_numbers */
+    NULL,               /* next_game_number_to_output */
+    NULL,               /* skip_game_numbers */
+    NULL,               /* next_game_number_to_skip */
+};
+
+/* Prepare the output file handles in GlobalState. */
+void
+init_default_global_state(void)
+{
+    GlobalState.outputfile = stdout;
+    GlobalState.logfile = stderr;
+    set_output_line_length(MAX_LINE_LENGTH);
+}
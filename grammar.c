@@ -40,6 +40,10 @@
 #include "end.h"
 #include "grammar.h"
 #include "hashing.h"
+#include "parallel.h"
+#include "gameindex.h"
+#include "dupsort.h"
+#include "minhash.h"
 
 static TokenType current_symbol = NO_TOKEN;
 
@@ -63,8 +67,23 @@ static struct {
     CommentList *prefix_comment;
 } GameHeader;
 
+/* A game to be disposed of, once it is known whether it
+ * meets the selection criteria.
+ */
+typedef struct {
+    Game *game;
+    /* The record made of the game by a parallel worker, or NULL
+     * if the game is being processed here.
+     */
+    const GameRecord *record;
+    /* Where the text of a recorded game is to be found. */
+    FILE *record_file;
+    long text_start;
+} GameSource;
+
 static void parse_opt_game_list(SourceFileType file_type);
-static Boolean parse_game(Move **returned_move_list, unsigned long *start_line, unsigned long *end_line);
+static Boolean parse_game(Move **returned_move_list, unsigned long *start_line, size_t *start_offset,
+                          unsigned long *end_line);
 Boolean parse_opt_tag_list(void);
 Boolean parse_tag(void);
 static Move *parse_move_list(void);
@@ -86,10 +105,19 @@ static Boolean check_for_odds(const Game *game);
 static Boolean chess960_setup(Board *board);
 static void deal_with_ECO_line(Move *move_list);
 static void deal_with_game(Move *move_list, unsigned long start_line, unsigned long end_line);
+static void dispose_of_game(GameSource *source, unsigned plycount, Boolean criteria_met);
 static Boolean finished_processing(void);
+static Boolean fit_for_non_matching_output(Game *game);
 static void free_tags(void);
+static void free_token_value(TokenType token);
+static Boolean game_rejected_on_tags(void);
+static void note_duplicate_origin(FILE *outputfile, const char *original_filename);
 static CommentList *merge_comment_lists(CommentList *prefix, CommentList *suffix);
 static void output_game(Game *game,FILE *outputfile);
+static void output_game_source(GameSource *source, FILE *outputfile, Boolean with_result);
+static void record_game(FILE *record_file, Game *current_game, unsigned plycount, Boolean criteria_met);
+static void report_progress(void);
+static void report_source_details(GameSource *source, FILE *outfp);
 static void split_variants(Game *game, FILE *outputfile, unsigned depth);
 
 /* Initialise the game header structure to contain
@@ -145,6 +173,30 @@ must_open_file(const char *filename, const char *mode)
     return fp;
 }
 
+/* Return the name of a new file to be written in full before
+ * it takes the place of filename via replace_file.
+ */
+char *
+replacement_file_name(const char *filename)
+{
+    char *new_filename = (char *) malloc_or_die(strlen(filename) + sizeof (".new"));
+
+    sprintf(new_filename, "%s.new", filename);
+    return new_filename;
+}
+
+/* Rename new_filename as filename, replacing any existing file
+ * of that name.
+ * Return TRUE if successful.
+ */
+Boolean
+replace_file(const char *new_filename, const char *filename)
+{
+    /* Not all systems allow an existing file to be replaced by rename. */
+    return rename(new_filename, filename) == 0 ||
+            (remove(filename) == 0 && rename(new_filename, filename) == 0);
+}
+
 /* Print out on outfp the current details and
  * terminate with a newline.
  */
@@ -366,6 +418,10 @@ select_output_file(StateInfo *GameState, const char *eco)
  */
 static Boolean finished_processing(void)
 {
+    if (is_parallel_worker()) {
+        /* Only the parent knows how many games there have been. */
+        return FALSE;
+    }
     return (GlobalState.matching_game_numbers != NULL &&
             GlobalState.next_game_number_to_output == NULL) ||
             (GlobalState.maximum_matches > 0 && 
@@ -373,6 +429,31 @@ static Boolean finished_processing(void)
             GlobalState.num_games_processed >= GlobalState.game_limit;
 }
 
+/* Return how many of the games that follow can be skipped without being
+ * parsed at all, because they come before --firstgame and dealing with
+ * them would have no effect on the output.
+ * That is not the case if they could be duplicates of later games
+ * or output as non-matching games.
+ */
+unsigned long
+games_that_can_be_skipped(void)
+{
+    if (GlobalState.first_game_number <= GlobalState.num_games_processed + 1 ||
+            GlobalState.non_matching_file != NULL ||
+            GlobalState.suppress_duplicates ||
+            GlobalState.suppress_originals ||
+            GlobalState.fuzzy_match_duplicates ||
+            GlobalState.near_duplicate_similarity > 0 ||
+            GlobalState.duplicate_database != NULL ||
+            GlobalState.duplicate_file != NULL ||
+            GlobalState.delete_same_setup) {
+        return 0;
+    }
+    else {
+        return GlobalState.first_game_number - 1 - GlobalState.num_games_processed;
+    }
+}
+
 /*
  * Is the given game number within the range to be matched?
  */
@@ -387,8 +468,16 @@ parse_opt_game_list(SourceFileType file_type)
 {
     Move *move_list = NULL;
     unsigned long start_line, end_line;
+    size_t start_offset;
 
-    while (parse_game(&move_list, &start_line, &end_line) && !finished_processing()) {
+    /* The nodes of each game are allocated from the game arena. */
+    open_game_arena();
+    while (parse_game(&move_list, &start_line, &start_offset, &end_line) &&
+            !finished_processing()) {
+        if (GlobalState.current_file_type == NORMALFILE) {
+            /* Note where it is, in case an index is being built. */
+            index_game(start_line, start_offset);
+        }
         if (file_type == NORMALFILE) {
             deal_with_game(move_list, start_line, end_line);
         }
@@ -411,17 +500,26 @@ parse_opt_game_list(SourceFileType file_type)
         }
         move_list = NULL;
         setup_for_new_game();
+        /* Everything belonging to the game has been freed, so the
+         * arena can be reset, unless the symbol following the game
+         * has something allocated from it.
+         */
+        if (current_symbol != MOVE && current_symbol != COMMENT) {
+            reset_game_arena();
+        }
     }
     if(move_list != NULL) {
         free_move_list(move_list);
     }
+    close_game_arena();
 }
 
 /* Parse a game and return a pointer to any valid list of moves
  * in returned_move_list.
  */
 static Boolean
-parse_game(Move **returned_move_list, unsigned long *start_line, unsigned long *end_line)
+parse_game(Move **returned_move_list, unsigned long *start_line, size_t *start_offset,
+           unsigned long *end_line)
 { /* Boolean something_found = FALSE; */
     CommentList *prefix_comment;
     Move *move_list = NULL;
@@ -446,6 +544,7 @@ parse_game(Move **returned_move_list, unsigned long *start_line, unsigned long *
         prefix_comment = NULL;
     }
     *start_line = get_line_number();
+    *start_offset = get_line_offset();
     if (parse_opt_tag_list()) {
         /* something_found = TRUE; */
     }
@@ -455,15 +554,28 @@ parse_game(Move **returned_move_list, unsigned long *start_line, unsigned long *
      * Silently delete it/them.
      */
     while (current_symbol == NAG) {
+        free_token_value(current_symbol);
         current_symbol = next_token();
     }
 
-    /* @@@ Beware of comments and/or tags without moves. */
-    move_list = parse_move_list();
+    if (current_symbol != TERMINATING_RESULT && current_symbol != EOF_TOKEN &&
+            game_rejected_on_tags()) {
+        /* There is no need to look at the moves, so
+         * leave the game with none.
+         */
+        free_token_value(current_symbol);
+        current_symbol = skip_movetext();
+        move_list = NULL;
+        hanging_comment = NULL;
+    }
+    else {
+        /* @@@ Beware of comments and/or tags without moves. */
+        move_list = parse_move_list();
 
-    /* @@@ Look for a comment with no move text before the result. */
-    hanging_comment = parse_opt_comment_list();
-    /* Append this to the final move, if there is one. */
+        /* @@@ Look for a comment with no move text before the result. */
+        hanging_comment = parse_opt_comment_list();
+        /* Append this to the final move, if there is one. */
+    }
 
     /* Look for a result, even if there were no moves. */
     result = parse_result();
@@ -492,7 +604,7 @@ parse_game(Move **returned_move_list, unsigned long *start_line, unsigned long *
     }
     else {
         /* @@@ Nothing to attach the comment to. */
-        (void) free((void *) hanging_comment);
+        game_free((void *) hanging_comment);
         hanging_comment = NULL;
         /*
          * Workaround for games with zero moves.
@@ -764,7 +876,7 @@ static void
 parse_opt_NAG_list(Move *move_details)
 {
     while (current_symbol == NAG) {
-        Nag *details = (Nag *) malloc_or_die(sizeof(*details));
+        Nag *details = (Nag *) game_malloc_or_die(sizeof(*details));
         details->text = NULL;
         details->comments = NULL;
         details->next = NULL;
@@ -816,7 +928,7 @@ parse_variant(void)
         Move *moves;
 
         RAV_level++;
-        variation = (Variation *) malloc_or_die(sizeof (Variation));
+        variation = (Variation *) game_malloc_or_die(sizeof (Variation));
 
         current_symbol = next_token();
         prefix_comment = parse_opt_comment_list();
@@ -899,6 +1011,62 @@ setup_for_new_game(void)
     RAV_level = 0;
 }
 
+/* Free the value held in yylval for the given token,
+ * which is being discarded.
+ */
+static void
+free_token_value(TokenType token)
+{
+    switch (token) {
+        case MOVE:
+            free_move_list(yylval.move_details);
+            yylval.move_details = NULL;
+            break;
+        case COMMENT:
+            free_comment_list(yylval.comment);
+            yylval.comment = NULL;
+            break;
+        case NAG:
+            (void) free((void *) yylval.token_string);
+            yylval.token_string = NULL;
+            break;
+        default:
+            break;
+    }
+}
+
+/* Return TRUE if the game whose tags have just been read
+ * is certain to be rejected by deal_with_game on the basis of its
+ * tags alone, so that its moves need not be parsed.
+ * This is only the case if nothing is to be done with a
+ * rejected game and if its tags cannot be altered by anything
+ * following them: the Result tag may be filled in from the
+ * game's result and FEN-related tags may be corrected.
+ */
+static Boolean
+game_rejected_on_tags(void)
+{
+    const char *result = GameHeader.Tags[RESULT_TAG];
+
+    if (GlobalState.parsing_ECO_file ||
+            GlobalState.non_matching_file != NULL ||
+            (!GlobalState.check_tags && !GlobalState.higher_rated_winner &&
+                !GlobalState.lower_rated_winner)) {
+        return FALSE;
+    }
+    else if (result == NULL || *result == '\0' ||
+            strcmp(result, "?") == 0 || strcmp(result, "1/2") == 0) {
+        return FALSE;
+    }
+    else if (GameHeader.Tags[FEN_TAG] != NULL) {
+        return FALSE;
+    }
+    else {
+        return !check_tag_details_not_ECO(GameHeader.Tags,
+                GameHeader.header_tags_length, TRUE);
+    }
+}
+
 /* Discard any data held in the GameHeader.Tags structure. */
 static void
 free_tags(void)
@@ -925,7 +1093,7 @@ free_string_list(StringList *list)
         if (next->str != NULL) {
             (void) free((void *) next->str);
         }
-        (void) free((void *) next);
+        game_free((void *) next);
     }
 }
 
@@ -939,7 +1107,7 @@ free_comment_list(CommentList *comment_list)
             free_string_list(comment_list->comment);
         }
         comment_list = comment_list->next;
-        (void) free((void *) this_comment);
+        game_free((void *) this_comment);
     }
 }
 
@@ -960,7 +1128,7 @@ free_variation(Variation *variation)
         if (next->moves != NULL) {
             (void) free_move_list(next->moves);
         }
-        (void) free((void *) next);
+        game_free((void *) next);
     }
 }
 
@@ -970,7 +1138,7 @@ static void free_NAG_list(Nag *nag_list)
         Nag *nextNAG = nag_list->next;
         free_string_list(nag_list->text);
         free_comment_list(nag_list->comments);
-        (void) free((void *) nag_list);
+        game_free((void *) nag_list);
         nag_list = nextNAG;
     }
 }
@@ -999,7 +1167,7 @@ free_move_list(Move *move_list)
             (void) free((void *) nextMove->terminating_result);
         }
         
-        (void) free((void *) nextMove);
+        game_free((void *) nextMove);
     }
 }
 
@@ -1012,7 +1180,7 @@ save_string_list_item(StringList *list, const char *str)
     if (str != NULL && *str != '\0') {
         StringList *new_item;
 
-        new_item = (StringList *) malloc_or_die(sizeof (*new_item));
+        new_item = (StringList *) game_malloc_or_die(sizeof (*new_item));
         new_item->str = str;
         new_item->next = NULL;
         if (list == NULL) {
@@ -1161,81 +1329,134 @@ static Boolean consistent_FEN_tags(Game *current_game)
     return consistent;
 }
 
+/* Return TRUE if the given game is fit to be output as a
+ * non-matching game.
+ */
+static Boolean
+fit_for_non_matching_output(Game *game)
+{
+    if (! game->moves_checked) {
+        /* We need a dummy argument for apply_move_list. */
+        unsigned plycount;
+
+        /* Make sure that the move text is in a reasonable state.
+         * Force checking of the whole game.
+         */
+        (void) apply_move_list(game, &plycount, 0, FALSE);
+    }
+    return game->moves_ok || GlobalState.keep_broken_games;
+}
+
+/* Output the game in source to outputfile, either directly or,
+ * if it was dealt with by a parallel worker, from the text
+ * that the worker recorded for it.
+ * If with_result then the game lacked both moves and a Result tag,
+ * and it is to be output with a Result of *.
+ */
 static void
-deal_with_game(Move *move_list, unsigned long start_line, unsigned long end_line)
+output_game_source(GameSource *source, FILE *outputfile, Boolean with_result)
 {
-    Game current_game;
-    /* We need a dummy argument for apply_move_list. */
-    unsigned plycount;
-    /* Whether the game matches, as long as it is not in a CHECKFILE. */
-    Boolean game_matches = FALSE;
-    /* Whether to output the game. */
-    Boolean output_the_game = FALSE;
+    const GameRecord *record = source->record;
 
-    if (GlobalState.current_file_type != CHECKFILE) {
-        /* Update the count of how many games handled. */
-        GlobalState.num_games_processed++;
+    if (record == NULL) {
+        output_game(source->game, outputfile);
     }
+    else {
+        long offset = source->text_start;
+        long text_length = record->text_length;
+        long log_length = record->text_log_length;
 
-    /* Fill in the information currently known. */
-    current_game.tags = GameHeader.Tags;
-    current_game.tags_length = GameHeader.header_tags_length;
-    current_game.prefix_comment = GameHeader.prefix_comment;
-    current_game.moves = move_list;
-    current_game.moves_checked = FALSE;
-    current_game.moves_ok = FALSE;
-    current_game.error_ply = 0;
-    current_game.position_counts = NULL;
-    current_game.start_line = start_line;
-    current_game.end_line = end_line;
+        if (with_result) {
+            offset += record->text_length + record->text_log_length;
+            text_length = record->result_text_length;
+            log_length = record->result_text_log_length;
+        }
+        copy_record_text(source->record_file, offset, text_length, outputfile);
+        /* Along with anything logged as it was formatted. */
+        copy_record_text(source->record_file, offset + text_length, log_length,
+                GlobalState.logfile);
+    }
+}
 
-    /* Determine whether or not this game is wanted, on the
-     * basis of the various selection criteria available.
-     */
+/* Report the details of the game in source to outfp.
+ * See report_details.
+ */
+static void
+report_source_details(GameSource *source, FILE *outfp)
+{
+    const GameRecord *record = source->record;
 
-    /*
-     * apply_move_list checks out the moves.
-     * If it returns TRUE as a match, it will also fill in the
-     *     current_game.final_hash_value and
-     *     current_game.cumulative_hash_value
-     * fields of current_game so that these can be used in the
-     * previous_occurrence function.
-     *
-     * If there are any tag criteria, it will be easy to quickly
-     * eliminate most games without going through the lengthy
-     * process of game matching.
-     *
-     * If ECO adding is done, the order of checking may cause
-     * a conflict here since it won't be possible to reject a game
-     * based on its ECO code unless it already has one.
-     * Therefore, check for the ECO tag only after everything else has
-     * been checked.
-     */
-    if (consistent_FEN_tags(&current_game) &&
-            check_tag_details_not_ECO(current_game.tags, current_game.tags_length, TRUE) &&
-            check_setup_tag(current_game.tags) &&
-            check_duplicate_setup(&current_game) &&
+    if (record == NULL) {
+        report_details(outfp);
+    }
+    else {
+        copy_record_text(source->record_file,
+                source->text_start +
+                    record->text_length + record->text_log_length +
+                    record->result_text_length + record->result_text_log_length,
+                record->details_length, outfp);
+        fflush(outfp);
+    }
+}
 
-            apply_move_list(&current_game, &plycount, GlobalState.depth_of_positional_search, TRUE) &&
+/* Precede a duplicate game in the duplicates file with a note
+ * of where it was first found.
+ */
+static void
+note_duplicate_origin(FILE *outputfile, const char *original_filename)
+{
+    static const char *last_input_file = NULL;
 
-            check_move_bounds(plycount) &&
-            check_for_odds(&current_game) &&
-            check_textual_variations(&current_game) &&
-            check_for_material_match(&current_game) &&
-            check_for_piece_count_match(&current_game) &&
-            check_for_only_checkmate(&current_game) &&
-            check_for_only_repetition(current_game.position_counts) &&
-            check_ECO_tag(current_game.tags, TRUE) &&
-            check_for_comments(&current_game)) {
+    if ((last_input_file != GlobalState.current_input_file) &&
+            (GlobalState.current_input_file != NULL)) {
+        if(GlobalState.keep_comments) {
+            /* Record which file this and succeeding
+             * duplicates come from.
+             */
+            print_str(outputfile, "{ From: ");
+            print_str(outputfile,
+                    GlobalState.current_input_file);
+            print_str(outputfile, " }");
+            terminate_line(outputfile);
+        }
+        last_input_file = GlobalState.current_input_file;
+    }
+    if(GlobalState.keep_comments) {
+        print_str(outputfile, "{ First found in: ");
+        print_str(outputfile, original_filename);
+        print_str(outputfile, " }");
+        terminate_line(outputfile);
+    }
+}
+
+/* Decide what to do with a game, once it is known whether it meets
+ * the selection criteria, and output it accordingly.
+ * The game is either the current one or one recorded by a parallel
+ * worker. In the latter case, source->game holds only the hash values
+ * needed for duplicate detection.
+ */
+static void
+dispose_of_game(GameSource *source, unsigned plycount, Boolean criteria_met)
+{
+    Game *current_game = source->game;
+    /* Whether the game matches, as long as it is not in a CHECKFILE. */
+    Boolean game_matches = FALSE;
+    /* Whether to output the game. */
+    Boolean output_the_game = FALSE;
+
+    if (criteria_met) {
         /* If there is no original filename then the game is not a
          * duplicate.
          */
-        const char *original_filename = previous_occurance(current_game, plycount);
+        const char *original_filename = previous_occurance(*current_game, plycount);
 
         if ((original_filename == NULL) && GlobalState.suppress_originals) {
             /* Don't output first occurrences. */
         }
         else if ((original_filename == NULL) || !GlobalState.suppress_duplicates) {
+            /* Whether the game has neither moves nor a result. */
+            Boolean no_moves_or_result;
+
             if (GlobalState.current_file_type == CHECKFILE) {
                 /* We are only checking, so don't count this as a matched game. */
             }
@@ -1256,7 +1477,7 @@ deal_with_game(Move *move_list, unsigned long start_line, unsigned long end_line
                 else if (GlobalState.check_only) {
                     if (GlobalState.verbosity & PER_GAME_SUMMARY) {
                         /* Report progress on logfile. */
-                        report_details(GlobalState.logfile);
+                        report_source_details(source, GlobalState.logfile);
                     }
                 }
                 else {
@@ -1267,52 +1488,37 @@ deal_with_game(Move *move_list, unsigned long start_line, unsigned long end_line
                 /* Not wanted. */
             }
 
-            if(current_game.moves == NULL &&
-                    current_game.tags[RESULT_TAG] == NULL) {
+            if (source->record != NULL) {
+                no_moves_or_result = source->record->no_moves_or_result;
+            }
+            else {
+                no_moves_or_result = current_game->moves == NULL &&
+                    current_game->tags[RESULT_TAG] == NULL;
+            }
+            if(no_moves_or_result) {
                     fprintf(GlobalState.logfile, "Game with no moves and no result.\n");
-                    report_details(GlobalState.logfile);
-                    if(output_the_game) {
-                        current_game.tags[RESULT_TAG] = copy_string("*");
+                    report_source_details(source, GlobalState.logfile);
+                    if(output_the_game && source->record == NULL) {
+                        current_game->tags[RESULT_TAG] = copy_string("*");
                     }
             }
             if(output_the_game) {
                 /* This game is to be kept and output. */
                 FILE *outputfile = select_output_file(&GlobalState,
-                        current_game.tags[ECO_TAG]);
+                        source->record == NULL ? current_game->tags[ECO_TAG] : NULL);
 
                 /* See if we wish to separate out duplicates. */
                 if ((original_filename != NULL) &&
                         (GlobalState.duplicate_file != NULL)) {
-                    static const char *last_input_file = NULL;
-
                     outputfile = GlobalState.duplicate_file;
-                    if ((last_input_file != GlobalState.current_input_file) &&
-                            (GlobalState.current_input_file != NULL)) {
-                        if(GlobalState.keep_comments) {
-                            /* Record which file this and succeeding
-                             * duplicates come from.
-                             */
-                            print_str(outputfile, "{ From: ");
-                            print_str(outputfile,
-                                    GlobalState.current_input_file);
-                            print_str(outputfile, " }");
-                            terminate_line(outputfile);
-                        }
-                        last_input_file = GlobalState.current_input_file;
-                    }
-                    if(GlobalState.keep_comments) {
-                        print_str(outputfile, "{ First found in: ");
-                        print_str(outputfile, original_filename);
-                        print_str(outputfile, " }");
-                        terminate_line(outputfile);
-                    }
+                    note_duplicate_origin(outputfile, original_filename);
                 }
                 if(! GlobalState.suppress_matched) {
                     /* Now output what we have. */
-                    output_game(&current_game, outputfile);
+                    output_game_source(source, outputfile, no_moves_or_result);
                     if (GlobalState.verbosity & PER_GAME_SUMMARY) {
                         /* Report progress on logfile. */
-                        report_details(GlobalState.logfile);
+                        report_source_details(source, GlobalState.logfile);
                     }
                 }
             }
@@ -1321,13 +1527,11 @@ deal_with_game(Move *move_list, unsigned long start_line, unsigned long end_line
     if (!game_matches && (GlobalState.non_matching_file != NULL) &&
             GlobalState.current_file_type != CHECKFILE) {
         /* The user wants to keep everything else. */
-        if (! current_game.moves_checked) {
-            /* Make sure that the move text is in a reasonable state.
-             * Force checking of the whole game.
-             */
-            (void) apply_move_list(&current_game, &plycount, 0, FALSE);
-        }
-        if (current_game.moves_ok || GlobalState.keep_broken_games) {
+        Boolean fit_for_output = source->record != NULL ?
+                source->record->non_matching_ok :
+                fit_for_non_matching_output(current_game);
+
+        if (fit_for_output) {
             if(GlobalState.json_format) {
                 if(GlobalState.num_non_matching_games == 0) {
                     fputs("[\n", GlobalState.non_matching_file);
@@ -1337,7 +1541,7 @@ deal_with_game(Move *move_list, unsigned long start_line, unsigned long end_line
                 }
             }
             GlobalState.num_non_matching_games++;
-            output_game(&current_game, GlobalState.non_matching_file);
+            output_game_source(source, GlobalState.non_matching_file, FALSE);
         }
     }
     if (game_matches && GlobalState.matching_game_numbers != NULL &&
@@ -1347,6 +1551,195 @@ deal_with_game(Move *move_list, unsigned long start_line, unsigned long end_line
             GlobalState.next_game_number_to_output = GlobalState.next_game_number_to_output->next;
         }
     }
+}
+
+/* Record the outcome of matching the current game, in a parallel
+ * worker, for dispose_of_game to be applied to it later by the parent.
+ * The text of the game is recorded in each form in which the
+ * parent might need to output it.
+ */
+static void
+record_game(FILE *record_file, Game *current_game, unsigned plycount, Boolean criteria_met)
+{
+    GameRecord record;
+    long text_start, log_start;
+    Boolean non_matching_output = FALSE;
+    /* Whether the parent might output the game as a match. */
+    Boolean might_be_output = criteria_met;
+
+    memset((void *) &record, 0, sizeof(record));
+    record.matched = criteria_met;
+    record.final_hash_value = current_game->final_hash_value;
+    record.cumulative_hash_value = current_game->cumulative_hash_value;
+    record.fuzzy_duplicate_hash = current_game->fuzzy_duplicate_hash;
+    record.plycount = plycount;
+    record.no_moves_or_result = current_game->moves == NULL &&
+            current_game->tags[RESULT_TAG] == NULL;
+    if (GlobalState.non_matching_file != NULL) {
+        /* Whether or not the game is output as non-matching
+         * depends on whether it turns out to be a duplicate.
+         */
+        record.non_matching_ok = fit_for_non_matching_output(current_game);
+        non_matching_output = record.non_matching_ok;
+    }
+
+    /* A game that duplicates one already seen by this worker is bound
+     * to be found to be a duplicate by the parent too, so there is
+     * no need to format it when duplicates are being dropped.
+     */
+    if (criteria_met && GlobalState.suppress_duplicates &&
+            GlobalState.duplicate_file == NULL &&
+            !GlobalState.use_virtual_hash_table &&
+            previous_occurance(*current_game, plycount) != NULL) {
+        might_be_output = FALSE;
+    }
+
+    if ((might_be_output && !GlobalState.check_only && !record.no_moves_or_result) ||
+            non_matching_output) {
+        text_start = ftell(record_file);
+        log_start = worker_log_position();
+        output_game(current_game, record_file);
+        record.text_length = ftell(record_file) - text_start;
+        record.text_log_length = move_worker_log(log_start);
+    }
+
+    if (might_be_output && !GlobalState.check_only && record.no_moves_or_result) {
+        text_start = ftell(record_file);
+        log_start = worker_log_position();
+        current_game->tags[RESULT_TAG] = copy_string("*");
+        output_game(current_game, record_file);
+        record.result_text_length = ftell(record_file) - text_start;
+        record.result_text_log_length = move_worker_log(log_start);
+        (void) free((void *) current_game->tags[RESULT_TAG]);
+        current_game->tags[RESULT_TAG] = NULL;
+    }
+
+    if (might_be_output) {
+        text_start = ftell(record_file);
+        report_details(record_file);
+        record.details_length = ftell(record_file) - text_start;
+    }
+    end_game_record(&record);
+}
+
+/* Merge a game recorded by a parallel worker into the output.
+ * The current input file must be the one from which it came.
+ * Return FALSE if no more games are wanted.
+ */
+Boolean
+merge_game_record(const GameRecord *record, FILE *record_file, long text_start)
+{
+    Game hashes;
+    GameSource source;
+
+    GlobalState.num_games_processed++;
+    memset((void *) &hashes, 0, sizeof(hashes));
+    hashes.final_hash_value = record->final_hash_value;
+    hashes.cumulative_hash_value = record->cumulative_hash_value;
+    hashes.fuzzy_duplicate_hash = record->fuzzy_duplicate_hash;
+
+    source.game = &hashes;
+    source.record = record;
+    source.record_file = record_file;
+    source.text_start = text_start;
+    dispose_of_game(&source, record->plycount, record->matched);
+    report_progress();
+    return !finished_processing();
+}
+
+/* Report the number of games processed so far, if required. */
+static void
+report_progress(void)
+{
+    if ((GlobalState.verbosity & RUNNING_STATUS) && (GlobalState.num_games_processed % PROGRESS_RATE) == 0) {
+        fprintf(stderr, "Games: %lu\r", GlobalState.num_games_processed);
+    }
+}
+
+static void
+deal_with_game(Move *move_list, unsigned long start_line, unsigned long end_line)
+{
+    Game current_game;
+    /* We need a dummy argument for apply_move_list. */
+    unsigned plycount = 0;
+    /* Whether the game meets all of the selection criteria. */
+    Boolean criteria_met;
+    /* Where to record the game, in a parallel worker. */
+    FILE *record_file = is_parallel_worker() ? begin_game_record() : NULL;
+
+    if (GlobalState.current_file_type != CHECKFILE) {
+        /* Update the count of how many games handled. */
+        GlobalState.num_games_processed++;
+    }
+
+    /* Fill in the information currently known. */
+    current_game.tags = GameHeader.Tags;
+    current_game.tags_length = GameHeader.header_tags_length;
+    current_game.prefix_comment = GameHeader.prefix_comment;
+    current_game.moves = move_list;
+    current_game.moves_checked = FALSE;
+    current_game.moves_ok = FALSE;
+    current_game.error_ply = 0;
+    current_game.position_counts = NULL;
+    current_game.near_duplicate_signature = NULL;
+    current_game.start_line = start_line;
+    current_game.end_line = end_line;
+
+    /* Determine whether or not this game is wanted, on the
+     * basis of the various selection criteria available.
+     */
+
+    /*
+     * apply_move_list checks out the moves.
+     * If it returns TRUE as a match, it will also fill in the
+     *     current_game.final_hash_value and
+     *     current_game.cumulative_hash_value
+     * fields of current_game so that these can be used in the
+     * previous_occurrence function.
+     *
+     * If there are any tag criteria, it will be easy to quickly
+     * eliminate most games without going through the lengthy
+     * process of game matching.
+     *
+     * If ECO adding is done, the order of checking may cause
+     * a conflict here since it won't be possible to reject a game
+     * based on its ECO code unless it already has one.
+     * Therefore, check for the ECO tag only after everything else has
+     * been checked.
+     */
+    criteria_met =
+            consistent_FEN_tags(&current_game) &&
+            check_tag_details_not_ECO(current_game.tags, current_game.tags_length, TRUE) &&
+            check_setup_tag(current_game.tags) &&
+            check_duplicate_setup(&current_game) &&
+
+            apply_move_list(&current_game, &plycount, GlobalState.depth_of_positional_search, TRUE) &&
+
+            check_move_bounds(plycount) &&
+            check_for_odds(&current_game) &&
+            check_textual_variations(&current_game) &&
+            check_for_material_match(&current_game) &&
+            check_for_piece_count_match(&current_game) &&
+            check_for_only_checkmate(&current_game) &&
+            check_for_only_repetition(current_game.position_counts) &&
+            check_ECO_tag(current_game.tags, TRUE) &&
+            check_for_comments(&current_game);
+
+    if (record_file != NULL) {
+        record_game(record_file, &current_game, plycount, criteria_met);
+    }
+    else if (recording_external_duplicates()) {
+        note_game_for_external_duplicates(&current_game, criteria_met);
+    }
+    else {
+        GameSource source;
+
+        source.game = &current_game;
+        source.record = NULL;
+        source.record_file = NULL;
+        source.text_start = 0;
+        dispose_of_game(&source, plycount, criteria_met);
+    }
 
     /* Game is finished with, so free everything. */
     /* Ensure that the GameHeader's prefix comment is NULL for
@@ -1362,12 +1755,14 @@ deal_with_game(Move *move_list, unsigned long start_line, unsigned long end_line
     }
     free_move_list(current_game.moves);
     if (current_game.position_counts != NULL) {
-        free_position_count_list(current_game.position_counts);
+        free_position_counts(current_game.position_counts);
         current_game.position_counts = NULL;
     }
-    if ((GlobalState.verbosity & RUNNING_STATUS) && (GlobalState.num_games_processed % PROGRESS_RATE) == 0) {
-        fprintf(stderr, "Games: %lu\r", GlobalState.num_games_processed);
+    if (current_game.near_duplicate_signature != NULL) {
+        free_minhash_signature(current_game.near_duplicate_signature);
+        current_game.near_duplicate_signature = NULL;
     }
+    report_progress();
 }
 
 /*
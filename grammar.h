@@ -24,6 +24,7 @@
 
 int yyparse(SourceFileType file_type);
 void free_string_list(StringList *list);
+unsigned long games_that_can_be_skipped(void);
 void init_game_header(void);
 void increase_game_header_tags_length(unsigned new_length);
 void report_details(FILE *outfp);
@@ -19,6 +19,15 @@
  *  https://www.cs.kent.ac.uk/people/staff/djb/
  */
 
+#if defined(__unix__) || defined(__linux__) || defined(__APPLE__)
+/* The file of the virtual hash table is accessed via mmap() rather
+ * than fseek() and fread().
+ */
+#define MAP_VIRTUAL_TABLE
+/* Runs sharing a duplicate database take turns with lockf(). */
+#define LOCK_DUPLICATE_DATABASE
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -30,6 +39,13 @@
 /* For unlink() */
 #include <unistd.h>
 #endif
+#ifdef MAP_VIRTUAL_TABLE
+#include <sys/types.h>
+#include <sys/mman.h>
+#endif
+#ifdef LOCK_DUPLICATE_DATABASE
+#include <sys/stat.h>
+#endif
 #include "bool.h"
 #include "mymalloc.h"
 #include "defs.h"
@@ -40,12 +56,23 @@
 #include "hashing.h"
 #include "zobrist.h"
 #include "apply.h"
+#include "dupsort.h"
+#include "minhash.h"
 
-/* Routines, similar in nature to those in apply.c
- * to implement a duplicate hash-table lookup using
- * an external file, rather than malloc'd memory.
+/* Routines to implement a duplicate hash-table lookup using
+ * an external file, rather than malloc'd memory (-Z).
  * The only limit should be a file system limit.
- * NB: Using an external, virtual file seems obsolete now.
+ *
+ * The file is divided into fixed-size pages, each holding a number
+ * of VirtualHashLog entries. The first num_buckets pages are the
+ * primary pages of the buckets, and a full bucket is extended with
+ * an overflow page taken from the end of the file.
+ * The number of buckets is a power of two, and is doubled by
+ * rehashing into a fresh file when the buckets become three-quarters
+ * full on average, so that overflow chains stay short.
+ * Where possible the file is mapped into memory, so that only the
+ * pages in use need be held in memory; otherwise pages are read and
+ * written one at a time.
  *
  * This version should be slightly more accurate than
  * the alternative because the final_ and cumulative_
@@ -54,55 +81,241 @@
  */
 
 /*
- * The name of the file used.
- * This is overwritten each time, and removed on normal
+ * The names of the files used.
+ * The table is moved from one to the other each time it is enlarged.
+ * These are overwritten each time, and removed on normal
  * program exit.
  */
 static char VIRTUAL_FILE[] = "virtual.tmp";
+static char ALTERNATE_VIRTUAL_FILE[] = "virtual2.tmp";
 
-/* Define the size of the hash table.
+/* The size of a page of the virtual file. */
+#define VIRTUAL_PAGE_SIZE 4096
+
+/* The initial number of buckets in the virtual file.
+ * This must be a power of two.
  */
-#define LOG_TABLE_SIZE 100003
+#define INITIAL_VIRTUAL_BUCKETS 64
 
-/* Define a table to hold hash values of the extracted games.
- * This is used to enable duplicate detection.
+/* An entry in the virtual hash table. */
+typedef struct VirtualHashLog {
+    /* Store the final position hash value and
+     * the cumulative hash value for a game.
+     */
+    HashCode final_hash_value, cumulative_hash_value;
+    /* Record the file list index for the file this game was first found in. */
+    unsigned file_number;
+} VirtualHashLog;
+
+/* The number of entries that fit in a page after its header. */
+#define VIRTUAL_ENTRIES_PER_PAGE \
+    ((VIRTUAL_PAGE_SIZE - 2 * sizeof (unsigned)) / sizeof (VirtualHashLog))
+
+/* A page of the virtual file.
+ * A page of zeros is an empty page with no overflow.
  */
 typedef struct {
-    /* Record the file offset of the first and last entries
-     * for an index. (head == -1) => empty.
+    /* The number of entries in use. */
+    unsigned num_entries;
+    /* The page number of the next page in this bucket.
+     * 0 => none, as page 0 is always a primary page.
      */
-    long head, tail;
-} LogHeaderEntry;
+    unsigned overflow;
+    VirtualHashLog entries[VIRTUAL_ENTRIES_PER_PAGE];
+} VirtualPage;
+
+/* The state of a virtual file. */
+typedef struct {
+    const char *filename;
+    FILE *fp;
+    /* Whether the file is kept once closed, rather than removed.
+     * A persistent file starts with a header page, and its entries
+     * are not added to DuplicateFilter.
+     */
+    Boolean persistent;
+    /* The page number of the first bucket. */
+    unsigned first_page;
+    /* The number of buckets: a power of two. */
+    unsigned num_buckets;
+    /* The number of pages in use, including overflow pages. */
+    unsigned num_pages;
+    /* The number of entries stored. */
+    unsigned long num_entries;
+#ifdef MAP_VIRTUAL_TABLE
+    /* The mapping of the file, and the number of pages it covers. */
+    unsigned char *mapping;
+    unsigned mapped_pages;
+#else
+    /* The single page held in memory, and its page number. */
+    VirtualPage page;
+    unsigned page_number;
+    /* Whether page holds a page of the file. */
+    Boolean page_valid;
+    /* Whether page has to be written back to the file. */
+    Boolean page_modified;
+#endif
+} VirtualStore;
 
 /* If use_virtual_hash_table */
-static LogHeaderEntry *VirtualLogTable = NULL;
+static VirtualStore *VirtualTable = NULL;
 
-/* Define a table to hold hash values of the extracted games.
- * This is used to enable duplicate detection when not using
- * the virtual hash table.
+/* A duplicate database (--dupdb) is a persistent virtual file
+ * holding the hash values of the games met in earlier runs.
+ * Page 0 holds a DatabaseHeader, and the buckets follow it.
+ * The file is in the byte order of the machine that wrote it.
+ * It is only read during a run: the games not already in it are
+ * noted in NewDatabaseEntries and added to it at the end, so that
+ * duplicates within a run are reported against their own files.
+ * The header is rewritten whenever a page or entry is added, so that
+ * it covers every page in use even if a run stops part way through
+ * an update.
+ * Where possible, the file is locked for the whole of a run.
  */
-static HashLog **LogTable = NULL;
+#define DATABASE_MAGIC "pgn-extract dupdb"
+#define DATABASE_VERSION 1
 
-/* Define a type to hold hash values of interest.
- * This is used both to aid in duplicate detection
- * and in finding positional variations.
+typedef struct {
+    char magic[sizeof (DATABASE_MAGIC)];
+    uint32_t version;
+    /* The layout the file was written with. */
+    uint32_t page_size;
+    uint32_t entry_size;
+    uint32_t num_buckets;
+    uint32_t num_pages;
+    uint64_t num_entries;
+} DatabaseHeader;
+
+/* If --dupdb */
+static VirtualStore *DuplicateDatabase = NULL;
+static VirtualHashLog *NewDatabaseEntries = NULL;
+static unsigned long num_new_database_entries = 0;
+static unsigned long new_database_entries_size = 0;
+
+/* A Bloom filter of the entries in DuplicateTable or VirtualTable.
+ * Most games are not duplicates, and the filter allows most of those
+ * to be recognised as such without looking in the table.
+ * The filter is blocked: all of the bits for a key lie within a
+ * single block the size of a typical cache line.
+ * It is rebuilt, in proportion to the new size, whenever the table
+ * is enlarged.
  */
-typedef struct VirtualHashLog {
-    /* Store the final position hash value and
-     * the cumulative hash value for a game.
+#define DUPLICATE_FILTER_BLOCK_WORDS 8
+/* The number of filter bits per table slot. */
+#define DUPLICATE_FILTER_BITS_PER_SLOT 16
+/* The number of bits set for each key. */
+#define DUPLICATE_FILTER_PROBES 6
+static uint64_t *DuplicateFilter = NULL;
+/* The number of blocks in DuplicateFilter: a power of two. */
+static size_t duplicate_filter_blocks = 0;
+/* Statistics for the summary:
+ *  + the number of games checked against the filter;
+ *  + the number of those that the filter passed on to the table;
+ *  + the number of those that were found in the table.
+ */
+static unsigned long duplicate_filter_lookups = 0;
+static unsigned long duplicate_filter_passes = 0;
+static unsigned long duplicate_filter_matches = 0;
+
+/* An entry in the table of games seen, for duplicate detection
+ * when not using the virtual hash table.
+ */
+typedef struct {
+    /* The hash value of the final position, or of the position
+     * at the fuzzy match depth.
      */
-    HashCode final_hash_value, cumulative_hash_value;
-    /* Record the file list index for the file this game was first found in. */
-    int file_number;
-    /* Record the file offset of the next element
-     * in this list. -1 => end-of-list.
+    HashCode final_hash_value;
+    /* The cumulative hash value for the game.
+     * 0 if final_hash_value is from the fuzzy match depth.
      */
-    long next;
-} VirtualHashLog;
+    HashCode cumulative_hash_value;
+    /* Record the file list index for the file this game was first found in. */
+    unsigned file_number;
+    /* Whether this slot of the table is occupied. */
+    Boolean in_use;
+} DuplicateEntry;
+
+/* The initial number of slots in DuplicateTable.
+ * This must be a power of two.
+ */
+#define INITIAL_DUPLICATE_TABLE_SIZE (1 << 16)
 
-static FILE *hash_file = NULL;
+/* Define a table to hold hash values of the extracted games.
+ * This is an open-addressed table, with linear probing from the slot
+ * given by the final_hash_value of an entry, so that fuzzy matches
+ * on that value alone can also be found.
+ * The number of slots is a power of two and the table is doubled
+ * in size when it becomes three-quarters full.
+ */
+static DuplicateEntry *DuplicateTable = NULL;
+/* The number of slots in DuplicateTable. */
+static size_t duplicate_table_size = 0;
+/* The number of occupied slots in DuplicateTable. */
+static size_t duplicate_table_entries = 0;
 
 static const char *previous_virtual_occurance(Game game_details);
+static VirtualStore *new_virtual_store(const char *filename, FILE *fp,
+        unsigned first_page, unsigned num_buckets, unsigned num_pages);
+static VirtualStore *open_virtual_store(const char *filename, unsigned first_page,
+        unsigned num_buckets);
+static VirtualStore *open_duplicate_database(const char *filename);
+static void update_duplicate_database(void);
+static void close_virtual_store(VirtualStore *store);
+static void write_database_header(VirtualStore *store);
+static FILE *open_database_file(const char *filename);
+#ifdef LOCK_DUPLICATE_DATABASE
+static Boolean lock_database_file(FILE *fp, const char *filename);
+#endif
+#ifdef MAP_VIRTUAL_TABLE
+static void map_virtual_pages(VirtualStore *store, unsigned num_pages);
+#else
+static void write_back_virtual_page(VirtualStore *store);
+#endif
+static DuplicateEntry *allocate_duplicate_table(size_t size);
+static void reset_duplicate_filter(size_t num_slots);
+static HashCode duplicate_filter_key(HashCode final_hash_value, HashCode cumulative_hash_value);
+static void add_to_duplicate_filter(HashCode key);
+static Boolean in_duplicate_filter(HashCode key);
+static void add_duplicate_entry(HashCode final_hash_value, HashCode cumulative_hash_value,
+        unsigned file_number);
+static const DuplicateEntry *find_duplicate_entry(HashCode final_hash_value,
+        HashCode cumulative_hash_value, Boolean match_cumulative);
+
+/* The initial number of slots in a PositionCount table.
+ * This must be a power of two.
+ */
+#define INITIAL_POSITION_COUNT_SLOTS 64
+
+/* The details of a position in a PositionCount table. */
+typedef struct {
+    HashCode hash_value;
+    Colour to_move;
+    unsigned short castling_rights;
+    Rank ep_rank;
+    Col ep_col;
+    unsigned count;
+    /* The slot is in use only if this matches the generation
+     * of the table.
+     */
+    unsigned generation;
+} PositionCountEntry;
+
+/*
+ * An open-addressed table of the positions that have arisen in a game
+ * since the last pawn move or capture.
+ * No earlier position can occur again after one of those, so the
+ * table is emptied by moving on to a new generation whenever the
+ * halfmove clock is reset, rather than by clearing its slots.
+ */
+struct PositionCount {
+    PositionCountEntry *entries;
+    /* The number of slots, which is a power of two. */
+    unsigned num_slots;
+    /* The number of slots in use in the current generation. */
+    unsigned num_entries;
+    unsigned generation;
+    /* The highest count of any position in the game so far. */
+    unsigned max_count;
+};
 
 /*
  * Check whether the position counts indicate a desired repetition.
@@ -112,11 +325,8 @@ static const char *previous_virtual_occurance(Game game_details);
 Boolean check_for_only_repetition(PositionCount *position_counts)
 {
     if (GlobalState.check_for_repetition > 0) {
-        PositionCount *entry = position_counts;
-        while (entry != NULL && entry->count < GlobalState.check_for_repetition) {
-            entry = entry->next;
-        }
-        return entry != NULL;
+        return position_counts != NULL &&
+                position_counts->max_count >= GlobalState.check_for_repetition;
     }
     else {
         return TRUE;
@@ -147,214 +357,940 @@ encode_castling_rights(const Board *board)
 }
 
 /*
- * Return TRUE if the position on board matches the entry details
+ * Fill in entry with the details of the position on board
  * for the purposes of position repetition matches:
  *     + Same board position (based on a hash value)
  *     + Same castling rights.
  *     + Same en passant status (i.e., no ep possible).
  *     + Same player to move.
  */
-static Boolean
-repetition_position_matches(PositionCount *entry, const Board *board)
+static void
+set_repetition_details(PositionCountEntry *entry, const Board *board)
 {
-    if(board->weak_hash_value != entry->hash_value) {
-        return FALSE;
+    entry->hash_value = board->zobrist;
+    entry->to_move = board->to_move;
+    entry->castling_rights = encode_castling_rights(board);
+    if(board->EnPassant && ! ep_is_redundant(board)) {
+        entry->ep_rank = board->ep_rank;
+        entry->ep_col = board->ep_col;
     }
-    else if(board->to_move != entry->to_move) {
-        return FALSE;
+    else {
+        entry->ep_rank = '\0';
+        entry->ep_col = '\0';
     }
-    else if(encode_castling_rights(board) != entry->castling_rights) {
-        return FALSE;
+}
+
+/*
+ * Return TRUE if the details of the two positions match
+ * for the purposes of position repetition matches.
+ */
+static Boolean
+repetition_position_matches(const PositionCountEntry *entry,
+                            const PositionCountEntry *details)
+{
+    return entry->hash_value == details->hash_value &&
+            entry->to_move == details->to_move &&
+            entry->castling_rights == details->castling_rights &&
+            entry->ep_rank == details->ep_rank &&
+            entry->ep_col == details->ep_col;
+}
+
+/* Return the slot in the entries of position_counts at which to
+ * start looking for a position with the given hash_value.
+ */
+static unsigned
+position_count_slot(const PositionCount *position_counts, HashCode hash_value)
+{
+    return (unsigned) (hash_value & (position_counts->num_slots - 1));
+}
+
+/* Allocate num_slots entries, none of which are in use
+ * in any generation.
+ */
+static PositionCountEntry *
+allocate_position_count_entries(unsigned num_slots)
+{
+    PositionCountEntry *entries =
+            (PositionCountEntry *) malloc_or_die(num_slots * sizeof (*entries));
+    unsigned i;
+
+    for (i = 0; i < num_slots; i++) {
+        entries[i].generation = 0;
     }
-    else {
-        if(board->EnPassant && ! ep_is_redundant(board)) {
-            return board->ep_rank == entry->ep_rank && board->ep_col == entry->ep_col;
-        }
-        else {
-            return entry->ep_rank == '\0';
+    return entries;
+}
+
+/* Double the number of slots in position_counts, keeping only the
+ * entries of the current generation.
+ */
+static void
+enlarge_position_counts(PositionCount *position_counts)
+{
+    PositionCountEntry *old_entries = position_counts->entries;
+    unsigned old_slots = position_counts->num_slots;
+    unsigned generation = position_counts->generation;
+    unsigned i;
+
+    position_counts->num_slots *= 2;
+    position_counts->entries = allocate_position_count_entries(position_counts->num_slots);
+    for (i = 0; i < old_slots; i++) {
+        if (old_entries[i].generation == generation) {
+            unsigned slot = position_count_slot(position_counts, old_entries[i].hash_value);
+
+            while (position_counts->entries[slot].generation == generation) {
+                slot = (slot + 1) & (position_counts->num_slots - 1);
+            }
+            position_counts->entries[slot] = old_entries[i];
         }
     }
+    (void) free((void *) old_entries);
 }
 
-char *get_FEN_string(const Board *);
-
 /*
- * Add hash_value as a position in the current game.
+ * Add the position on board to the positions of the current game.
  * Return the number of times this position has occurred.
- * NB: The assumption is that position_counts is not NULL.
  */
 unsigned
 update_position_counts(PositionCount *position_counts, const Board *board)
 {
-    PositionCount *entry = position_counts;
+    PositionCountEntry details;
+    PositionCountEntry *entry;
+    unsigned slot;
+
     if (position_counts == NULL) {
         /* Don't try to match in variations. */
         return 0;
     }
-    /* Try to find an existing entry. */
-    while (entry != NULL && !repetition_position_matches(entry, board)) {
-        entry = entry->next;
+    if (board->halfmove_clock == 0) {
+        /* A pawn move or capture: start afresh. */
+        position_counts->generation++;
+        position_counts->num_entries = 0;
     }
-    if (entry == NULL) {
-        /* New position. */
-        entry = new_position_count_list(board);
-        /* Insert just after the head of the list. */
-        entry->next = position_counts->next;
-        position_counts->next = entry;
+    else if ((position_counts->num_entries + 1) * 4 > position_counts->num_slots * 3) {
+        /* Make sure there is room for a new position. */
+        enlarge_position_counts(position_counts);
     }
-    else {
+    set_repetition_details(&details, board);
+    /* Try to find an existing entry. */
+    slot = position_count_slot(position_counts, details.hash_value);
+    entry = &position_counts->entries[slot];
+    while (entry->generation == position_counts->generation &&
+            !repetition_position_matches(entry, &details)) {
+        slot = (slot + 1) & (position_counts->num_slots - 1);
+        entry = &position_counts->entries[slot];
+    }
+    if (entry->generation == position_counts->generation) {
         /* Increment the count. */
         entry->count++;
     }
+    else {
+        /* New position. */
+        *entry = details;
+        entry->count = 1;
+        entry->generation = position_counts->generation;
+        position_counts->num_entries++;
+    }
+    if (entry->count > position_counts->max_count) {
+        position_counts->max_count = entry->count;
+    }
     return entry->count;
 }
 
 /*
- * Free the list of position counts.
+ * Free the table of position counts.
  */
 void
-free_position_count_list(PositionCount *position_counts)
+free_position_counts(PositionCount *position_counts)
 {
-    PositionCount *entry = position_counts;
-    while (entry != NULL) {
-        PositionCount *next = entry->next;
-        (void) free((void *) entry);
-        entry = next;
-    }
+    (void) free((void *) position_counts->entries);
+    (void) free((void *) position_counts);
 }
 
 /*
- * Create a new position count list.
- * This will have a single entry at its head.
+ * Create a new table of position counts, containing
+ * the position on board.
  */
 PositionCount *
-new_position_count_list(const Board *board)
+new_position_counts(const Board *board)
 {
-    PositionCount *head = (PositionCount *) malloc_or_die(sizeof (*head));
-    head->hash_value = board->weak_hash_value;
-    head->to_move = board->to_move;
-    head->castling_rights = encode_castling_rights(board);
-    if(board->EnPassant && ! ep_is_redundant(board)) {
-        head->ep_rank = board->ep_rank;
-        head->ep_col = board->ep_col;
+    PositionCount *position_counts =
+            (PositionCount *) malloc_or_die(sizeof (*position_counts));
+
+    position_counts->num_slots = INITIAL_POSITION_COUNT_SLOTS;
+    position_counts->entries = allocate_position_count_entries(position_counts->num_slots);
+    position_counts->num_entries = 0;
+    position_counts->generation = 1;
+    position_counts->max_count = 0;
+    (void) update_position_counts(position_counts, board);
+    return position_counts;
+}
+
+/* Determine which table to initialise, depending
+ * on whether use_virtual_hash_table is set or not.
+ */
+void
+init_duplicate_hash_table(void)
+{
+    if (GlobalState.duplicate_database != NULL) {
+        DuplicateDatabase = open_duplicate_database(GlobalState.duplicate_database);
+    }
+    if (GlobalState.use_virtual_hash_table) {
+        VirtualTable = open_virtual_store(VIRTUAL_FILE, 0, INITIAL_VIRTUAL_BUCKETS);
+        reset_duplicate_filter((size_t) INITIAL_VIRTUAL_BUCKETS * VIRTUAL_ENTRIES_PER_PAGE);
     }
     else {
-        head->ep_rank = '\0';
-        head->ep_col = '\0';
+        duplicate_table_size = INITIAL_DUPLICATE_TABLE_SIZE;
+        duplicate_table_entries = 0;
+        DuplicateTable = allocate_duplicate_table(duplicate_table_size);
+        reset_duplicate_filter(duplicate_table_size);
     }
-    head->count = 1;
-    head->next = NULL;
-    return head;
 }
 
-/*
- * Return an identical copy of the given list.
- */
-PositionCount *copy_position_count_list(PositionCount *original)
-{
-    PositionCount *copy = NULL;
-    PositionCount *tail = NULL;
-    while (original != NULL) {
-        PositionCount *entry = (PositionCount *) malloc_or_die(sizeof (*entry));
-        entry->hash_value = original->hash_value;
-        entry->to_move = original->to_move;
-        entry->castling_rights = original->castling_rights;
-        entry->count = original->count;
-        entry->next = NULL;
-
-        if (copy == NULL) {
-            copy = entry;
-        }
-        else {
-            tail->next = entry;
-        }
-        tail = entry;
-        original = original->next;
+/* Make DuplicateFilter empty, with space for a table of num_slots entries. */
+static void
+reset_duplicate_filter(size_t num_slots)
+{
+    size_t bits_per_block = DUPLICATE_FILTER_BLOCK_WORDS * 64;
+    size_t num_words;
+
+    duplicate_filter_blocks = 1;
+    while (duplicate_filter_blocks * bits_per_block < num_slots * DUPLICATE_FILTER_BITS_PER_SLOT) {
+        duplicate_filter_blocks *= 2;
+    }
+    num_words = duplicate_filter_blocks * DUPLICATE_FILTER_BLOCK_WORDS;
+    if (DuplicateFilter != NULL) {
+        (void) free((void *) DuplicateFilter);
     }
-    return copy;
+    DuplicateFilter = (uint64_t *) malloc_or_die(num_words * sizeof (*DuplicateFilter));
+    memset((void *) DuplicateFilter, 0, num_words * sizeof (*DuplicateFilter));
 }
 
-/* Determine which table to initialise, depending
- * on whether use_virtual_hash_table is set or not.
+/* Return the key under which an entry with the given hash values
+ * is held in DuplicateFilter.
  */
-void
-init_duplicate_hash_table(void)
+static HashCode
+duplicate_filter_key(HashCode final_hash_value, HashCode cumulative_hash_value)
 {
-    int i;
+    if (GlobalState.fuzzy_match_duplicates && !GlobalState.use_virtual_hash_table) {
+        /* Fuzzy matches look for final_hash_value alone. */
+        return final_hash_value;
+    }
+    else {
+        return final_hash_value ^ (cumulative_hash_value * UINT64_C(0x9E3779B97F4A7C15));
+    }
+}
 
-    if (GlobalState.use_virtual_hash_table) {
-        VirtualLogTable = (LogHeaderEntry *)
-                malloc_or_die(LOG_TABLE_SIZE * sizeof (*VirtualLogTable));
-        for (i = 0; i < LOG_TABLE_SIZE; i++) {
-            VirtualLogTable[i].head = VirtualLogTable[i].tail = -1;
+/* Mix the bits of value so that every bit of the result
+ * depends on every bit of value.
+ */
+static uint64_t
+mix_filter_bits(uint64_t value)
+{
+    value ^= value >> 33;
+    value *= UINT64_C(0xff51afd7ed558ccd);
+    value ^= value >> 33;
+    value *= UINT64_C(0xc4ceb9fe1a85ec53);
+    value ^= value >> 33;
+    return value;
+}
+
+/* Return the block of DuplicateFilter for key. */
+static uint64_t *
+duplicate_filter_block(HashCode key)
+{
+    size_t block = (size_t) (mix_filter_bits(key) & (duplicate_filter_blocks - 1));
+
+    return &DuplicateFilter[block * DUPLICATE_FILTER_BLOCK_WORDS];
+}
+
+/* Add key to DuplicateFilter. */
+static void
+add_to_duplicate_filter(HashCode key)
+{
+    uint64_t *block = duplicate_filter_block(key);
+    uint64_t bits = mix_filter_bits(~key);
+    int probe;
+
+    /* Each probe takes 9 bits to select one bit of the 512 in the block. */
+    for (probe = 0; probe < DUPLICATE_FILTER_PROBES; probe++) {
+        block[(bits >> 6) & 0x07] |= (uint64_t) 1 << (bits & 0x3f);
+        bits >>= 9;
+    }
+}
+
+/* Return whether key might be in DuplicateFilter.
+ * FALSE means that it definitely is not.
+ */
+static Boolean
+in_duplicate_filter(HashCode key)
+{
+    const uint64_t *block = duplicate_filter_block(key);
+    uint64_t bits = mix_filter_bits(~key);
+    int probe;
+
+    for (probe = 0; probe < DUPLICATE_FILTER_PROBES; probe++) {
+        if ((block[(bits >> 6) & 0x07] & ((uint64_t) 1 << (bits & 0x3f))) == 0) {
+            return FALSE;
         }
-        hash_file = fopen(VIRTUAL_FILE, "w+b");
-        if (hash_file == NULL) {
-            fprintf(GlobalState.logfile, "Unable to open %s\n",
-                    VIRTUAL_FILE);
+        bits >>= 9;
+    }
+    return TRUE;
+}
+
+/* Return a table of size empty slots for duplicate detection. */
+static DuplicateEntry *
+allocate_duplicate_table(size_t size)
+{
+    DuplicateEntry *table = (DuplicateEntry *) malloc_or_die(size * sizeof (*table));
+    size_t i;
+
+    for (i = 0; i < size; i++) {
+        table[i].in_use = FALSE;
+    }
+    return table;
+}
+
+/* Return the slot in DuplicateTable at which to start looking
+ * for an entry with the given final_hash_value.
+ */
+static size_t
+duplicate_table_slot(HashCode final_hash_value)
+{
+    return (size_t) (final_hash_value & (duplicate_table_size - 1));
+}
+
+/* Add an entry to DuplicateTable, doubling its size first if it is
+ * three-quarters full.
+ */
+static void
+add_duplicate_entry(HashCode final_hash_value, HashCode cumulative_hash_value,
+        unsigned file_number)
+{
+    size_t ix;
+
+    if ((duplicate_table_entries + 1) * 4 > duplicate_table_size * 3) {
+        DuplicateEntry *old_table = DuplicateTable;
+        size_t old_size = duplicate_table_size;
+
+        duplicate_table_size *= 2;
+        DuplicateTable = allocate_duplicate_table(duplicate_table_size);
+        reset_duplicate_filter(duplicate_table_size);
+        for (ix = 0; ix < old_size; ix++) {
+            if (old_table[ix].in_use) {
+                size_t slot = duplicate_table_slot(old_table[ix].final_hash_value);
+
+                add_to_duplicate_filter(duplicate_filter_key(old_table[ix].final_hash_value,
+                                                             old_table[ix].cumulative_hash_value));
+
+                while (DuplicateTable[slot].in_use) {
+                    slot = (slot + 1) & (duplicate_table_size - 1);
+                }
+                DuplicateTable[slot] = old_table[ix];
+            }
         }
+        (void) free((void *) old_table);
     }
-    else {
-        LogTable = (HashLog**) malloc_or_die(LOG_TABLE_SIZE * sizeof (*LogTable));
-        for (i = 0; i < LOG_TABLE_SIZE; i++) {
-            LogTable[i] = NULL;
+    ix = duplicate_table_slot(final_hash_value);
+    while (DuplicateTable[ix].in_use) {
+        ix = (ix + 1) & (duplicate_table_size - 1);
+    }
+    DuplicateTable[ix].final_hash_value = final_hash_value;
+    DuplicateTable[ix].cumulative_hash_value = cumulative_hash_value;
+    DuplicateTable[ix].file_number = file_number;
+    DuplicateTable[ix].in_use = TRUE;
+    add_to_duplicate_filter(duplicate_filter_key(final_hash_value, cumulative_hash_value));
+    duplicate_table_entries++;
+}
+
+/* Return the entry in DuplicateTable with the given final_hash_value
+ * and, if match_cumulative, the given cumulative_hash_value.
+ * Return NULL if there is none.
+ */
+static const DuplicateEntry *
+find_duplicate_entry(HashCode final_hash_value, HashCode cumulative_hash_value,
+        Boolean match_cumulative)
+{
+    size_t ix = duplicate_table_slot(final_hash_value);
+
+    while (DuplicateTable[ix].in_use) {
+        if (DuplicateTable[ix].final_hash_value == final_hash_value &&
+                (!match_cumulative ||
+                 DuplicateTable[ix].cumulative_hash_value == cumulative_hash_value)) {
+            return &DuplicateTable[ix];
         }
+        ix = (ix + 1) & (duplicate_table_size - 1);
     }
+    return NULL;
 }
 
-/* Close and remove the temporary file if in use. */
+/* Prefetch the block of DuplicateFilter and the slot of DuplicateTable
+ * that previous_occurance will look at first for game_details,
+ * so that the memory accesses can overlap with other work on the game.
+ */
+void
+prefetch_previous_occurance(const Game *game_details)
+{
+#if defined(__GNUC__)
+    if (DuplicateTable != NULL) {
+        __builtin_prefetch(duplicate_filter_block(
+                duplicate_filter_key(game_details->final_hash_value,
+                                     game_details->cumulative_hash_value)));
+        __builtin_prefetch(&DuplicateTable[duplicate_table_slot(game_details->final_hash_value)]);
+    }
+#else
+    (void) game_details;
+#endif
+}
+
+/* Close and remove the temporary file if in use,
+ * and bring the duplicate database up to date.
+ */
 void
 clear_duplicate_hash_table(void)
 {
-    if (GlobalState.use_virtual_hash_table) {
-        if (hash_file != NULL) {
-            (void) fclose(hash_file);
-            unlink(VIRTUAL_FILE);
-            hash_file = NULL;
+    if (VirtualTable != NULL) {
+        close_virtual_store(VirtualTable);
+        VirtualTable = NULL;
+    }
+    if (DuplicateDatabase != NULL) {
+        update_duplicate_database();
+        close_virtual_store(DuplicateDatabase);
+        DuplicateDatabase = NULL;
+    }
+}
+
+/* Report to fp how often DuplicateFilter passed on a game that
+ * turned out not to be in the duplicate table.
+ */
+void
+report_duplicate_filter_statistics(FILE *fp)
+{
+    unsigned long new_games = duplicate_filter_lookups - duplicate_filter_matches;
+
+    if (new_games > 0) {
+        unsigned long false_positives = duplicate_filter_passes - duplicate_filter_matches;
+
+        fprintf(fp, "Duplicate filter false positives: %lu in %lu new game%s (%.2f%%).\n",
+                false_positives, new_games, new_games == 1 ? "" : "s",
+                100.0 * false_positives / new_games);
+    }
+}
+
+/* Return the state of the virtual file filename, open as fp,
+ * with num_buckets buckets starting at page first_page and
+ * num_pages pages in use.
+ */
+static VirtualStore *
+new_virtual_store(const char *filename, FILE *fp,
+        unsigned first_page, unsigned num_buckets, unsigned num_pages)
+{
+    VirtualStore *store = (VirtualStore *) malloc_or_die(sizeof (*store));
+
+    store->filename = filename;
+    store->fp = fp;
+    store->persistent = FALSE;
+    store->first_page = first_page;
+    store->num_buckets = num_buckets;
+    store->num_pages = num_pages;
+    store->num_entries = 0;
+#ifdef MAP_VIRTUAL_TABLE
+    store->mapping = NULL;
+    store->mapped_pages = 0;
+    map_virtual_pages(store, store->num_pages);
+#else
+    store->page_number = 0;
+    store->page_valid = FALSE;
+    store->page_modified = FALSE;
+#endif
+    return store;
+}
+
+/* Create the virtual file filename with num_buckets empty buckets,
+ * the first of which is page first_page.
+ * Return NULL if the file cannot be opened.
+ */
+static VirtualStore *
+open_virtual_store(const char *filename, unsigned first_page, unsigned num_buckets)
+{
+    FILE *fp = fopen(filename, "w+b");
+
+    if (fp == NULL) {
+        fprintf(GlobalState.logfile, "Unable to open %s\n", filename);
+        return NULL;
+    }
+    return new_virtual_store(filename, fp, first_page, num_buckets,
+                             first_page + num_buckets);
+}
+
+/* Close the file of store, and remove it unless it is persistent. */
+static void
+close_virtual_store(VirtualStore *store)
+{
+    if (store->persistent) {
+        write_database_header(store);
+    }
+#ifdef MAP_VIRTUAL_TABLE
+    (void) munmap((void *) store->mapping,
+                  (size_t) store->mapped_pages * VIRTUAL_PAGE_SIZE);
+#else
+    if (store->persistent) {
+        write_back_virtual_page(store);
+    }
+#endif
+    if (fclose(store->fp) != 0 && store->persistent) {
+        fprintf(GlobalState.logfile, "Unable to write %s.\n", store->filename);
+        exit(1);
+    }
+    if (!store->persistent) {
+        unlink(store->filename);
+    }
+    (void) free((void *) store);
+}
+
+/* Write the header of the persistent store to page 0 of its file. */
+static void
+write_database_header(VirtualStore *store)
+{
+    DatabaseHeader header;
+
+    memset((void *) &header, 0, sizeof (header));
+    strcpy(header.magic, DATABASE_MAGIC);
+    header.version = DATABASE_VERSION;
+    header.page_size = VIRTUAL_PAGE_SIZE;
+    header.entry_size = sizeof (VirtualHashLog);
+    header.num_buckets = store->num_buckets;
+    header.num_pages = store->num_pages;
+    header.num_entries = store->num_entries;
+#ifdef MAP_VIRTUAL_TABLE
+    memcpy((void *) store->mapping, (void *) &header, sizeof (header));
+#else
+    if (fseek(store->fp, 0L, SEEK_SET) != 0 ||
+            fwrite((void *) &header, sizeof (header), 1, store->fp) != 1) {
+        fprintf(GlobalState.logfile, "Unable to write %s.\n", store->filename);
+        exit(1);
+    }
+#endif
+}
+
+/* Open the file of the duplicate database filename for reading and
+ * writing, creating it empty if it does not exist.
+ */
+static FILE *
+open_database_file(const char *filename)
+{
+    FILE *fp = fopen(filename, "r+b");
+
+    if (fp == NULL) {
+        /* Create it without truncating one that another run
+         * has created in the meantime.
+         */
+        fp = fopen(filename, "ab");
+        if (fp != NULL) {
+            (void) fclose(fp);
+            fp = fopen(filename, "r+b");
         }
     }
+    if (fp == NULL) {
+        fprintf(GlobalState.logfile, "Unable to open %s\n", filename);
+        exit(1);
+    }
+    return fp;
 }
 
-/* Retrieve a duplicate table entry from the hash file. */
-static int
-retrieve_virtual_entry(long ix, VirtualHashLog *entry)
+#ifdef LOCK_DUPLICATE_DATABASE
+/* Wait for exclusive use of the file of fp, which was opened
+ * as filename.
+ * Return FALSE if filename has since been replaced by a different
+ * file, as happens when another run enlarges the database.
+ */
+static Boolean
+lock_database_file(FILE *fp, const char *filename)
 {
-    if (hash_file == NULL) {
-        return 0;
+    struct stat locked, named;
+
+    /* The lock covers the whole file, as the offset of fp is still 0. */
+    if (lockf(fileno(fp), F_LOCK, 0) != 0) {
+        fprintf(GlobalState.logfile, "Unable to lock %s.\n", filename);
+        exit(1);
     }
-    else if (fseek(hash_file, ix, SEEK_SET) != 0) {
-        fprintf(GlobalState.logfile,
-                "Fseek error to %ld in retrieve_virtual_entry\n", ix);
-        return 0;
+    return fstat(fileno(fp), &locked) == 0 && stat(filename, &named) == 0 &&
+            locked.st_dev == named.st_dev && locked.st_ino == named.st_ino;
+}
+#endif
+
+/* Open the duplicate database filename, creating it if it
+ * does not exist.
+ */
+static VirtualStore *
+open_duplicate_database(const char *filename)
+{
+    FILE *fp = open_database_file(filename);
+    VirtualStore *store;
+    DatabaseHeader header;
+    long length;
+
+#ifdef LOCK_DUPLICATE_DATABASE
+    while (!lock_database_file(fp, filename)) {
+        /* Use the file that replaced it. */
+        (void) fclose(fp);
+        fp = open_database_file(filename);
+    }
+#endif
+    if (fseek(fp, 0L, SEEK_END) != 0 || (length = ftell(fp)) < 0 ||
+            fseek(fp, 0L, SEEK_SET) != 0) {
+        fprintf(GlobalState.logfile, "Unable to read %s.\n", filename);
+        exit(1);
+    }
+    if (length == 0) {
+        /* Start a new one. */
+        store = new_virtual_store(filename, fp, 1, INITIAL_VIRTUAL_BUCKETS,
+                                  1 + INITIAL_VIRTUAL_BUCKETS);
+        store->persistent = TRUE;
+        write_database_header(store);
+        return store;
     }
-    else if (fread((void *) entry, sizeof (*entry), 1, hash_file) != 1) {
+    if (fread((void *) &header, sizeof (header), 1, fp) != 1 ||
+            strcmp(header.magic, DATABASE_MAGIC) != 0 ||
+            header.version != DATABASE_VERSION ||
+            header.page_size != VIRTUAL_PAGE_SIZE ||
+            header.entry_size != sizeof (VirtualHashLog) ||
+            header.num_buckets == 0 ||
+            (header.num_buckets & (header.num_buckets - 1)) != 0 ||
+            header.num_pages < 1 + (uint64_t) header.num_buckets) {
         fprintf(GlobalState.logfile,
-                "Fread error from %ld in retrieve_virtual_entry\n", ix);
-        return 0;
+                "%s is not a duplicate database written by this version of pgn-extract.\n",
+                filename);
+        exit(1);
     }
-    else {
-        return 1;
+    store = new_virtual_store(filename, fp, 1, header.num_buckets, header.num_pages);
+    store->persistent = TRUE;
+    store->num_entries = (unsigned long) header.num_entries;
+    return store;
+}
+
+#ifdef MAP_VIRTUAL_TABLE
+/* Extend the file of store to num_pages pages and map the whole of it.
+ * The extension is filled with zeros, so new pages are empty.
+ */
+static void
+map_virtual_pages(VirtualStore *store, unsigned num_pages)
+{
+    size_t length = (size_t) num_pages * VIRTUAL_PAGE_SIZE;
+    void *addr = MAP_FAILED;
+
+    if (store->mapping != NULL) {
+        (void) munmap((void *) store->mapping,
+                      (size_t) store->mapped_pages * VIRTUAL_PAGE_SIZE);
+        store->mapping = NULL;
     }
+    if (ftruncate(fileno(store->fp), (off_t) length) == 0) {
+        addr = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED,
+                    fileno(store->fp), 0);
+    }
+    if (addr == MAP_FAILED) {
+        fprintf(GlobalState.logfile, "Unable to extend %s to %lu bytes.\n",
+                store->filename, (unsigned long) length);
+        exit(1);
+    }
+    /* Buckets are visited in no particular order, so read-ahead is
+     * of no use. This is only a hint, so failure doesn't matter.
+     */
+    (void) madvise(addr, length, MADV_RANDOM);
+    store->mapping = (unsigned char *) addr;
+    store->mapped_pages = num_pages;
 }
+#else
+/* Write the page held by store back to its file, if it has changed. */
+static void
+write_back_virtual_page(VirtualStore *store)
+{
+    if (store->page_valid && store->page_modified) {
+        if (fseek(store->fp, (long) store->page_number * VIRTUAL_PAGE_SIZE, SEEK_SET) != 0 ||
+                fwrite((void *) &store->page, sizeof (store->page), 1, store->fp) != 1) {
+            fprintf(GlobalState.logfile, "Unable to write page %u of %s.\n",
+                    store->page_number, store->filename);
+            exit(1);
+        }
+        store->page_modified = FALSE;
+    }
+}
+#endif
 
-/* Write a duplicate table entry to the hash file. */
-static int
-write_virtual_entry(long where, const VirtualHashLog *entry)
+/* Return page page_number of store.
+ * The page remains valid until the next call to get_virtual_page or
+ * new_virtual_page for store.
+ * Changes to it must be notified via virtual_page_modified.
+ */
+static VirtualPage *
+get_virtual_page(VirtualStore *store, unsigned page_number)
 {
-    if (fseek(hash_file, where, SEEK_SET) != 0) {
-        fprintf(GlobalState.logfile,
-                "Fseek error to %ld in write_virtual_entry\n", where);
-        return 0;
+#ifdef MAP_VIRTUAL_TABLE
+    return (VirtualPage *) (store->mapping + (size_t) page_number * VIRTUAL_PAGE_SIZE);
+#else
+    if (!store->page_valid || store->page_number != page_number) {
+        write_back_virtual_page(store);
+        if (fseek(store->fp, (long) page_number * VIRTUAL_PAGE_SIZE, SEEK_SET) != 0 ||
+                fread((void *) &store->page, sizeof (store->page), 1, store->fp) != 1) {
+            /* The page has never been written, so it is empty. */
+            memset((void *) &store->page, 0, sizeof (store->page));
+        }
+        store->page_number = page_number;
+        store->page_valid = TRUE;
     }
-    else if (fwrite((void *) entry, sizeof (*entry), 1, hash_file) != 1) {
-        fprintf(GlobalState.logfile,
-                "Fwrite error from %ld in write_virtual_entry\n", where);
-        fflush(hash_file);
-        return 0;
+    return &store->page;
+#endif
+}
+
+/* Note that the page last returned by get_virtual_page has been changed. */
+static void
+virtual_page_modified(VirtualStore *store)
+{
+#ifdef MAP_VIRTUAL_TABLE
+    /* The change is already in the mapping. */
+    (void) store;
+#else
+    store->page_modified = TRUE;
+#endif
+}
+
+/* Return the page number of a new, empty page at the end of store. */
+static unsigned
+new_virtual_page(VirtualStore *store)
+{
+    unsigned page_number = store->num_pages;
+
+    store->num_pages++;
+#ifdef MAP_VIRTUAL_TABLE
+    if (store->num_pages > store->mapped_pages) {
+        /* Grow the file geometrically to limit remapping. */
+        map_virtual_pages(store, 2 * store->mapped_pages);
+    }
+#endif
+    if (store->persistent) {
+        /* Cover the page before it is linked into a bucket. */
+        write_database_header(store);
+    }
+    return page_number;
+}
+
+/* Check that page page_number of store is consistent with the
+ * rest of the file, which might have been damaged.
+ * Overflow pages are only ever added at the end of the file,
+ * so a page's overflow always follows it.
+ */
+static void
+check_virtual_page(const VirtualStore *store, unsigned page_number,
+        const VirtualPage *page)
+{
+    if (page->num_entries > VIRTUAL_ENTRIES_PER_PAGE ||
+            (page->overflow != 0 &&
+                (page->overflow <= page_number || page->overflow >= store->num_pages))) {
+        fprintf(GlobalState.logfile, "Page %u of %s is corrupt.\n",
+                page_number, store->filename);
+        exit(1);
+    }
+}
+
+/* Return the page number of the first page of the bucket in store
+ * for the given hash values.
+ * Both values are used, as matches are only ever exact, so that games
+ * with the same final position are spread across the buckets.
+ */
+static unsigned
+virtual_bucket(const VirtualStore *store, HashCode final_hash_value,
+        HashCode cumulative_hash_value)
+{
+    HashCode key = final_hash_value ^ (cumulative_hash_value * 0x9E3779B97F4A7C15ULL);
+
+    return store->first_page + (unsigned) (key & (store->num_buckets - 1));
+}
+
+/* Return the entry in store with the given hash values, or NULL
+ * if there is none.
+ * The entry remains valid until the next access to store.
+ */
+static const VirtualHashLog *
+find_virtual_entry(VirtualStore *store, HashCode final_hash_value,
+        HashCode cumulative_hash_value)
+{
+    unsigned page_number = virtual_bucket(store, final_hash_value, cumulative_hash_value);
+
+    do {
+        const VirtualPage *page = get_virtual_page(store, page_number);
+        unsigned i;
+
+        check_virtual_page(store, page_number, page);
+        for (i = 0; i < page->num_entries; i++) {
+            if (page->entries[i].final_hash_value == final_hash_value &&
+                    page->entries[i].cumulative_hash_value == cumulative_hash_value) {
+                return &page->entries[i];
+            }
+        }
+        page_number = page->overflow;
+    } while (page_number != 0);
+    return NULL;
+}
+
+/* Add entry to its bucket in store, adding an overflow page to
+ * the bucket if it is full.
+ */
+static void
+add_virtual_entry(VirtualStore *store, const VirtualHashLog *entry)
+{
+    unsigned page_number = virtual_bucket(store, entry->final_hash_value,
+                                          entry->cumulative_hash_value);
+    VirtualPage *page = get_virtual_page(store, page_number);
+
+    /* Find the last page of the bucket. */
+    check_virtual_page(store, page_number, page);
+    while (page->overflow != 0) {
+        page_number = page->overflow;
+        page = get_virtual_page(store, page_number);
+        check_virtual_page(store, page_number, page);
+    }
+    if (page->num_entries == VIRTUAL_ENTRIES_PER_PAGE) {
+        unsigned overflow = new_virtual_page(store);
+
+        /* Fetch the page again, as new_virtual_page
+         * may have moved it.
+         */
+        page = get_virtual_page(store, page_number);
+        page->overflow = overflow;
+        virtual_page_modified(store);
+        page = get_virtual_page(store, overflow);
+    }
+    page->entries[page->num_entries] = *entry;
+    page->num_entries++;
+    virtual_page_modified(store);
+    store->num_entries++;
+    if (store->persistent) {
+        write_database_header(store);
     }
     else {
-        /* Written ok. */
-        return 1;
+        add_to_duplicate_filter(duplicate_filter_key(entry->final_hash_value,
+                                                     entry->cumulative_hash_value));
+    }
+}
+
+/* Rehash the entries of store into a new file, filename, with
+ * num_buckets buckets.
+ * The pages of the old file are read in order.
+ * Return the new store.
+ */
+static VirtualStore *
+rehash_virtual_store(VirtualStore *store, const char *filename, unsigned num_buckets)
+{
+    VirtualStore *new_store = open_virtual_store(filename, store->first_page, num_buckets);
+    unsigned page_number;
+
+    if (new_store == NULL) {
+        exit(1);
+    }
+    new_store->persistent = store->persistent;
+    for (page_number = store->first_page; page_number < store->num_pages; page_number++) {
+        const VirtualPage *page = get_virtual_page(store, page_number);
+        unsigned i;
+
+        check_virtual_page(store, page_number, page);
+        for (i = 0; i < page->num_entries; i++) {
+            add_virtual_entry(new_store, &page->entries[i]);
+        }
+    }
+    return new_store;
+}
+
+/* Double the number of buckets of VirtualTable by rehashing its
+ * entries into the alternate file, and rebuild DuplicateFilter to match.
+ */
+static void
+enlarge_virtual_table(void)
+{
+    const char *filename = VirtualTable->filename == VIRTUAL_FILE ?
+            ALTERNATE_VIRTUAL_FILE : VIRTUAL_FILE;
+    unsigned num_buckets = 2 * VirtualTable->num_buckets;
+    VirtualStore *old_table = VirtualTable;
+
+    /* The filter is refilled as the entries are added to the new file. */
+    reset_duplicate_filter((size_t) num_buckets * VIRTUAL_ENTRIES_PER_PAGE);
+    VirtualTable = rehash_virtual_store(old_table, filename, num_buckets);
+    close_virtual_store(old_table);
+}
+
+/* Note the hash values of game_details for addition to
+ * the duplicate database.
+ */
+static void
+note_database_entry(const Game *game_details)
+{
+    VirtualHashLog *entry;
+
+    if (num_new_database_entries == new_database_entries_size) {
+        new_database_entries_size = new_database_entries_size == 0 ?
+                1024 : 2 * new_database_entries_size;
+        NewDatabaseEntries = (VirtualHashLog *) realloc_or_die((void *) NewDatabaseEntries,
+                new_database_entries_size * sizeof (*NewDatabaseEntries));
+    }
+    entry = &NewDatabaseEntries[num_new_database_entries];
+    /* Avoid writing unset bytes that are part of the structure padding. */
+    memset((void *) entry, 0, sizeof (*entry));
+    entry->final_hash_value = game_details->final_hash_value;
+    entry->cumulative_hash_value = game_details->cumulative_hash_value;
+    num_new_database_entries++;
+}
+
+/* Add the entries noted during the run to the duplicate database,
+ * first enlarging it if they would make its buckets more than
+ * three-quarters full on average.
+ * It is enlarged by rehashing into a new file that then
+ * replaces the old one.
+ */
+static void
+update_duplicate_database(void)
+{
+    unsigned long num_entries = DuplicateDatabase->num_entries + num_new_database_entries;
+    unsigned num_buckets = DuplicateDatabase->num_buckets;
+    unsigned long i;
+
+    while (num_entries >= (unsigned long) num_buckets * VIRTUAL_ENTRIES_PER_PAGE / 4 * 3) {
+        num_buckets *= 2;
+    }
+    if (num_buckets != DuplicateDatabase->num_buckets) {
+        const char *filename = DuplicateDatabase->filename;
+        char *new_filename = replacement_file_name(filename);
+        VirtualStore *old_database = DuplicateDatabase;
+
+        DuplicateDatabase = rehash_virtual_store(old_database, new_filename, num_buckets);
+#ifdef LOCK_DUPLICATE_DATABASE
+        /* Lock the new file before it replaces the old one, and keep
+         * the old one locked until then, so that a run waiting for
+         * the old one moves on to the new one.
+         */
+        (void) lock_database_file(DuplicateDatabase->fp, new_filename);
+#else
+        /* Not all systems allow an open file to be replaced. */
+        close_virtual_store(old_database);
+#endif
+        if (!replace_file(new_filename, filename)) {
+            fprintf(GlobalState.logfile, "Unable to rename %s as %s.\n",
+                    new_filename, filename);
+            exit(1);
+        }
+#ifdef LOCK_DUPLICATE_DATABASE
+        close_virtual_store(old_database);
+#endif
+        DuplicateDatabase->filename = filename;
+        (void) free((void *) new_filename);
+    }
+    for (i = 0; i < num_new_database_entries; i++) {
+        const VirtualHashLog *entry = &NewDatabaseEntries[i];
+
+        /* The same game may have been noted more than once if
+         * duplicates are not being looked for within the run.
+         */
+        if (find_virtual_entry(DuplicateDatabase, entry->final_hash_value,
+                               entry->cumulative_hash_value) == NULL) {
+            add_virtual_entry(DuplicateDatabase, entry);
+        }
     }
 }
 
@@ -362,83 +1298,48 @@ write_virtual_entry(long where, const VirtualHashLog *entry)
  * have met the moves in game_details before, otherwise return
  * NULL.  A match is assumed to be so if both
  * the final_ and cumulative_ hash values in game_details
- * are already present in VirtualLogTable.
+ * are already present in VirtualTable.
  */
 static const char *
 previous_virtual_occurance(Game game_details)
 {
-    unsigned ix = game_details.final_hash_value % LOG_TABLE_SIZE;
-    VirtualHashLog entry;
-    Boolean duplicate = FALSE;
     const char *original_filename = NULL;
 
-
     /* Are we keeping this information? */
-    if (GlobalState.suppress_duplicates || GlobalState.suppress_originals ||
-            GlobalState.duplicate_file != NULL) {
-        if (VirtualLogTable[ix].head < 0l) {
-            /* First occurrence. */
+    if (VirtualTable != NULL &&
+            (GlobalState.suppress_duplicates || GlobalState.suppress_originals ||
+             GlobalState.duplicate_file != NULL)) {
+        const VirtualHashLog *match = NULL;
+
+        duplicate_filter_lookups++;
+        if (in_duplicate_filter(duplicate_filter_key(game_details.final_hash_value,
+                                                     game_details.cumulative_hash_value))) {
+            duplicate_filter_passes++;
+            match = find_virtual_entry(VirtualTable, game_details.final_hash_value,
+                                       game_details.cumulative_hash_value);
         }
-        else {
-            int keep_going =
-                    retrieve_virtual_entry(VirtualLogTable[ix].head, &entry);
-
-            while (keep_going && !duplicate) {
-                if ((entry.final_hash_value == game_details.final_hash_value) &&
-                        (entry.cumulative_hash_value == game_details.cumulative_hash_value)) {
-                    /* We have a match.
-                     * Determine where it first occured.
-                     */
-                    original_filename = input_file_name(entry.file_number);
-                    duplicate = TRUE;
-                }
-                else if (entry.next >= 0l) {
-                    keep_going = retrieve_virtual_entry(entry.next, &entry);
-                }
-                else {
-                    keep_going = 0;
-                }
-            }
+        if (match != NULL) {
+            duplicate_filter_matches++;
+            /* We have a match.
+             * Determine where it first occured.
+             */
+            original_filename = input_file_name(match->file_number);
         }
+        else {
+            VirtualHashLog entry;
 
-        if (!duplicate) {
-            /* Write an entry for it. */
-            /* Where to write the next VirtualHashLog entry. */
-            static long next_free_entry = 0l;
-
+            if (VirtualTable->num_entries >=
+                    (unsigned long) VirtualTable->num_buckets * VIRTUAL_ENTRIES_PER_PAGE / 4 * 3) {
+                enlarge_virtual_table();
+            }
             /* Avoid valgrind error when writing unset bytes that
              * are part of the structure padding.
              */
             memset((void *) &entry, 0, sizeof(entry));
-            /* Store the XOR of the two hash values. */
             entry.final_hash_value = game_details.final_hash_value;
             entry.cumulative_hash_value = game_details.cumulative_hash_value;
             entry.file_number = current_file_number();
-            entry.next = -1l;
-
-            /* Write out these details. */
-            if (write_virtual_entry(next_free_entry, &entry)) {
-                long where_written = next_free_entry;
-                /* Move on ready for next time. */
-                next_free_entry += sizeof (entry);
-
-                /* Now update the index table. */
-                if (VirtualLogTable[ix].head < 0l) {
-                    /* First occurrence. */
-                    VirtualLogTable[ix].head =
-                            VirtualLogTable[ix].tail = where_written;
-                }
-                else {
-                    VirtualHashLog tail;
-
-                    if (retrieve_virtual_entry(VirtualLogTable[ix].tail, &tail)) {
-                        tail.next = where_written;
-                        (void) write_virtual_entry(VirtualLogTable[ix].tail, &tail);
-                        /* Store the new tail address. */
-                        VirtualLogTable[ix].tail = where_written;
-                    }
-                }
-            }
+            add_virtual_entry(VirtualTable, &entry);
         }
     }
     return original_filename;
@@ -449,7 +1350,7 @@ previous_virtual_occurance(Game game_details)
  * NULL.
  * For non-fuzzy comparison, a match is assumed to be so if both
  * final_ and cumulative_ hash values are already present 
- * as a pair in LogTable.
+ * as a pair in DuplicateTable.
  * Fuzzy matches depend on the match depth and do not use the
  * cumulative hash value.
  */
@@ -457,7 +1358,16 @@ const char *
 previous_occurance(Game game_details, unsigned plycount)
 {
     const char *original_filename = NULL;
-    if (GlobalState.use_virtual_hash_table) {
+    if (DuplicateDatabase != NULL &&
+            find_virtual_entry(DuplicateDatabase, game_details.final_hash_value,
+                               game_details.cumulative_hash_value) != NULL) {
+        /* Met in an earlier run. */
+        return GlobalState.duplicate_database;
+    }
+    if (GlobalState.external_duplicates) {
+        original_filename = external_previous_occurance();
+    }
+    else if (GlobalState.use_virtual_hash_table) {
         original_filename = previous_virtual_occurance(game_details);
     }
     else {
@@ -467,76 +1377,61 @@ previous_occurance(Game game_details, unsigned plycount)
                 GlobalState.fuzzy_match_duplicates ||
                 GlobalState.duplicate_file != NULL) {
             Boolean duplicate = FALSE;
-            // Entry index.
-            unsigned ix;
-            HashLog *entry;
-
-            ix = game_details.final_hash_value % LOG_TABLE_SIZE;
-            entry = LogTable[ix];
-            /* Check for non-fuzzy matches first. */
-            while (entry != NULL && !duplicate) {
-                if (entry->final_hash_value == game_details.final_hash_value &&
-                        entry->cumulative_hash_value == game_details.cumulative_hash_value) {
-                    /* An exact match. */
-                    duplicate = TRUE;
-                    /* Determine where it first occurred. */
-                    original_filename = input_file_name(entry->file_number);
-                }
-                else {
-                    entry = entry->next;
+            Boolean passed = FALSE;
+            const DuplicateEntry *entry = NULL;
+
+            /* Check for non-fuzzy matches first.
+             * When fuzzy matching, the filter holds just the first
+             * hash value of each entry, which serves both for this
+             * and for a fuzzy match at depth 0.
+             */
+            if (in_duplicate_filter(duplicate_filter_key(game_details.final_hash_value,
+                                                         game_details.cumulative_hash_value))) {
+                passed = TRUE;
+                entry = find_duplicate_entry(game_details.final_hash_value,
+                                             game_details.cumulative_hash_value, TRUE);
+                if (entry == NULL && GlobalState.fuzzy_match_duplicates &&
+                        GlobalState.fuzzy_match_depth == 0) {
+                    /* Accept positional match at the end of the game. */
+                    entry = find_duplicate_entry(game_details.final_hash_value, 0, FALSE);
                 }
             }
-            if (!duplicate && GlobalState.fuzzy_match_duplicates) {
-                ix = game_details.fuzzy_duplicate_hash % LOG_TABLE_SIZE;
-                entry = LogTable[ix];
-                while (entry != NULL && !duplicate) {
-                    if (GlobalState.fuzzy_match_depth == 0 &&
-                            entry->final_hash_value == game_details.final_hash_value) {
-                        /* Accept positional match at the end of the game. */
-                        duplicate = TRUE;
-                    }
-                    else {
-                        /* Need to check at the fuzzy_match_depth. */
-                        if (entry->final_hash_value == game_details.fuzzy_duplicate_hash) {
-                            duplicate = TRUE;
-                        }
-                    }
-                    if (duplicate) {
-                        /* We have a match.
-                         * Determine where it first occurred.
-                         */
-                        original_filename = input_file_name(entry->file_number);
-                    }
-                    else {
-                        entry = entry->next;
-                    }
-                }
+            if (entry == NULL && GlobalState.fuzzy_match_duplicates &&
+                    GlobalState.fuzzy_match_depth > 0 &&
+                    plycount >= GlobalState.fuzzy_match_depth &&
+                    in_duplicate_filter(game_details.fuzzy_duplicate_hash)) {
+                /* Need to check at the fuzzy_match_depth. */
+                passed = TRUE;
+                entry = find_duplicate_entry(game_details.fuzzy_duplicate_hash, 0, FALSE);
             }
-
-            if (!duplicate) {
-                /* First occurrence, so add it to the log. */
-                entry = (HashLog *) malloc_or_die(sizeof (*entry));
-
-                if (!GlobalState.fuzzy_match_duplicates) {
-                    /* Store the two hash values. */
-                    entry->final_hash_value = game_details.final_hash_value;
-                    entry->cumulative_hash_value = game_details.cumulative_hash_value;
-                }
-                else if (GlobalState.fuzzy_match_depth > 0 &&
-                        plycount >= GlobalState.fuzzy_match_depth) {
-                    /* Store just the hash value from the fuzzy depth. */
-                    entry->final_hash_value = game_details.fuzzy_duplicate_hash;
-                    entry->cumulative_hash_value = 0;
-                }
-                else {
-                    /* Store the two hash values. */
-                    entry->final_hash_value = game_details.final_hash_value;
-                    entry->cumulative_hash_value = game_details.cumulative_hash_value;
-                }
-                entry->file_number = current_file_number();
-                /* Link it into the head at this index. */
-                entry->next = LogTable[ix];
-                LogTable[ix] = entry;
+            duplicate_filter_lookups++;
+            if (passed) {
+                duplicate_filter_passes++;
+            }
+            if (entry != NULL) {
+                /* We have a match.
+                 * Determine where it first occurred.
+                 */
+                duplicate = TRUE;
+                duplicate_filter_matches++;
+                original_filename = input_file_name(entry->file_number);
+            }
+            else if (GlobalState.fuzzy_match_duplicates &&
+                    GlobalState.fuzzy_match_depth > 0 &&
+                    plycount >= GlobalState.fuzzy_match_depth) {
+                /* First occurrence, so add it to the log.
+                 * Store just the hash value from the fuzzy depth.
+                 */
+                add_duplicate_entry(game_details.fuzzy_duplicate_hash, 0,
+                        current_file_number());
+            }
+            else {
+                /* First occurrence, so add it to the log.
+                 * Store the two hash values.
+                 */
+                add_duplicate_entry(game_details.final_hash_value,
+                        game_details.cumulative_hash_value,
+                        current_file_number());
             }
             /* Without a filename, suppressing duplicates on stdin does not work. */
             if(duplicate && original_filename == NULL) {
@@ -544,6 +1439,13 @@ previous_occurance(Game game_details, unsigned plycount)
             }
         }
     }
+    if (original_filename == NULL && GlobalState.near_duplicate_similarity > 0) {
+        /* Not an exact duplicate, but it might be a near one. */
+        original_filename = previous_near_occurance(&game_details);
+    }
+    if (original_filename == NULL && DuplicateDatabase != NULL) {
+        note_database_entry(&game_details);
+    }
     return original_filename;
 }
 
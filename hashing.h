@@ -38,28 +38,21 @@ typedef struct HashLog {
 } HashLog;
 
 /*
- * A structure for counting the number of times a position arises
- * in a game.
+ * A table for counting the number of times a position arises
+ * in a game. The details are private to hashing.c.
  */
-typedef struct PositionCount {
-    HashCode hash_value;
-    Colour to_move;
-    unsigned short castling_rights;
-    Rank ep_rank;
-    Col ep_col;
-    unsigned count;
-    struct PositionCount *next;
-} PositionCount;
+typedef struct PositionCount PositionCount;
 
 
 Boolean check_duplicate_setup(const Game *game_details);
 Boolean check_for_only_repetition(PositionCount *position_counts);
 void clear_duplicate_hash_table(void);
-PositionCount *copy_position_count_list(PositionCount *original);
-void free_position_count_list(PositionCount *position_counts);
+void free_position_counts(PositionCount *position_counts);
 void init_duplicate_hash_table(void);
-PositionCount *new_position_count_list(const Board *board);
+PositionCount *new_position_counts(const Board *board);
+void prefetch_previous_occurance(const Game *game_details);
 const char *previous_occurance(Game game_details, unsigned plycount);
+void report_duplicate_filter_statistics(FILE *fp);
 unsigned update_position_counts(PositionCount *position_counts, const Board *board);
 
 #endif	// HASHING_H
@@ -19,8 +19,14 @@
  *  https://www.cs.kent.ac.uk/people/staff/djb/
  */
 
+#if defined(__unix__) || defined(__linux__) || defined(__APPLE__)
+/* Regular input files are read via mmap() rather than fread(). */
+#define MAP_INPUT_FILES
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <ctype.h>
 #if defined(__BORLANDC__) || defined(_MSC_VER)
@@ -31,6 +37,11 @@
 #else
 #include <unistd.h>
 #endif
+#ifdef MAP_INPUT_FILES
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
 #include "bool.h"
 #include "mymalloc.h"
 #include "defs.h"
@@ -42,6 +53,7 @@
 #include "lists.h"
 #include "decode.h"
 #include "lines.h"
+#include "gameindex.h"
 #include "grammar.h"
 #include "apply.h"
 #include "output.h"
@@ -49,10 +61,13 @@
 /* Prototypes for the functions in this file. */
 static Boolean extract_yytext(const unsigned char *symbol_start,
         const unsigned char *linep);
-static int identify_tag(const char *tag_string);
-static TagName make_new_tag(const char *tag);
+static int identify_tag(const char *tag_string, size_t len);
+static TagName make_new_tag(const char *tag, size_t len);
+static void intern_tag(unsigned tag_index);
 static Boolean open_input(const char *infile);
+static Boolean open_input_quietly(const char *infile);
 static Boolean open_input_file(int file_number);
+static void release_input_mapping(void);
 /* When a move is saved, what is known of its source and destination coordinates
  * should also be saved.
  */
@@ -64,6 +79,10 @@ static void terminate_input(void);
 
 static unsigned long line_number = 0;
 static unsigned long line_position = 0;
+/* The byte offset in the input file of the current line.
+ * Only maintained for mapped input.
+ */
+static size_t line_offset = 0;
 /* Keep track of the Recursive Annotation Variation level. */
 static unsigned RAV_level = 0;
 /* Keep track of the last move found. */
@@ -95,6 +114,14 @@ static short MoveChars[MAX_CHAR];
  */
 static const char **TagList;
 static unsigned tag_list_length = 0;
+/* An open-addressing hash table of indices into TagList, so that
+ * identify_tag does not have to search the whole list for every tag
+ * of every game.  Each slot holds a TagList index plus one, with zero
+ * marking an empty slot.  The number of slots is a power of two,
+ * and is doubled to keep the table no more than half full.
+ */
+static unsigned *tag_table = NULL;
+static unsigned tag_table_size = 0;
 /* Which tags, if any, are to be suppressed in the output.
  * The indices are the same as for TagList.
  */
@@ -102,6 +129,11 @@ static Boolean *suppressed_tags;
 /* Nested comment depth: GlobalState.allow_nested_comments. */
 static unsigned comment_depth = 0;
 
+/* Set by skip_movetext to have get_next_symbol pass over
+ * the remainder of the current game's movetext.
+ */
+static Boolean skipping_movetext = FALSE;
+
 /* Initialise the TagList. This should be stored in alphabetical order,
  * by virtue of the order in which the _TAG values are defined.
  */
@@ -168,15 +200,89 @@ init_list_of_known_tags(void)
     TagList[WHITE_TITLE_TAG] = "WhiteTitle";
     TagList[WHITE_TYPE_TAG] = "WhiteType";
     TagList[WHITE_USCF_TAG] = "WhiteUSCF";
+
+    for (i = 0; i < tag_list_length; i++) {
+        intern_tag(i);
+    }
+}
+
+/* Return a hash value for the len characters of tag_string. */
+static unsigned
+tag_hash(const char *tag_string, size_t len)
+{
+    /* FNV-1a */
+    uint32_t hash = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        hash ^= (unsigned char) tag_string[i];
+        hash *= 16777619u;
+    }
+    return (unsigned) hash;
+}
+
+/* Return the slot of tag_table that either holds the tag whose
+ * name is the len characters of tag_string, or is the empty
+ * slot where it should be added.
+ */
+static unsigned
+tag_table_slot(const char *tag_string, size_t len)
+{
+    unsigned mask = tag_table_size - 1;
+    unsigned slot = tag_hash(tag_string, len) & mask;
+
+    while (tag_table[slot] != 0) {
+        const char *tag = TagList[tag_table[slot] - 1];
+        if (strncmp(tag_string, tag, len) == 0 && tag[len] == '\0') {
+            break;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return slot;
 }
 
-/* Extend TagList to accommodate a new tag string.
+/* Add TagList[tag_index] to tag_table, growing the table if
+ * necessary.  An existing entry for the same string is retained
+ * so that the lowest index continues to be the one identified.
+ */
+static void
+intern_tag(unsigned tag_index)
+{
+    const char *tag = TagList[tag_index];
+    unsigned slot;
+
+    if (2 * (tag_index + 1) > tag_table_size) {
+        unsigned *old_table = tag_table;
+        unsigned old_size = tag_table_size;
+        unsigned i;
+
+        tag_table_size = tag_table_size == 0 ? 128 : 2 * tag_table_size;
+        tag_table = (unsigned *) malloc_or_die(tag_table_size * sizeof(*tag_table));
+        memset(tag_table, 0, tag_table_size * sizeof(*tag_table));
+        for (i = 0; i < old_size; i++) {
+            if (old_table[i] != 0) {
+                const char *old_tag = TagList[old_table[i] - 1];
+                tag_table[tag_table_slot(old_tag, strlen(old_tag))] = old_table[i];
+            }
+        }
+        if (old_table != NULL) {
+            (void) free((void *) old_table);
+        }
+    }
+    slot = tag_table_slot(tag, strlen(tag));
+    if (tag_table[slot] == 0) {
+        tag_table[slot] = tag_index + 1;
+    }
+}
+
+/* Extend TagList to accommodate a new tag string of length len.
  * Return the current value of tag_list_length as its
  * index, having incremented its value.
  */
 static TagName
-make_new_tag(const char *tag)
+make_new_tag(const char *tag, size_t len)
 {
+    char *tag_copy = (char *) malloc_or_die(len + 1);
     unsigned tag_index = tag_list_length;
     tag_list_length++;
     TagList = (const char **) realloc_or_die((void *) TagList,
@@ -184,8 +290,11 @@ make_new_tag(const char *tag)
     suppressed_tags = (Boolean *) realloc_or_die(
                                       (void *) suppressed_tags,
                                       tag_list_length * sizeof(*suppressed_tags));
-    TagList[tag_index] = copy_string(tag);
+    memcpy(tag_copy, tag, len);
+    tag_copy[len] = '\0';
+    TagList[tag_index] = tag_copy;
     suppressed_tags[tag_index] = FALSE;
+    intern_tag(tag_index);
     /* Ensure that the game header's tags array can accommodate
      * the new tag.
      */
@@ -225,9 +334,10 @@ is_suppressed_tag(TagName tag)
 void
 suppress_tag(const char *tag_string)
 {
-    int tag_item = identify_tag(tag_string);
+    size_t len = strlen(tag_string);
+    int tag_item = identify_tag(tag_string, len);
     if (tag_item < 0) {
-        tag_item = make_new_tag(tag_string);
+        tag_item = make_new_tag(tag_string, len);
     }
     suppressed_tags[tag_item] = TRUE;
 }
@@ -566,7 +676,7 @@ gather_comment(char *line, unsigned char *linep)
     }
 
     /* Set up the structure to be returned. */
-    comment = (CommentList *) malloc_or_die(sizeof (*comment));
+    comment = (CommentList *) game_malloc_or_die(sizeof (*comment));
     comment->comment = current_comment;
     comment->next = NULL;
     yylval.comment = comment;
@@ -628,7 +738,7 @@ gather_single_line_comment(char *line, unsigned char *linep)
         current_comment = save_string_list_item(current_comment, comment_str);
 
         /* Set up the comment structure to be returned. */
-        comment = (CommentList *) malloc_or_die(sizeof (*comment));
+        comment = (CommentList *) game_malloc_or_die(sizeof (*comment));
         comment->comment = current_comment;
         comment->next = NULL;
         yylval.comment = comment;
@@ -643,6 +753,121 @@ gather_single_line_comment(char *line, unsigned char *linep)
     return resulting_line;
 }
 
+/* Return TRUE if a terminating result starts at p in line. */
+static Boolean
+result_starts_at(const char *line, const char *p)
+{
+    if (p > line && isalnum((unsigned char) p[-1])) {
+        /* Part of some other symbol. */
+        return FALSE;
+    }
+    else {
+        return strncmp(p, "1-0", 3) == 0 || strncmp(p, "0-1", 3) == 0 ||
+                strncmp(p, "1/2", 3) == 0;
+    }
+}
+
+/* Starting from linep in line, pass over movetext without
+ * tokenising it, until either a terminating result outside any
+ * variation or the start of a tag section is found.
+ * Comments and variations are tracked only so that characters
+ * within them are not mistaken for either of these.
+ * Leave linep at the start of whatever was found.
+ */
+static LinePair
+skim_movetext(char *line, unsigned char *linep)
+{
+    LinePair resulting_line;
+    /* The only characters of interest outside and inside comments. */
+    const char *movetext_stops = "[{();-/*";
+    const char *comment_stops = GlobalState.allow_nested_comments ? "{}" : "}";
+    unsigned depth_of_comment = 0;
+    unsigned depth_of_variation = 0;
+    Boolean found = FALSE;
+
+    while (line != NULL && !found) {
+        char *p = (char *) linep;
+
+        if (depth_of_comment == 0 && p == line && *p == '%') {
+            /* An escaped line. */
+            p += strlen(p);
+        }
+        while (*p != '\0' && !found) {
+            if (depth_of_comment > 0) {
+                p += strcspn(p, comment_stops);
+                if (*p == '{') {
+                    depth_of_comment++;
+                    p++;
+                }
+                else if (*p == '}') {
+                    depth_of_comment--;
+                    p++;
+                }
+            }
+            else {
+                p += strcspn(p, movetext_stops);
+                switch (*p) {
+                    case '\0':
+                        break;
+                    case '[':
+                        found = TRUE;
+                        break;
+                    case '{':
+                        depth_of_comment++;
+                        p++;
+                        break;
+                    case '(':
+                        depth_of_variation++;
+                        p++;
+                        break;
+                    case ')':
+                        if (depth_of_variation > 0) {
+                            depth_of_variation--;
+                        }
+                        p++;
+                        break;
+                    case ';':
+                        /* The rest of the line is a comment. */
+                        p += strlen(p);
+                        break;
+                    case '*':
+                        if (depth_of_variation == 0) {
+                            found = TRUE;
+                        }
+                        else {
+                            p++;
+                        }
+                        break;
+                    default:
+                        /* Either '-' or '/', which might be in a result. */
+                        if (depth_of_variation == 0 && p > line &&
+                                result_starts_at(line, p - 1)) {
+                            p--;
+                            found = TRUE;
+                        }
+                        else {
+                            p++;
+                        }
+                        break;
+                }
+            }
+        }
+        if (found) {
+            linep = (unsigned char *) p;
+        }
+        else {
+            line = next_input_line(yyin);
+            linep = (unsigned char *) line;
+        }
+    }
+    RAV_level = 0;
+
+    resulting_line.line = line;
+    resulting_line.linep = linep;
+    resulting_line.token = NO_TOKEN;
+    return resulting_line;
+}
+
 /* Remember that 0 can start 0-1 and 0-0.
  * Remember that 1 can start 1-0 and 1/2.
  */
@@ -730,25 +955,25 @@ gather_possible_numeric(char *line, unsigned char *linep, char initial_digit)
     return resulting_line;
 }
 
-/* Look up tag_string in TagList[] and return its _TAG
- * value or -1 if it isn't there.
+/* Look up the len characters of tag_string in TagList[] and
+ * return its _TAG value or -1 if it isn't there.
+ * tag_string need not be null-terminated.
  * Although the strings are sorted initially, further
  * tags identified in the source files will be appended
- * without further sorting. So we cannot use a binary
- * search on the list.
+ * without further sorting, so the lookup is made via tag_table.
  */
 static int
-identify_tag(const char *tag_string)
+identify_tag(const char *tag_string, size_t len)
 {
-    unsigned tag_index;
+    unsigned slot = tag_table_slot(tag_string, len);
 
-    for (tag_index = 0; tag_index < tag_list_length; tag_index++) {
-        if (strcmp(tag_string, TagList[tag_index]) == 0) {
-            return tag_index;
-        }
+    if (tag_table[slot] != 0) {
+        return tag_table[slot] - 1;
+    }
+    else {
+        /* Not found. */
+        return -1;
     }
-    /* Not found. */
-    return -1;
 }
 
 /* Starting from linep in line, gather up the tag name.
@@ -783,21 +1008,17 @@ gather_tag(char *line, unsigned char *linep)
         /* The last one wasn't part of the tag. */
         linep--;
         if (len > 0) {
-            int tag_item;
-            char *tag_string;
-
-            /* Allocate space for the result. */
-            tag_string = (char *) malloc_or_die(len + 1);
-            strncpy((char *) tag_string, (const char *) (linep - len), len);
-            tag_string[len] = '\0';
-            tag_item = identify_tag(tag_string);
+            /* The tag name is identified in place in the line,
+             * and only copied if it is a new one.
+             */
+            const char *tag_string = (const char *) (linep - len);
+            int tag_item = identify_tag(tag_string, len);
             if (tag_item < 0) {
-                tag_item = make_new_tag(tag_string);
+                tag_item = make_new_tag(tag_string, len);
             }
             if (tag_item >= 0 && ((unsigned) tag_item) < tag_list_length) {
                 yylval.tag_index = tag_item;
                 resulting_line.token = TAG;
-                (void) free((void *) tag_string);
             }
             else {
                 fprintf(GlobalState.logfile,
@@ -852,6 +1073,15 @@ get_next_symbol(void)
     TokenType token;
     LinePair resulting_line;
 
+    if (skipping_movetext) {
+        skipping_movetext = FALSE;
+        if (line != NULL) {
+            resulting_line = skim_movetext(line, linep);
+            line = resulting_line.line;
+            linep = resulting_line.linep;
+        }
+    }
+
     do {
         /* Remember where in line the current symbol starts. */
         const unsigned char *symbol_start;
@@ -1232,7 +1462,7 @@ skip_to_next_game(TokenType token)
                 if ((yylval.comment != NULL) &&
                         (yylval.comment->comment != NULL)) {
                     free_string_list(yylval.comment->comment);
-                    free((void *) yylval.comment);
+                    game_free((void *) yylval.comment);
                     yylval.comment = NULL;
                 }
             }
@@ -1243,6 +1473,18 @@ skip_to_next_game(TokenType token)
     return token;
 }
 
+/* Discard the remainder of the current game's movetext,
+ * whose first token has already been returned, without
+ * tokenising it. Return the token that follows it: normally
+ * either a terminating result or the next game's first tag.
+ */
+TokenType
+skip_movetext(void)
+{
+    skipping_movetext = TRUE;
+    return next_token();
+}
+
 /* Save castling moves in a standard way. */
 static void
 save_q_castle(void)
@@ -1283,6 +1525,10 @@ restart_lex_for_new_game(void)
  * is built up from the program's arguments.
  */
 static int current_file_num = 0;
+/* Whether input should stop at the end of the current file,
+ * rather than moving on to the next in list_of_files.
+ */
+static Boolean single_file_input = FALSE;
 /* Keep track of the list of PGN files.  These will either be the
  * remaining arguments once flags have been dealt with, or
  * those read from -c and -f arguments.
@@ -1367,45 +1613,188 @@ static void unget_char(int c, FILE *fpin)
     }
 }
 
+#ifdef MAP_INPUT_FILES
+/* Regular files opened by open_input are mapped into memory in their
+ * entirety, and lines are taken directly from the mapping rather than
+ * a character at a time through input_buffer.
+ * Pipes, terminals and stdin continue to use the buffered path.
+ * mapped_file is the stream whose contents are mapped, if any.
+ */
+static FILE *mapped_file = NULL;
+static const char *mapped_input = NULL;
+static size_t mapped_input_length = 0;
+static size_t mapped_input_index = 0;
+/* Where reading of the mapping stops.
+ * This is before mapped_input_length when only a section of the
+ * file is being read (open_input_section).
+ */
+static size_t mapped_input_end = 0;
+
+/* Try to map the whole of fp into memory.
+ * If that is not possible, input_buffer will be used instead.
+ */
+static void
+map_input_file(FILE *fp)
+{
+    struct stat info;
+
+    release_input_mapping();
+    if (fstat(fileno(fp), &info) == 0 && S_ISREG(info.st_mode) &&
+            info.st_size > 0 && (uintmax_t) info.st_size <= SIZE_MAX) {
+        size_t length = (size_t) info.st_size;
+        void *addr = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+
+        if (addr != MAP_FAILED) {
+            /* The input is read once from start to finish, so
+             * encourage aggressive read-ahead.
+             * These are only hints, so failure doesn't matter.
+             */
+            (void) madvise(addr, length, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+            (void) madvise(addr, length, MADV_HUGEPAGE);
+#endif
+            mapped_file = fp;
+            mapped_input = (const char *) addr;
+            mapped_input_length = length;
+            mapped_input_index = 0;
+            mapped_input_end = length;
+        }
+    }
+}
+
+/* Return the next line of the mapped input as a slice of the mapping,
+ * with its length in *len. The line terminator is not included.
+ * Return NULL at the end of the input.
+ * As in read_line, either \n or \r terminates a line, and \r\n
+ * is treated as a single terminator.
+ */
+static const char *
+next_mapped_line(size_t *len)
+{
+    const char *start, *end, *limit;
+
+    if (mapped_input_index >= mapped_input_end) {
+        return NULL;
+    }
+    start = mapped_input + mapped_input_index;
+    limit = mapped_input + mapped_input_end;
+    /* Stop at whichever terminator comes first. */
+    for (end = start; end < limit && *end != '\n' && *end != '\r'; end++) {
+    }
+    *len = end - start;
+    mapped_input_index += *len;
+    if (mapped_input_index < mapped_input_end) {
+        /* Skip the terminator. */
+        if (*end == '\r' && mapped_input_index + 1 < mapped_input_end &&
+                end[1] == '\n') {
+            mapped_input_index++;
+        }
+        mapped_input_index++;
+    }
+    return start;
+}
+#endif
+
+/* Release any mapping made of the current input file. */
+static void
+release_input_mapping(void)
+{
+#ifdef MAP_INPUT_FILES
+    if (mapped_input != NULL) {
+        (void) munmap((void *) mapped_input, mapped_input_length);
+        mapped_file = NULL;
+        mapped_input = NULL;
+        mapped_input_length = 0;
+        mapped_input_index = 0;
+        mapped_input_end = 0;
+    }
+#endif
+}
+
 /* Read a single line of input. */
 #define INIT_LINE_LENGTH 100
-#define LINE_INCREMENT 100
 
-char *read_line(FILE *fpin)
+/* Ensure that *buffer, currently of *space bytes, can hold
+ * a line of len characters plus a terminating null.
+ */
+static void
+reserve_line_space(char **buffer, size_t *space, size_t len)
 {
-    char *line = NULL;
-    unsigned len = 0;
-    unsigned max_length;
+    if (len + 1 > *space) {
+        size_t new_space = *space > 0 ? *space : INIT_LINE_LENGTH + 1;
+
+        while (new_space < len + 1) {
+            new_space *= 2;
+        }
+        *buffer = (char *) realloc_or_die((void *) *buffer, new_space);
+        *space = new_space;
+    }
+}
+
+/* Read the next line of fpin into *buffer, growing the
+ * buffer (of *space bytes) if necessary.
+ * The line terminator is not retained.
+ * Return FALSE if there is no more input, in which case
+ * *buffer is left untouched.
+ */
+static Boolean
+read_line_into(FILE *fpin, char **buffer, size_t *space)
+{
+    size_t len = 0;
     int ch;
 
+#ifdef MAP_INPUT_FILES
+    if (fpin == mapped_file) {
+        const char *slice = next_mapped_line(&len);
+
+        if (slice == NULL) {
+            return FALSE;
+        }
+        reserve_line_space(buffer, space, len);
+        memcpy(*buffer, slice, len);
+        (*buffer)[len] = '\0';
+        return TRUE;
+    }
+#endif
     ch = get_next_char(fpin);
-    if (ch != EOF) {
-        line = (char *) malloc_or_die(INIT_LINE_LENGTH + 1);
-        max_length = INIT_LINE_LENGTH;
-        while ((ch != '\n') && (ch != '\r') && (ch != EOF)) {
-            /* Another character to add. */
-            if (len == max_length) {
-                line = (char *) realloc_or_die((void *) line,
-                        max_length + LINE_INCREMENT + 1);
-                if (line == NULL) {
-                    return NULL;
-                }
-                max_length += LINE_INCREMENT;
-            }
-            line[len] = ch;
-            len++;
-            ch = get_next_char(fpin);
-        }
-        line[len] = '\0';
-        if (ch == '\r') {
-            /* Try to avoid double counting lines in dos-format files. */
-            ch = get_next_char(fpin);
-            if (ch != '\n' && ch != EOF) {
-                unget_char(ch, fpin);
-            }
+    if (ch == EOF) {
+        return FALSE;
+    }
+    reserve_line_space(buffer, space, INIT_LINE_LENGTH);
+    while ((ch != '\n') && (ch != '\r') && (ch != EOF)) {
+        /* Another character to add. */
+        if (len + 1 == *space) {
+            reserve_line_space(buffer, space, len + 1);
+        }
+        (*buffer)[len] = ch;
+        len++;
+        ch = get_next_char(fpin);
+    }
+    (*buffer)[len] = '\0';
+    if (ch == '\r') {
+        /* Try to avoid double counting lines in dos-format files. */
+        ch = get_next_char(fpin);
+        if (ch != '\n' && ch != EOF) {
+            unget_char(ch, fpin);
         }
     }
-    return line;
+    return TRUE;
+}
+
+/* Read a single line of input into newly allocated space.
+ * Return NULL if there is no more input.
+ */
+char *read_line(FILE *fpin)
+{
+    char *line = NULL;
+    size_t space = 0;
+
+    if (read_line_into(fpin, &line, &space)) {
+        return line;
+    }
+    else {
+        return NULL;
+    }
 }
 
 /* Read a list of lines from fp. These are the names of files
@@ -1513,18 +1902,33 @@ add_filename_to_source_list(const char *filename, SourceFileType file_type)
     list_of_files.files[list_of_files.num_files] = (char *) NULL;
 }
 
-/* Use infile as the input source. */
+/* Use infile as the input source, without announcing it. */
 static Boolean
-open_input(const char *infile)
+open_input_quietly(const char *infile)
 {
     yyin = fopen(infile, "rb");
     if (yyin != NULL) {
+#ifdef MAP_INPUT_FILES
+        map_input_file(yyin);
+#endif
         GlobalState.current_input_file = infile;
+    }
+    return yyin != NULL;
+}
+
+/* Use infile as the input source. */
+static Boolean
+open_input(const char *infile)
+{
+    if (open_input_quietly(infile)) {
         if (GlobalState.verbosity & PER_GAME_SUMMARY) {
             fprintf(GlobalState.logfile, "Processing %s\n", GlobalState.current_input_file);
         }
+        return TRUE;
+    }
+    else {
+        return FALSE;
     }
-    return yyin != NULL;
 }
 
 /* Simple interface to open_input for the ECO file. */
@@ -1534,6 +1938,37 @@ open_eco_file(const char *eco_file)
     return open_input(eco_file);
 }
 
+#ifdef MAP_INPUT_FILES
+/* The mapped file infile has just been opened for normal processing
+ * with --index. If it has an up-to-date index then use that to skip
+ * any games that are not needed, otherwise build an index
+ * as the file is read.
+ */
+static void
+consult_game_index(const char *infile)
+{
+    unsigned long num_games;
+    unsigned long games_to_skip = games_that_can_be_skipped();
+    GameIndexEntry entry;
+
+    if (read_game_index(infile, yyin, games_to_skip + 1, &entry, &num_games)) {
+        if (games_to_skip >= num_games) {
+            /* None of the file is needed. */
+            GlobalState.num_games_processed += num_games;
+            mapped_input_index = mapped_input_end;
+        }
+        else if (games_to_skip > 0 && entry.offset < mapped_input_end) {
+            GlobalState.num_games_processed += games_to_skip;
+            mapped_input_index = (size_t) entry.offset;
+            line_number = (unsigned long) entry.start_line - 1;
+        }
+    }
+    else {
+        begin_game_index(infile, yyin);
+    }
+}
+#endif
+
 /* Open the input file whose number is the argument. */
 static Boolean
 open_input_file(int file_number)
@@ -1543,6 +1978,13 @@ open_input_file(int file_number)
      */
     if (open_input(list_of_files.files[file_number])) {
         GlobalState.current_file_type = list_of_files.file_type[file_number];
+#ifdef MAP_INPUT_FILES
+        if (GlobalState.use_game_index && !single_file_input &&
+                GlobalState.current_file_type == NORMALFILE &&
+                mapped_file == yyin) {
+            consult_game_index(list_of_files.files[file_number]);
+        }
+#endif
         return TRUE;
     }
     else {
@@ -1550,6 +1992,275 @@ open_input_file(int file_number)
     }
 }
 
+/* Open just the given file from list_of_files as the source
+ * of input. The end of this file will be treated as the end
+ * of all input.
+ */
+Boolean
+open_single_input_file(unsigned file_number)
+{
+    if (input_file_name(file_number) == NULL) {
+        return FALSE;
+    }
+    current_file_num = file_number;
+    single_file_input = TRUE;
+    restart_lex_for_new_game();
+    games_in_file = 0;
+    reset_line_number();
+    return open_input_file(file_number);
+}
+
+/* Open just the given section of a file from list_of_files
+ * as the source of input, as for open_single_input_file.
+ * Only the first section of a file is announced, and line numbers
+ * continue from those of the preceding sections.
+ */
+Boolean
+open_input_section(unsigned file_number, const InputSection *section)
+{
+    const char *infile = input_file_name(file_number);
+    Boolean ok;
+
+    if (infile == NULL) {
+        return FALSE;
+    }
+    current_file_num = file_number;
+    single_file_input = TRUE;
+    restart_lex_for_new_game();
+    games_in_file = 0;
+    reset_line_number();
+    if (section->start == 0) {
+        ok = open_input(infile);
+    }
+    else {
+        ok = open_input_quietly(infile);
+    }
+    if (ok) {
+        GlobalState.current_file_type = list_of_files.file_type[file_number];
+#ifdef MAP_INPUT_FILES
+        if (mapped_file == yyin && section->end <= mapped_input_length) {
+            mapped_input_index = section->start;
+            mapped_input_end = section->end;
+            line_number = section->first_line;
+        }
+        else
+#endif
+        {
+            fprintf(GlobalState.logfile, "Unable to map %s to read a section of it.\n",
+                    infile);
+            ok = FALSE;
+        }
+    }
+    return ok;
+}
+
+#ifdef MAP_INPUT_FILES
+/* Return the offset of the line terminator that ends the line
+ * of text containing offset i, or length if there is none.
+ */
+static size_t
+end_of_text_line(const char *text, size_t length, size_t i)
+{
+    while (i < length && text[i] != '\n' && text[i] != '\r') {
+        i++;
+    }
+    return i;
+}
+
+/* Return the offset of the first game in text, at or after from,
+ * or length if there is none.
+ * A game is taken to start with an Event tag at the beginning
+ * of a line that follows an empty line, outside any comment or string.
+ * The text is scanned from start, which must not be within either,
+ * so that the extent of those before from is known.
+ */
+static size_t
+next_game_start(const char *text, size_t length, size_t start, size_t from)
+{
+    static const char marker[] = "[Event ";
+    const size_t marker_length = sizeof(marker) - 1;
+    unsigned depth_of_comment = 0;
+    size_t i = start;
+
+    while (i < length) {
+        if (depth_of_comment > 0) {
+            if (text[i] == '}') {
+                depth_of_comment--;
+            }
+            else if (text[i] == '{' && GlobalState.allow_nested_comments) {
+                depth_of_comment++;
+            }
+            i++;
+        }
+        else {
+            switch (text[i]) {
+                case '{':
+                    depth_of_comment++;
+                    i++;
+                    break;
+                case '%':
+                    if (i == 0 || text[i - 1] == '\n' || text[i - 1] == '\r') {
+                        /* An escaped line. */
+                        i = end_of_text_line(text, length, i);
+                    }
+                    else {
+                        i++;
+                    }
+                    break;
+                case ';':
+                    /* The rest of the line is a comment. */
+                    i = end_of_text_line(text, length, i);
+                    break;
+                case '"':
+                    /* A string ends at the end of its line. */
+                    i++;
+                    while (i < length && text[i] != '"' &&
+                            text[i] != '\n' && text[i] != '\r') {
+                        if (text[i] == '\\' && i + 1 < length &&
+                                text[i + 1] != '\n' && text[i + 1] != '\r') {
+                            i++;
+                        }
+                        i++;
+                    }
+                    if (i < length && text[i] == '"') {
+                        i++;
+                    }
+                    break;
+                case '[':
+                    if (i >= from && i >= 2 && text[i - 1] == '\n' &&
+                            (text[i - 2] == '\n' ||
+                                (i >= 3 && text[i - 2] == '\r' && text[i - 3] == '\n')) &&
+                            length - i >= marker_length &&
+                            memcmp(text + i, marker, marker_length) == 0) {
+                        return i;
+                    }
+                    i++;
+                    break;
+                default:
+                    i++;
+                    break;
+            }
+        }
+    }
+    return length;
+}
+
+/* Return the number of lines in text, counted in the
+ * same way as by next_mapped_line.
+ */
+static unsigned long
+count_lines(const char *text, size_t length)
+{
+    const char *end = text + length;
+    const char *p;
+    unsigned long count = 0;
+
+    for (p = text; (p = (const char *) memchr(p, '\n', end - p)) != NULL; p++) {
+        count++;
+    }
+    /* A \r on its own is also a line terminator. */
+    for (p = text; (p = (const char *) memchr(p, '\r', end - p)) != NULL; p++) {
+        if (p + 1 == end || p[1] != '\n') {
+            count++;
+        }
+    }
+    return count;
+}
+#endif
+
+/* Divide the given input file into sections of roughly section_size
+ * bytes, each of which starts at the beginning of a game, so that
+ * they can be processed in parallel.
+ * Return the number of sections, stored in *sections, or 0 if
+ * the file either cannot or need not be divided.
+ */
+unsigned
+divide_input_file(unsigned file_number, size_t section_size, InputSection **sections)
+{
+    unsigned num_sections = 0;
+#ifdef MAP_INPUT_FILES
+    const char *infile = input_file_name(file_number);
+    FILE *fp = infile != NULL ? fopen(infile, "rb") : NULL;
+
+    if (fp != NULL) {
+        struct stat info;
+
+        if (fstat(fileno(fp), &info) == 0 && S_ISREG(info.st_mode) &&
+                (uintmax_t) info.st_size > section_size &&
+                (uintmax_t) info.st_size <= SIZE_MAX) {
+            size_t length = (size_t) info.st_size;
+            void *addr = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+
+            if (addr != MAP_FAILED) {
+                const char *text = (const char *) addr;
+                InputSection *list = NULL;
+                unsigned space = 0;
+                size_t start = 0;
+                unsigned long first_line = 0;
+
+                (void) madvise(addr, length, MADV_SEQUENTIAL);
+                while (start < length) {
+                    size_t end = length;
+
+                    if (length - start > section_size) {
+                        end = next_game_start(text, length, start,
+                                               start + section_size);
+                    }
+                    if (num_sections == space) {
+                        space = space == 0 ? 16 : 2 * space;
+                        list = (InputSection *) realloc_or_die((void *) list,
+                                space * sizeof(*list));
+                    }
+                    list[num_sections].start = start;
+                    list[num_sections].end = end;
+                    list[num_sections].first_line = first_line;
+                    num_sections++;
+                    if (end < length) {
+                        first_line += count_lines(text + start, end - start);
+                    }
+                    start = end;
+                }
+                (void) munmap(addr, length);
+                if (num_sections > 1) {
+                    *sections = list;
+                }
+                else {
+                    (void) free((void *) list);
+                    num_sections = 0;
+                }
+            }
+        }
+        (void) fclose(fp);
+    }
+#endif
+    return num_sections;
+}
+
+/* Treat the given file from list_of_files as the current
+ * input file, for reporting purposes, without opening it.
+ */
+void
+select_input_file(unsigned file_number)
+{
+    current_file_num = file_number;
+    GlobalState.current_input_file = input_file_name(file_number);
+    GlobalState.current_file_type = list_of_files.file_type[file_number];
+}
+
+/* Prepare to read all of the input files again, from the start
+ * of the first, and open it.
+ */
+Boolean
+reopen_first_file(void)
+{
+    terminate_input();
+    current_file_num = 0;
+    restart_lex_for_new_game();
+    games_in_file = 0;
+    reset_line_number();
+    return open_first_file();
+}
+
 /* Open the first input file. */
 Boolean
 open_first_file(void)
@@ -1558,6 +2269,7 @@ open_first_file(void)
 
     if (list_of_files.num_files == 0) {
         /* Use standard input. */
+        release_input_mapping();
         yyin = stdin;
         GlobalState.current_input_file = "stdin";
         /* @@@ Should this be set?
@@ -1591,6 +2303,20 @@ input_file_name(unsigned file_number)
     }
 }
 
+/* Return the number of files in list_of_files. */
+unsigned
+num_input_files(void)
+{
+    return list_of_files.num_files;
+}
+
+/* Return the type of the given file in list_of_files. */
+SourceFileType
+input_file_type(unsigned file_number)
+{
+    return list_of_files.file_type[file_number];
+}
+
 /* Give some error information. */
 void
 print_error_context(FILE *fp)
@@ -1615,23 +2341,30 @@ save_string(const char *str)
     yylval.token_string = token;
 }
 
-/* Return the next line of input from fp. */
+/* Return the next line of input from fp.
+ * The same space is reused for every line, so the result
+ * is only valid until the next call. Anything that must
+ * outlive the line has to be copied out of it.
+ */
 char *
 next_input_line(FILE *fp)
-{ /* Retain each line in turn, so as to be able to free it. */
+{
     static char *line = NULL;
+    static size_t line_space = 0;
 
-    if (line != NULL) {
-        (void) free((void *) line);
+#ifdef MAP_INPUT_FILES
+    if (fp == mapped_file) {
+        line_offset = mapped_input_index;
     }
-
-    line = read_line(fp);
-
-    if (line != NULL) {
+#endif
+    if (read_line_into(fp, &line, &line_space)) {
         line_number++;
         line_position = 0;
+        return line;
+    }
+    else {
+        return NULL;
     }
-    return line;
 }
 
 /* Handle the end of a file. */
@@ -1641,7 +2374,12 @@ yywrap(void)
     int time_to_exit;
 
     /* Beware of this being called in inappropriate circumstances. */
-    if (list_of_files.files == NULL) {
+    if (single_file_input) {
+        /* Only the one file was wanted. */
+        terminate_input();
+        time_to_exit = 1;
+    }
+    else if (list_of_files.files == NULL) {
         /* There are no files. */
         time_to_exit = 1;
     }
@@ -1650,6 +2388,10 @@ yywrap(void)
         time_to_exit = 1;
     }
     else {
+#ifdef MAP_INPUT_FILES
+        /* Any index being built is now complete. */
+        complete_game_index(mapped_input_length);
+#endif
         /* Close the input files.  */
         terminate_input();
         /* See if there is another. */
@@ -1680,6 +2422,13 @@ yywrap(void)
     return time_to_exit;
 }
 
+/* Return the byte offset of the current line in a mapped input file. */
+size_t
+get_line_offset(void)
+{
+    return line_offset;
+}
+
 /* Return the current line number. */
 unsigned long
 get_line_number(void)
@@ -1698,6 +2447,7 @@ reset_line_number(void)
 static void
 terminate_input(void)
 {
+    release_input_mapping();
     if ((yyin != stdin) && (yyin != NULL)) {
         (void) fclose(yyin);
         yyin = NULL;
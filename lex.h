@@ -71,23 +71,32 @@ typedef struct {
 void add_filename_to_source_list(const char *filename,SourceFileType file_type);
 void add_filename_list_from_file(FILE *fp,SourceFileType file_type);
 unsigned current_file_number(void);
+unsigned divide_input_file(unsigned file_number, size_t section_size, InputSection **sections);
 void free_move_list(Move *move_list);
 LinePair gather_tag(char *line, unsigned char *linep);
 LinePair gather_string(char *line, unsigned char *linep);
 void init_lex_tables(void);
 const char *input_file_name(unsigned file_number);
+SourceFileType input_file_type(unsigned file_number);
+size_t get_line_offset(void);
 unsigned long get_line_number(void);
 Boolean is_character_class(unsigned char ch, TokenType character_class);
 Boolean is_suppressed_tag(TagName tag);
 char *next_input_line(FILE *fp);
 TokenType next_token(void);
+unsigned num_input_files(void);
 Boolean open_eco_file(const char *eco_file);
 Boolean open_first_file(void);
+Boolean open_input_section(unsigned file_number, const InputSection *section);
+Boolean open_single_input_file(unsigned file_number);
 void print_error_context(FILE *fp);
 char *read_line(FILE *fpin);
+Boolean reopen_first_file(void);
 void reset_line_number(void);
 void restart_lex_for_new_game(void);
 void save_assessment(const char *assess);
+void select_input_file(unsigned file_number);
+TokenType skip_movetext(void);
 TokenType skip_to_next_game(TokenType token);
 void suppress_tag(const char *tag_string);
 const char *tag_header_string(TagName tag);
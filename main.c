@@ -38,137 +38,11 @@
 #include "grammar.h"
 #include "hashing.h"
 #include "argsfile.h"
-
-/* The maximum length of an output line.  This is conservatively
- * slightly smaller than the PGN export standard of 80.
- */
-#define MAX_LINE_LENGTH 75
-
-/* Define a file name relative to the current directory representing
- * a file of ECO classificiations.
- */
-#ifndef DEFAULT_ECO_FILE
-#define DEFAULT_ECO_FILE "eco.pgn"
-#endif
-
-/* This structure holds details of the program state
- * available to all parts of the program.
- * This goes against the grain of good structured programming
- * principles, but most of these fields are set from the program's
- * arguments and are read-only thereafter. If I had done this in
- * C++ there would have been a cleaner interface!
- */
-StateInfo GlobalState = {
-    FALSE,              /* skipping_current_game */
-    FALSE,              /* check_only (-r) */
-    PER_GAME_SUMMARY | RUNNING_STATUS | COUNT_SUMMARY, /* verbosity level (-s and --quiet) */
-    TRUE,               /* keep_NAGs (-N) */
-    TRUE,               /* keep_comments (-C) */
-    TRUE,               /* keep_variations (-V) */
-    ALL_TAGS,           /* tag_output_form (-7, --notags) */
-    TRUE,               /* match_permutations (-v) */
-    FALSE,              /* positional_variations (-x) */
-    FALSE,              /* use_soundex (-S) */
-    FALSE,              /* suppress_duplicates (-D) */
-    FALSE,              /* suppress_originals (-U) */
-    FALSE,              /* fuzzy_match_duplicates (--fuzzy) */
-    0,                  /* fuzzy_match_depth (--fuzzy) */
-    FALSE,              /* check_tags */
-    FALSE,              /* add_ECO (-e) */
-    FALSE,              /* parsing_ECO_file (-e) */
-    FALSE,              /* --addelotags */
-    FALSE,              /* --addfideidtags */
-    DONT_DIVIDE,        /* ECO_level (-E) */
-    SAN,                /* output_format (-W) */
-    MAX_LINE_LENGTH,    /* max_line_length (-w) */
-    FALSE,              /* use_virtual_hash_table (-Z) */
-    FALSE,              /* check_move_bounds (-b) */
-    FALSE,              /* match_only_checkmate (-M) */
-    FALSE,              /* match_only_stalemate (--stalemate) */
-    FALSE,              /* match_only_insufficient_material (--insufficient) */
-    TRUE,               /* keep_move_numbers (--nomovenumbers) */
-    TRUE,               /* keep_results (--noresults) */
-    TRUE,               /* keep_checks (--nochecks) */
-    FALSE,              /* output_evaluation (--evaluation) */
-    FALSE,              /* keep_broken_games (--keepbroken) */
-    FALSE,              /* suppress_redundant_ep_info (--nofauxep) */
-    FALSE,              /* json_format (--json) */
-    FALSE,              /* tag_match_anywhere (--tagsubstr) */
-    FALSE,              /* match_underpromotion (--underpromotion) */
-    FALSE,              /* suppress_matched (--suppressmatched) */
-    FALSE,              /* higher_rated_winner (--higherratedwinner) */
-    FALSE,              /* lower_rated_winner (--lowerratedwinner) */
-    FALSE,              /* find_odds_games (--odds) */
-    0,                  /* depth_of_positional_search */
-    0,                  /* num_games_processed */
-    0,                  /* num_games_matched */
-    0,                  /* num_non_matching_games */
-    0,                  /* games_per_file (-#) */
-    1,                  /* next_file_number */
-    0,                  /* lower_move_bound */
-    10000,              /* upper_move_bound */
-    -1,                 /* output_ply_limit (--plylimit) */
-    0,                  /* stability_threshold (--stable) */
-    1,                  /* first */
-    ~0,                 /* game_limit */
-    0,                  /* maximum_matches */
-    0,                  /* drop_ply_number (--dropply) */
-    1,                  /* startply (--startply) */
-    0,                  /* check_for_repetition (--repetition) */
-    0,                  /* check_for_N_move_rule (--fifty, --seventyfive) */
-    0,                  /* piece_count (--piececount) */
-    FALSE,              /* output_FEN_string */
-    FALSE,              /* add_FEN_comments (--fencomments) */
-    FALSE,              /* add_hashcode_comments (--hashcomments) */
-    FALSE,              /* add_position_match_comments (--markmatches) */
-    FALSE,              /* output_plycount (--plycount) */
-    FALSE,              /* output_total_plycount (--totalplycount) */
-    FALSE,              /* add_hashcode_tag (--addhashcode) */
-    FALSE,              /* fix_result_tags (--fixresulttags) */
-    FALSE,              /* fix_tag_strings (--fixtagstrings) */
-    FALSE,              /* add_fen_castling (--addfencastling) */
-    FALSE,              /* separate_comment_lines (--commentlines) */
-    FALSE,              /* split_variants (--separatevariants) */
-    FALSE,              /* reject_inconsistent_results (--nobadresults) */
-    FALSE,              /* allow_null_moves (--allownullmoves) */
-    FALSE,              /* allow_nested_comments (--nestedcomments) */
-    FALSE,              /* add_match_tag (--addmatchtag) */
-    FALSE,              /* add_matchlabel_tag (--addlabeltag) */
-    FALSE,              /* only_output_wanted_tags (--xroster) */
-    FALSE,              /* delete_same_setup (--deletesamesetup) */
-    FALSE,              /* lichess_comment_fix (--lichesscommentfix) */
-    FALSE,              /* keep_only_commented_games (--only_commented_games) */
-    FALSE,              /* variation_match_anywhere (--anywhere) */
-    0,                  /* split_depth_limit */
-    NORMALFILE,         /* current_file_type */
-    SETUP_TAG_OK,       /* setup_status */
-    EITHER_TO_MOVE,     /* whose_move */
-    "MATCH",            /* position_match_comment (--markmatches) */
-    (char *) NULL,      /* FEN_comment_pattern (-Fpattern) */
-    (char *) NULL, /* FEN_comment_format (--fencommentformat) */
-    (char *) NULL,      /* drop_comment_pattern (--dropbefore) */
-    (char *) NULL,      /* line_number_marker (--linenumbers) */
-    (char *) NULL,      /* current_input_file */
-    DEFAULT_ECO_FILE,   /* eco_file (-e) */
-    (FILE *) NULL,      /* outputfile (-o, -a). Default is stdout */
-    (char *) NULL,      /* output_filename (-o, -a) */
-    (FILE *) NULL,      /* logfile (-l). Default is stderr */
-    (FILE *) NULL,      /* duplicate_file (-d) */
-    (FILE *) NULL,      /* non_matching_file (-n) */
-    NULL,               /* matching_game_numbers */
-    NULL,               /* next_game_number_to_output */
-    NULL,               /* skip_game_numbers */
-    NULL,               /* next_game_number_to_skip */
-};
-
-/* Prepare the output file handles in GlobalState. */
-static void
-init_default_global_state(void)
-{
-    GlobalState.outputfile = stdout;
-    GlobalState.logfile = stderr;
-    set_output_line_length(MAX_LINE_LENGTH);
-}
+#include "parallel.h"
+#include "gameindex.h"
+#include "globalstate.h"
+#include "dupsort.h"
+#include "eco.h"
 
 int
 main(int argc, char *argv[])
@@ -183,6 +57,8 @@ main(int argc, char *argv[])
     init_tag_lists();
     /* Prepare the hash tables for transposition detection. */
     init_hashtab();
+    /* Prepare the attack tables for move validation. */
+    init_bitboards();
     /* Initialise the lexical analyser's tables. */
     init_lex_tables();
     /* Allow for some arguments. */
@@ -410,27 +286,48 @@ main(int argc, char *argv[])
     init_duplicate_hash_table();
 
     if (GlobalState.add_ECO) {
-        /* Read in a list of ECO lines in order to classify the games. */
-        if (open_eco_file(GlobalState.eco_file)) {
+        /* Read in a list of ECO lines in order to classify the games,
+         * unless they have already been compiled.
+         */
+        if (GlobalState.eco_table_file != NULL &&
+                load_eco_table(GlobalState.eco_table_file, GlobalState.eco_file)) {
+            /* The compiled table is up to date. */
+        }
+        else if (open_eco_file(GlobalState.eco_file)) {
             /* Indicate that the ECO file is currently being parsed. */
             GlobalState.parsing_ECO_file = TRUE;
             yyparse(ECOFILE);
             reset_line_number();
             GlobalState.parsing_ECO_file = FALSE;
+            if (GlobalState.eco_table_file != NULL) {
+                save_eco_table(GlobalState.eco_table_file, GlobalState.eco_file);
+            }
         }
         else {
             fprintf(GlobalState.logfile, "Unable to open the ECO file %s.\n",
                     GlobalState.eco_file);
             exit(1);
         }
+        /* The ECO lines are complete, so prepare them for lookup. */
+        freeze_eco_table();
     }
 
-    /* Open up the first file as the source of input. */
-    if (!open_first_file()) {
-        exit(1);
+    if (parallel_processing_possible()) {
+        process_files_in_parallel();
+    }
+    else if (external_duplicates_possible()) {
+        process_files_with_external_duplicates();
     }
+    else {
+        /* Open up the first file as the source of input. */
+        if (!open_first_file()) {
+            exit(1);
+        }
 
-    yyparse(GlobalState.current_file_type);
+        yyparse(GlobalState.current_file_type);
+        /* Any index of a file that was not read to the end is incomplete. */
+        abandon_game_index();
+    }
 
     /* @@@ I would prefer this to be somewhere else. */
     if (GlobalState.json_format && !GlobalState.check_only) {
@@ -451,6 +348,9 @@ main(int argc, char *argv[])
                 GlobalState.num_games_matched == 1 ? "" : "s",
                 GlobalState.num_games_processed);
     }
+    if (GlobalState.verbosity & COUNT_SUMMARY) {
+        report_duplicate_filter_statistics(GlobalState.logfile);
+    }
     if ((GlobalState.logfile != stderr) && (GlobalState.logfile != NULL)) {
         (void) fclose(GlobalState.logfile);
     }
@@ -33,6 +33,7 @@
 #include "map.h"
 #include "decode.h"
 #include "apply.h"
+#include "zobrist.h"
 
 /* Structures to hold the x,y displacements of the various
  * piece movements.
@@ -50,22 +51,6 @@ static int Knight_moves[2 * NUM_KNIGHT_MOVES] = {
     -2, 1,
     -2, -1,};
 
-/* Define a list of possible Bishop moves. */
-#define NUM_BISHOP_MOVES 4
-static int Bishop_moves[2 * NUM_BISHOP_MOVES] = {
-    1, 1,
-    1, -1,
-    -1, 1,
-    -1, -1};
-
-/* Define a list of possible Rook moves. */
-#define NUM_ROOK_MOVES 4
-static int Rook_moves[2 * NUM_ROOK_MOVES] = {
-    1, 0,
-    0, 1,
-    -1, 0,
-    0, -1};
-
 /* Define a list of possible King moves. */
 #define NUM_KING_MOVES 8
 static int King_moves[2 * NUM_KING_MOVES] = {
@@ -78,22 +63,49 @@ static int King_moves[2 * NUM_KING_MOVES] = {
     -1, 1,
     -1, -1,};
 
-/* Define a list of possible Queen moves. */
-#define NUM_QUEEN_MOVES 8
-static int Queen_moves[2 * NUM_QUEEN_MOVES] = {
+/* The bitboard index of the square at board[r][c]. */
+#define SQUARE_INDEX(r, c) (((r) - HEDGE) * BOARDSIZE + ((c) - HEDGE))
+#define SQUARE_BIT(r, c) (((Bitboard) 1) << SQUARE_INDEX(r, c))
+/* The board row and column of a bitboard index. */
+#define INDEX_ROW(sq) ((sq) / BOARDSIZE + HEDGE)
+#define INDEX_COL(sq) ((sq) % BOARDSIZE + HEDGE)
+#define NUM_SQUARES (BOARDSIZE * BOARDSIZE)
+
+/* The directions of the sliding-piece rays.
+ * Those that increase the square index come first so that the
+ * nearest blocker on a ray can be found from the lowest or highest bit.
+ */
+typedef enum {
+    NORTH, EAST, NORTH_EAST, NORTH_WEST,
+    SOUTH, WEST, SOUTH_WEST, SOUTH_EAST,
+    NUM_DIRECTIONS
+} Direction;
+#define NUM_INCREASING_DIRECTIONS 4
+static const int Direction_offsets[2 * NUM_DIRECTIONS] = {
     1, 0,
+    0, 1,
     1, 1,
     1, -1,
-    0, 1,
-    0, -1,
     -1, 0,
-    -1, 1,
-    -1, -1,};
+    0, -1,
+    -1, -1,
+    -1, 1,};
 
+/* The squares attacked from each square by a knight, a king and
+ * a pawn of either colour.
+ */
+static Bitboard Knight_attacks[NUM_SQUARES];
+static Bitboard King_attacks[NUM_SQUARES];
+static Bitboard Pawn_attacks[2][NUM_SQUARES];
+/* The squares from each square to the edge of the board in each
+ * direction.
+ */
+static Bitboard Rays[NUM_DIRECTIONS][NUM_SQUARES];
 
 /* A table of hash values for square/piece/colour combinations.
  * When a piece is moved, the hash value is xor-ed into a
- * running description of the current board state.
+ * running description of the current board state: the
+ * Board's polyglot Zobrist hash value.
  */
 #define NUMBER_OF_PIECES 6
 static HashCode HashTab[BOARDSIZE][BOARDSIZE][NUMBER_OF_PIECES][2];
@@ -163,33 +175,29 @@ free_move_pair_list(MovePair *move_list)
     }
 }
 
-/* Produce a hash value for each piece, square, colour combination.
- * This code is a modified version of that to be found in
- * Steven J. Edwards' SAN kit.
+/* Fill HashTab with the polyglot Zobrist value of
+ * each piece, square, colour combination.
  */
-#define SHIFT_LENGTH 7
-
 void
 init_hashtab(void)
 {
+    static const char piece_letters[] = "PNBRQK";
     Piece piece;
     Colour colour;
     Rank rank;
     Col col;
-    static HashCode seed = 0;
 
     for (col = FIRSTCOL; col <= LASTCOL; col++) {
         for (rank = FIRSTRANK; rank <= LASTRANK; rank++) {
             for (piece = PAWN; piece <= KING; piece++) {
                 for (colour = BLACK; colour <= WHITE; colour++) {
-                    HashCode code;
+                    char letter = piece_letters[piece - PAWN];
 
-                    /* Try to use a wider range of the available values
-                     * in an attempt to avoid spurious hash matches.
-                     */
-                    seed = (seed * 1103515245L) + 123456789L;
-                    code = (seed >> SHIFT_LENGTH);
-                    HashTab[col - FIRSTCOL][rank - FIRSTRANK][piece - PAWN][colour - BLACK] = code;
+                    if (colour == BLACK) {
+                        letter = tolower(letter);
+                    }
+                    HashTab[col - FIRSTCOL][rank - FIRSTRANK][piece - PAWN][colour - BLACK] =
+                            piece_hash(letter, rank, col);
                 }
             }
         }
@@ -203,6 +211,310 @@ hash_lookup(Col col, Rank rank, Piece piece, Colour colour)
     return HashTab[col - FIRSTCOL][rank - FIRSTRANK][piece - PAWN][colour - BLACK];
 }
 
+/* Return the bitboard of the squares reached by the given
+ * (row, column) offsets from the square at board[r][c].
+ */
+static Bitboard
+offset_squares(int r, int c, const int *offsets, unsigned num_offsets)
+{
+    Bitboard squares = 0;
+
+    for (unsigned ix = 0; ix < 2 * num_offsets; ix += 2) {
+        int to_r = r + offsets[ix];
+        int to_c = c + offsets[ix + 1];
+
+        if (to_r >= HEDGE && to_r < HEDGE + BOARDSIZE &&
+                to_c >= HEDGE && to_c < HEDGE + BOARDSIZE) {
+            squares |= SQUARE_BIT(to_r, to_c);
+        }
+    }
+    return squares;
+}
+
+/* Fill the attack and ray tables used with the bitboards. */
+void
+init_bitboards(void)
+{
+    static const int White_pawn_captures[] = { 1, -1, 1, 1 };
+    static const int Black_pawn_captures[] = { -1, -1, -1, 1 };
+
+    for (int sq = 0; sq < NUM_SQUARES; sq++) {
+        int r = INDEX_ROW(sq), c = INDEX_COL(sq);
+
+        Knight_attacks[sq] = offset_squares(r, c, Knight_moves, NUM_KNIGHT_MOVES);
+        King_attacks[sq] = offset_squares(r, c, King_moves, NUM_KING_MOVES);
+        Pawn_attacks[WHITE][sq] = offset_squares(r, c, White_pawn_captures, 2);
+        Pawn_attacks[BLACK][sq] = offset_squares(r, c, Black_pawn_captures, 2);
+        for (Direction dir = NORTH; dir < NUM_DIRECTIONS; dir++) {
+            Bitboard ray = 0;
+            int ray_r = r + Direction_offsets[2 * dir];
+            int ray_c = c + Direction_offsets[2 * dir + 1];
+
+            while (ray_r >= HEDGE && ray_r < HEDGE + BOARDSIZE &&
+                    ray_c >= HEDGE && ray_c < HEDGE + BOARDSIZE) {
+                ray |= SQUARE_BIT(ray_r, ray_c);
+                ray_r += Direction_offsets[2 * dir];
+                ray_c += Direction_offsets[2 * dir + 1];
+            }
+            Rays[dir][sq] = ray;
+        }
+    }
+}
+
+/* Set the bitboards of board from the pieces on its squares. */
+void
+set_bitboards(Board *board)
+{
+    memset(board->pieces, 0, sizeof(board->pieces));
+    memset(board->occupied, 0, sizeof(board->occupied));
+    for (int r = HEDGE; r < HEDGE + BOARDSIZE; r++) {
+        for (int c = HEDGE; c < HEDGE + BOARDSIZE; c++) {
+            Piece occupant = board->board[r][c];
+
+            if (occupant != EMPTY) {
+                Colour colour = EXTRACT_COLOUR(occupant);
+
+                board->pieces[colour][EXTRACT_PIECE(occupant)] |= SQUARE_BIT(r, c);
+                board->occupied[colour] |= SQUARE_BIT(r, c);
+            }
+        }
+    }
+}
+
+/* The record in which set_square saves the squares it changes,
+ * between calls to begin_undo_record and end_undo_record.
+ */
+static MoveUndo *undo_record = NULL;
+/* The board whose changes are recorded in undo_record.
+ * Changes to other boards, such as the scratch copies made
+ * while building FEN strings, are not recorded.
+ */
+static const Board *undo_board = NULL;
+
+/* Place coloured_piece, which may be EMPTY, on the square at board[r][c],
+ * keeping the bitboards consistent with it.
+ */
+static void
+set_square(Board *board, int r, int c, Piece coloured_piece)
+{
+    Piece occupant = board->board[r][c];
+    Bitboard bit = SQUARE_BIT(r, c);
+
+    if (undo_record != NULL && board == undo_board) {
+        if (undo_record->num_squares >= MAX_UNDO_SQUARES) {
+            fprintf(GlobalState.logfile,
+                    "Internal error: too many squares changed in set_square().\n");
+            exit(1);
+        }
+        undo_record->squares[undo_record->num_squares].r = r;
+        undo_record->squares[undo_record->num_squares].c = c;
+        undo_record->squares[undo_record->num_squares].occupant = occupant;
+        undo_record->num_squares++;
+    }
+
+    if (occupant != EMPTY) {
+        Colour colour = EXTRACT_COLOUR(occupant);
+
+        board->pieces[colour][EXTRACT_PIECE(occupant)] &= ~bit;
+        board->occupied[colour] &= ~bit;
+    }
+    if (coloured_piece != EMPTY) {
+        Colour colour = EXTRACT_COLOUR(coloured_piece);
+
+        board->pieces[colour][EXTRACT_PIECE(coloured_piece)] |= bit;
+        board->occupied[colour] |= bit;
+    }
+    board->board[r][c] = coloured_piece;
+}
+
+/* Save the state of board in undo and record in it the squares changed
+ * by the moves made until end_undo_record is called.
+ */
+void
+begin_undo_record(MoveUndo *undo, const Board *board)
+{
+    undo->num_squares = 0;
+    undo->to_move = board->to_move;
+    undo->move_number = board->move_number;
+    undo->WKingCastle = board->WKingCastle;
+    undo->WQueenCastle = board->WQueenCastle;
+    undo->BKingCastle = board->BKingCastle;
+    undo->BQueenCastle = board->BQueenCastle;
+    undo->WKingCol = board->WKingCol;
+    undo->WKingRank = board->WKingRank;
+    undo->BKingCol = board->BKingCol;
+    undo->BKingRank = board->BKingRank;
+    undo->EnPassant = board->EnPassant;
+    undo->ep_rank = board->ep_rank;
+    undo->ep_col = board->ep_col;
+    undo->zobrist = board->zobrist;
+    undo->halfmove_clock = board->halfmove_clock;
+    undo_record = undo;
+    undo_board = board;
+}
+
+/* Stop recording changed squares. */
+void
+end_undo_record(void)
+{
+    undo_record = NULL;
+    undo_board = NULL;
+}
+
+/* Return board to the state it had when undo was begun. */
+void
+unmake_move(const MoveUndo *undo, Board *board)
+{
+    for (unsigned ix = undo->num_squares; ix > 0; ix--) {
+        set_square(board, undo->squares[ix - 1].r, undo->squares[ix - 1].c,
+                undo->squares[ix - 1].occupant);
+    }
+    board->to_move = undo->to_move;
+    board->move_number = undo->move_number;
+    board->WKingCastle = undo->WKingCastle;
+    board->WQueenCastle = undo->WQueenCastle;
+    board->BKingCastle = undo->BKingCastle;
+    board->BQueenCastle = undo->BQueenCastle;
+    board->WKingCol = undo->WKingCol;
+    board->WKingRank = undo->WKingRank;
+    board->BKingCol = undo->BKingCol;
+    board->BKingRank = undo->BKingRank;
+    board->EnPassant = undo->EnPassant;
+    board->ep_rank = undo->ep_rank;
+    board->ep_col = undo->ep_col;
+    board->zobrist = undo->zobrist;
+    board->halfmove_clock = undo->halfmove_clock;
+}
+
+/* Return the index of the lowest square in the non-empty set squares. */
+static int
+lowest_square(Bitboard squares)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzll(squares);
+#else
+    int sq = 0;
+
+    while ((squares & 1) == 0) {
+        squares >>= 1;
+        sq++;
+    }
+    return sq;
+#endif
+}
+
+/* Return the index of the highest square in the non-empty set squares. */
+static int
+highest_square(Bitboard squares)
+{
+#if defined(__GNUC__)
+    return (NUM_SQUARES - 1) - __builtin_clzll(squares);
+#else
+    int sq = NUM_SQUARES - 1;
+
+    while ((squares & (((Bitboard) 1) << sq)) == 0) {
+        sq--;
+    }
+    return sq;
+#endif
+}
+
+/* Return the squares attacked along the ray in direction dir from sq,
+ * up to and including the first occupied square.
+ */
+static Bitboard
+ray_attacks(Direction dir, int sq, Bitboard occupied)
+{
+    Bitboard attacks = Rays[dir][sq];
+    Bitboard blockers = attacks & occupied;
+
+    if (blockers != 0) {
+        int blocker = dir < NUM_INCREASING_DIRECTIONS ?
+                lowest_square(blockers) : highest_square(blockers);
+        attacks ^= Rays[dir][blocker];
+    }
+    return attacks;
+}
+
+/* Return the squares attacked diagonally from sq. */
+static Bitboard
+bishop_attacks(int sq, Bitboard occupied)
+{
+    return ray_attacks(NORTH_EAST, sq, occupied) |
+           ray_attacks(NORTH_WEST, sq, occupied) |
+           ray_attacks(SOUTH_WEST, sq, occupied) |
+           ray_attacks(SOUTH_EAST, sq, occupied);
+}
+
+/* Return the squares attacked along the rank and file from sq. */
+static Bitboard
+rook_attacks(int sq, Bitboard occupied)
+{
+    return ray_attacks(NORTH, sq, occupied) |
+           ray_attacks(EAST, sq, occupied) |
+           ray_attacks(SOUTH, sq, occupied) |
+           ray_attacks(WEST, sq, occupied);
+}
+
+/* Return the squares of the pieces of colour that attack sq,
+ * given the occupied squares and ignoring any pieces on the squares
+ * in removed.
+ */
+static Bitboard
+attackers_of(const Board *board, int sq, Colour colour,
+        Bitboard occupied, Bitboard removed)
+{
+    const Bitboard *pieces = board->pieces[colour];
+    Bitboard attackers =
+            (Knight_attacks[sq] & pieces[KNIGHT]) |
+            (King_attacks[sq] & pieces[KING]) |
+            (Pawn_attacks[OPPOSITE_COLOUR(colour)][sq] & pieces[PAWN]) |
+            (bishop_attacks(sq, occupied) & (pieces[BISHOP] | pieces[QUEEN])) |
+            (rook_attacks(sq, occupied) & (pieces[ROOK] | pieces[QUEEN]));
+
+    return attackers & ~removed;
+}
+
+/* Return the bitboard index of col,rank, or -1 if that is not
+ * a square on the board.
+ */
+static int
+square_index(Col col, Rank rank)
+{
+    int r = RankConvert(rank);
+    int c = ColConvert(col);
+
+    return (r != 0 && c != 0) ? SQUARE_INDEX(r, c) : -1;
+}
+
+/* Return the bitboard index of the king of the given colour. */
+static int
+king_square(const Board *board, Colour colour)
+{
+    if (colour == WHITE) {
+        return square_index(board->WKingCol, board->WKingRank);
+    }
+    else {
+        return square_index(board->BKingCol, board->BKingRank);
+    }
+}
+
+/* Add a move to to_col,to_rank from each of the squares in sources
+ * onto moves, and return the new list.
+ */
+static MovePair *
+append_move_pairs(Bitboard sources, Col to_col, Rank to_rank, MovePair *moves)
+{
+    while (sources != 0) {
+        int sq = lowest_square(sources);
+
+        moves = append_move_pair(ToCol(INDEX_COL(sq)), ToRank(INDEX_ROW(sq)),
+                to_col, to_rank, moves);
+        sources &= sources - 1;
+    }
+    return moves;
+}
+
 /* Is the given piece of the named colour? */
 static Boolean
 piece_is_colour(Piece coloured_piece, Colour colour)
@@ -237,6 +549,11 @@ make_move(MoveClass class, Col from_col, Rank from_rank, Col to_col, Rank to_ran
     else {
         castling_rook_col = '\0';
     }
+    /* The hash values of the castling and en-passant rights
+     * before the move, to be replaced once it has been made.
+     */
+    HashCode previous_rights = zobrist_castling_value(board) ^
+                               zobrist_ep_value(board, colour);
 
     /* If a KING or ROOK is moved, this might affect castling rights. */
     if (piece == KING) {
@@ -301,8 +618,8 @@ make_move(MoveClass class, Col from_col, Rank from_rank, Col to_col, Rank to_ran
             else if ((board->EnPassant) && (board->ep_rank == to_rank) &&
                     (board->ep_col == to_col)) {
                 /* This is an ep capture. Remove the intermediate pawn. */
-                board->board[RankConvert(to_rank) - 1][ColConvert(to_col)] = EMPTY;
-                board->weak_hash_value ^= hash_lookup(to_col, to_rank - 1, PAWN, BLACK);
+                set_square(board, RankConvert(to_rank) - 1, ColConvert(to_col), EMPTY);
+                board->zobrist ^= hash_lookup(to_col, to_rank - 1, PAWN, BLACK);
                 board->EnPassant = FALSE;
             }
             else {
@@ -318,8 +635,8 @@ make_move(MoveClass class, Col from_col, Rank from_rank, Col to_col, Rank to_ran
             else if ((board->EnPassant) && (board->ep_rank == to_rank) &&
                     (board->ep_col == to_col)) {
                 /* This is an ep capture. Remove the intermediate pawn. */
-                board->board[RankConvert(to_rank) + 1][ColConvert(to_col)] = EMPTY;
-                board->weak_hash_value ^= hash_lookup(to_col, to_rank + 1, PAWN, WHITE);
+                set_square(board, RankConvert(to_rank) + 1, ColConvert(to_col), EMPTY);
+                board->zobrist ^= hash_lookup(to_col, to_rank + 1, PAWN, WHITE);
                 board->EnPassant = FALSE;
             }
             else {
@@ -330,12 +647,12 @@ make_move(MoveClass class, Col from_col, Rank from_rank, Col to_col, Rank to_ran
     /* Clear the source square. */
     if (class == PAWN_MOVE_WITH_PROMOTION && piece != PAWN) {
         /* Remove the promoted pawn. */
-        board->weak_hash_value ^= hash_lookup(from_col, from_rank, PAWN, colour);
+        board->zobrist ^= hash_lookup(from_col, from_rank, PAWN, colour);
     }
     else {
-        board->weak_hash_value ^= hash_lookup(from_col, from_rank, piece, colour);
+        board->zobrist ^= hash_lookup(from_col, from_rank, piece, colour);
     }
-    board->board[from_r][from_c] = EMPTY;
+    set_square(board, from_r, from_c, EMPTY);
     if (board->board[to_r][to_c] != EMPTY) {
         /* Delete the removed piece from the hash value. */
         Piece coloured_piece = board->board[to_r][to_c];
@@ -344,7 +661,7 @@ make_move(MoveClass class, Col from_col, Rank from_rank, Col to_col, Rank to_ran
         
         removed_piece = EXTRACT_PIECE(coloured_piece);
         removed_colour = EXTRACT_COLOUR(coloured_piece);
-        board->weak_hash_value ^= hash_lookup(to_col, to_rank, removed_piece, removed_colour);
+        board->zobrist ^= hash_lookup(to_col, to_rank, removed_piece, removed_colour);
         /* See whether the removed piece is a Rook, as this could
          * affect castling rights.
          */
@@ -392,9 +709,9 @@ make_move(MoveClass class, Col from_col, Rank from_rank, Col to_col, Rank to_ran
         board->halfmove_clock++;
     }
     /* Place the piece at its destination. */
-    board->board[to_r][to_c] = MAKE_COLOURED_PIECE(colour, piece);
+    set_square(board, to_r, to_c, MAKE_COLOURED_PIECE(colour, piece));
     /* Insert the moved piece into the hash value. */
-    board->weak_hash_value ^= hash_lookup(to_col, to_rank, piece, colour);
+    board->zobrist ^= hash_lookup(to_col, to_rank, piece, colour);
     if(!board->EnPassant) {
         board->ep_rank = '\0';
         board->ep_col = '\0';
@@ -404,13 +721,84 @@ make_move(MoveClass class, Col from_col, Rank from_rank, Col to_col, Rank to_ran
         /* The rook involved in the castling move must now be moved. */
         if (castling_rook_col != to_col) {
             /* It must be removed. */
-            board->weak_hash_value ^= hash_lookup(castling_rook_col, from_rank, ROOK, colour);
-            board->board[from_r][ColConvert(castling_rook_col)] = EMPTY;
+            board->zobrist ^= hash_lookup(castling_rook_col, from_rank, ROOK, colour);
+            set_square(board, from_r, ColConvert(castling_rook_col), EMPTY);
         }
         int rook_offset = (class == KINGSIDE_CASTLE ? -1 : 1);
         /* Place the rook at its destination. */
-        board->board[to_r][to_c + rook_offset] = MAKE_COLOURED_PIECE(colour, ROOK);
-        board->weak_hash_value ^= hash_lookup(to_col + rook_offset, to_rank, ROOK, colour);
+        set_square(board, to_r, to_c + rook_offset, MAKE_COLOURED_PIECE(colour, ROOK));
+        board->zobrist ^= hash_lookup(to_col + rook_offset, to_rank, ROOK, colour);
+    }
+    board->zobrist ^= previous_rights ^
+                      zobrist_castling_value(board) ^
+                      zobrist_ep_value(board, OPPOSITE_COLOUR(colour));
+    /* The opponent is now to move, except when this is the second
+     * part of a promotion: replacing the pawn with the promoted piece.
+     */
+    if (class != PAWN_MOVE_WITH_PROMOTION || piece == PAWN) {
+        board->zobrist ^= zobrist_white_to_move_value();
+    }
+}
+
+/* Update the hash value of board for a null move by colour.
+ * The pieces are unchanged but the player to move is not and
+ * that affects whether an en-passant capture is available.
+ */
+void
+make_null_move(Colour colour, Board *board)
+{
+    board->zobrist ^= zobrist_ep_value(board, colour) ^
+                      zobrist_ep_value(board, OPPOSITE_COLOUR(colour)) ^
+                      zobrist_white_to_move_value();
+}
+
+/* Make move, as generated by generate_legal_moves, for the player
+ * to move on board and pass the move to the opponent.
+ */
+void
+make_compact_move(CompactMove move, Board *board)
+{
+    Colour colour = board->to_move;
+    int from_sq = COMPACT_FROM(move);
+    int to_sq = COMPACT_TO(move);
+    Col from_col = FIRSTCOL + from_sq % BOARDSIZE;
+    Rank from_rank = FIRSTRANK + from_sq / BOARDSIZE;
+    Col to_col = FIRSTCOL + to_sq % BOARDSIZE;
+    Rank to_rank = FIRSTRANK + to_sq / BOARDSIZE;
+    Piece piece = EXTRACT_PIECE(board->board[INDEX_ROW(from_sq)][INDEX_COL(from_sq)]);
+    MoveFlag flag = COMPACT_FLAG(move);
+
+    switch (flag) {
+        case ORDINARY_MOVE:
+            make_move(piece == PAWN ? PAWN_MOVE : PIECE_MOVE,
+                      from_col, from_rank, to_col, to_rank, piece, colour, board);
+            break;
+        case EN_PASSANT_MOVE:
+            make_move(ENPASSANT_PAWN_MOVE,
+                      from_col, from_rank, to_col, to_rank, PAWN, colour, board);
+            break;
+        case KINGSIDE_CASTLING:
+            make_move(KINGSIDE_CASTLE,
+                      from_col, from_rank, to_col, to_rank, KING, colour, board);
+            break;
+        case QUEENSIDE_CASTLING:
+            make_move(QUEENSIDE_CASTLE,
+                      from_col, from_rank, to_col, to_rank, KING, colour, board);
+            break;
+        default:
+            /* Move the pawn and then replace it with the promoted piece,
+             * as apply_move does.
+             */
+            make_move(PAWN_MOVE_WITH_PROMOTION,
+                      from_col, from_rank, to_col, to_rank, PAWN, colour, board);
+            make_move(PAWN_MOVE_WITH_PROMOTION,
+                      to_col, to_rank, to_col, to_rank,
+                      KNIGHT + (flag - KNIGHT_PROMOTION), colour, board);
+            break;
+    }
+    board->to_move = OPPOSITE_COLOUR(colour);
+    if (board->to_move == WHITE) {
+        board->move_number++;
     }
 }
 
@@ -552,430 +940,112 @@ find_pawn_moves(Col from_col, Rank from_rank, Col to_col, Rank to_rank,
 MovePair *
 find_knight_moves(Col to_col, Rank to_rank, Colour colour, const Board *board)
 {
-    int to_r = RankConvert(to_rank);
-    int to_c = ColConvert(to_col);
-    unsigned ix;
-    MovePair *move_list = NULL;
-    Piece target_piece = MAKE_COLOURED_PIECE(colour, KNIGHT);
-
-    /* Pick up pairs of offsets from to_r,to_c to look for a Knight of
-     * the right colour.
-     */
-    for (ix = 0; ix < 2 * NUM_KNIGHT_MOVES; ix += 2) {
-        int r = Knight_moves[ix] + to_r;
-        int c = Knight_moves[ix + 1] + to_c;
-
-        if (board->board[r][c] == target_piece) {
-            move_list = append_move_pair(ToCol(c), ToRank(r), to_col, to_rank, move_list);
-        }
-    }
-    return move_list;
-}
-
-/* Find bishop moves to the given square. */
-MovePair *
-find_bishop_moves(Col to_col, Rank to_rank, Colour colour, const Board *board)
-{
-    int to_r = RankConvert(to_rank);
-    int to_c = ColConvert(to_col);
-    MovePair *move_list = NULL;
-    Piece target_piece = MAKE_COLOURED_PIECE(colour, BISHOP);
-
-    /* Pick up pairs of offsets from to_r,to_c to look for a Bishop of
-     * the right colour.
-     */
-    for (unsigned ix = 0; ix < 2 * NUM_BISHOP_MOVES; ix += 2) {
-        int r = to_r, c = to_c;
-
-        /* Work backwards from the destination to find a bishop of
-         * the right colour.
-         */
-        do {
-            r += Bishop_moves[ix];
-            c += Bishop_moves[ix + 1];
-        } while (board->board[r][c] == EMPTY);
-
-        if (board->board[r][c] == target_piece) {
-            move_list = append_move_pair(ToCol(c), ToRank(r), to_col, to_rank, move_list);
-        }
-    }
-    return move_list;
-}
-
-/* Find rook moves to the given square. */
-MovePair *
-find_rook_moves(Col to_col, Rank to_rank, Colour colour, const Board *board)
-{
-    int to_r = RankConvert(to_rank);
-    int to_c = ColConvert(to_col);
-    MovePair *move_list = NULL;
-    Piece target_piece = MAKE_COLOURED_PIECE(colour, ROOK);
-
-    /* Pick up pairs of offsets from to_r,to_c to look for a Rook of
-     * the right colour.
-     */
-    for (unsigned ix = 0; ix < 2 * NUM_ROOK_MOVES; ix += 2) {
-        int r = to_r, c = to_c;
-
-        /* Work backwards from the destination to find a rook of
-         * the right colour.
-         */
-        do {
-            r += Rook_moves[ix];
-            c += Rook_moves[ix + 1];
-        } while (board->board[r][c] == EMPTY);
-
-        if (board->board[r][c] == target_piece) {
-            move_list = append_move_pair(ToCol(c), ToRank(r), to_col, to_rank, move_list);
-        }
-    }
-    return move_list;
-}
-
-/* Find queen moves to the given square. */
-MovePair *
-find_queen_moves(Col to_col, Rank to_rank, Colour colour, const Board *board)
-{
-    int to_r = RankConvert(to_rank);
-    int to_c = ColConvert(to_col);
-    MovePair *move_list = NULL;
-    Piece target_piece = MAKE_COLOURED_PIECE(colour, QUEEN);
-
-    /* Pick up pairs of offsets from to_r,to_c to look for a Queen of
-     * the right colour.
-     */
-    for (unsigned ix = 0; ix < 2 * NUM_QUEEN_MOVES; ix += 2) {
-        int r = to_r, c = to_c;
-
-        /* Work backwards from the destination to find a queen of
-         * the right colour.
-         */
-        do {
-            r += Queen_moves[ix];
-            c += Queen_moves[ix + 1];
-        } while (board->board[r][c] == EMPTY);
-
-        if (board->board[r][c] == target_piece) {
-            move_list = append_move_pair(ToCol(c), ToRank(r), to_col, to_rank, move_list);
-        }
-    }
-    return move_list;
-}
-
-/* Find King moves to the given square. */
-MovePair *
-find_king_moves(Col to_col, Rank to_rank, Colour colour, const Board *board)
-{
-    int to_r = RankConvert(to_rank);
-    int to_c = ColConvert(to_col);
-    MovePair *move_list = NULL;
-    Piece target_piece = MAKE_COLOURED_PIECE(colour, KING);
-    /* Stop once the single King is found. */
-    Boolean found = FALSE;
-
-    /* Pick up pairs of offsets from to_r,to_c to look for a King of
-     * the right colour.
-     */
-    for (unsigned ix = 0; ix < 2 * NUM_KING_MOVES && !found; ix += 2) {
-        int r = King_moves[ix] + to_r;
-        int c = King_moves[ix + 1] + to_c;
-
-        if (board->board[r][c] == target_piece) {
-            move_list = append_move_pair(ToCol(c), ToRank(r), to_col, to_rank, move_list);
-            found = TRUE;
-        }
-    }
-    if(!found) {
-        /* Check for possible Chess960 castling moves.
-         * Represented as a move to the position occupied by
-         * one of colour's own rooks.
-         */
-        Boolean possible_castling_move = FALSE;
-        if(colour == WHITE) {
-            if(to_rank == '1') {
-                if(to_col == board->WKingCastle || to_col == board->WQueenCastle) {
-                    possible_castling_move = TRUE;
-                }
-            }
-        }
-        else {
-            if(to_rank == '8') {
-                if(to_col == board->BKingCastle || to_col == board->BQueenCastle) {
-                    possible_castling_move = TRUE;
-                }
-            }
-        }
-        if(possible_castling_move) {
-            int c = ColConvert(COLBASE);
-            for(char col = COLBASE; col < COLBASE + BOARDSIZE && !found; col++ ) {
-                if(board->board[to_r][c] == target_piece) {
-                    move_list = append_move_pair(col, to_rank, to_col, to_rank, move_list);
-                    found = TRUE;
-                }
-                else {
-                    c++;
-                }
-            }
-        }
-    }
-    return move_list;
-}
-
-/* Find pawn moves matching the to_ and from_ information.
- * Depending on the input form of the move, some of this will be
- * incomplete.  For instance: e4 supplies just the to_ information
- * whereas cb supplies some from_ and some to_.
- */
-static Boolean
-find_single_pawn_move(Col from_col, Rank from_rank, Col to_col, Rank to_rank,
-        Colour colour, const Board *board)
-{
-    int to_r = RankConvert(to_rank);
-    int to_c = ColConvert(to_col);
-    int from_r = RankConvert(from_rank);
-    int from_c = ColConvert(from_col);
-    /* White pawn moves are offset by +1, Black by -1. */
-    int offset = COLOUR_OFFSET(colour);
-    Piece piece_to_move = MAKE_COLOURED_PIECE(colour, PAWN);
-    Boolean found = FALSE;
-
-    if ((to_col != 0) && (to_rank != 0)) {
-        /* We know the complete destination. */
-        if (board->board[to_r][to_c] == EMPTY) {
-            /* Destination must be empty for this form. */
-            if (board->board[to_r - offset][to_c] == piece_to_move) {
-                /* MovePair of one square. */
-                found = TRUE;
-            }
-            else if ((board->board[to_r - offset][to_c] == EMPTY) &&
-                    (to_rank == (colour == WHITE ? '4' : '5'))) {
-                /* Special case of initial two square move. */
-                if (board->board[to_r - 2 * offset][to_c] == piece_to_move) {
-                    found = TRUE;
-                }
-            }
-            else if (board->EnPassant &&
-                    (board->ep_rank == to_rank) &&
-                    (board->ep_col == to_col)) {
-                /* Make sure that there is a valid pawn in position. */
-                if (from_col != 0) {
-                    from_r = to_r - offset;
-                    if (board->board[from_r][from_c] == piece_to_move) {
-                        found = TRUE;
-                    }
-                }
-            }
-        }
-        else if (piece_is_colour(board->board[to_r][to_c], OPPOSITE_COLOUR(colour))) {
-            /* Capture on the destination square. */
-            if (from_col != 0) {
-                /* We know the from column. */
-                from_r = to_r - offset;
-                if (board->board[from_r][from_c] == piece_to_move) {
-                    found = TRUE;
-                }
-            }
-        }
-        else {
-            /* We have no move. */
-        }
-    }
-    else if ((from_col != 0) && (to_col != 0)) {
-        /* Should be a diagonal capture. */
-        if (((from_col + 1) != to_col) && ((from_col - 1) != to_col)) {
-            /* Inconsistent information. */
-        }
-        else {
-            if (from_rank != 0) {
-                /* We have complete source information. Check its
-                 * veracity.
-                 */
-                to_r = from_r - offset;
-                if (board->board[from_r][from_c] == piece_to_move) {
-                    Piece occupant = board->board[to_r][to_c];
-
-                    if ((occupant != EMPTY) &&
-                            (piece_is_colour(occupant, OPPOSITE_COLOUR(colour)))) {
-                        found = TRUE;
-                    }
-                    else if (board->EnPassant && (board->ep_rank == ToRank(to_r)) &&
-                            (board->ep_col == ToCol(to_c))) {
-                        found = TRUE;
-                    }
-                }
-            }
-            else {
-                /* We must search the from_col and to_col for appropriate
-                 * combinations.  There may be more than one.
-                 */
-                int start_rank, end_rank;
-
-                /* Work out from where to start and end. */
-                if (colour == WHITE) {
-                    start_rank = RankConvert(FIRSTRANK + 1);
-                    end_rank = RankConvert(LASTRANK);
-                }
-                else {
-                    start_rank = RankConvert(LASTRANK - 1);
-                    end_rank = RankConvert(FIRSTRANK);
-                }
-                for (from_r = start_rank; from_r != end_rank && !found; from_r += offset) {
-                    to_r = from_r + offset;
-                    if (board->board[from_r][from_c] == piece_to_move) {
-                        Piece occupant = board->board[to_r][to_c];
-
-                        if ((occupant != EMPTY) &&
-                                (piece_is_colour(occupant, OPPOSITE_COLOUR(colour)))) {
-                            found = TRUE;
-                        }
-                        else if (board->EnPassant && (board->ep_rank == ToRank(to_r)) &&
-                                (board->ep_col == ToCol(to_c))) {
-                            found = TRUE;
-                        }
-                    }
-                }
-            }
-        }
-    }
-    return found;
-}
-
-/* Find knight moves to the given square. */
-static Boolean
-find_single_knight_move(Col to_col, Rank to_rank, Colour colour, const Board *board)
-{
-    int to_r = RankConvert(to_rank);
-    int to_c = ColConvert(to_col);
-    unsigned ix;
-    Piece target_piece = MAKE_COLOURED_PIECE(colour, KNIGHT);
-    Boolean found = FALSE;
-
-    /* Pick up pairs of offsets from to_r,to_c to look for a Knight of
-     * the right colour.
-     */
-    for (ix = 0; ix < 2 * NUM_KNIGHT_MOVES && !found; ix += 2) {
-        int r = Knight_moves[ix] + to_r;
-        int c = Knight_moves[ix + 1] + to_c;
-
-        if (board->board[r][c] == target_piece) {
-            found = TRUE;
-        }
+    int to_sq = square_index(to_col, to_rank);
+
+    if (to_sq < 0) {
+        return NULL;
     }
-    return found;
+    return append_move_pairs(Knight_attacks[to_sq] & board->pieces[colour][KNIGHT],
+            to_col, to_rank, NULL);
 }
 
-/* See if there is at least one bishop move to the given square. */
-static Boolean
-find_single_bishop_move(Col to_col, Rank to_rank, Colour colour, const Board *board)
+/* Find bishop moves to the given square. */
+MovePair *
+find_bishop_moves(Col to_col, Rank to_rank, Colour colour, const Board *board)
 {
-    int to_r = RankConvert(to_rank);
-    int to_c = ColConvert(to_col);
-    Piece target_piece = MAKE_COLOURED_PIECE(colour, BISHOP);
-    Boolean found = FALSE;
+    int to_sq = square_index(to_col, to_rank);
+    Bitboard occupied = board->occupied[WHITE] | board->occupied[BLACK];
 
-    /* Pick up pairs of offsets from to_r,to_c to look for a Bishop of
-     * the right colour.
-     */
-    for (unsigned ix = 0; ix < 2 * NUM_BISHOP_MOVES && !found; ix += 2) {
-        int r = to_r, c = to_c;
-
-        /* Work backwards from the destination to find a bishop of
-         * the right colour.
-         */
-        do {
-            r += Bishop_moves[ix];
-            c += Bishop_moves[ix + 1];
-        } while (board->board[r][c] == EMPTY);
-
-        if (board->board[r][c] == target_piece) {
-            found = TRUE;
-        }
+    if (to_sq < 0) {
+        return NULL;
     }
-    return found;
+    return append_move_pairs(bishop_attacks(to_sq, occupied) & board->pieces[colour][BISHOP],
+            to_col, to_rank, NULL);
 }
 
 /* Find rook moves to the given square. */
-static Boolean
-find_single_rook_move(Col to_col, Rank to_rank, Colour colour, const Board *board)
+MovePair *
+find_rook_moves(Col to_col, Rank to_rank, Colour colour, const Board *board)
 {
-    int to_r = RankConvert(to_rank);
-    int to_c = ColConvert(to_col);
-    Piece target_piece = MAKE_COLOURED_PIECE(colour, ROOK);
-    Boolean found = FALSE;
-
-    /* Pick up pairs of offsets from to_r,to_c to look for a Rook of
-     * the right colour.
-     */
-    for (unsigned ix = 0; ix < 2 * NUM_ROOK_MOVES && !found; ix += 2) {
-        int r = to_r, c = to_c;
-
-        /* Work backwards from the destination to find a rook of
-         * the right colour.
-         */
-        do {
-            r += Rook_moves[ix];
-            c += Rook_moves[ix + 1];
-        } while (board->board[r][c] == EMPTY);
+    int to_sq = square_index(to_col, to_rank);
+    Bitboard occupied = board->occupied[WHITE] | board->occupied[BLACK];
 
-        if (board->board[r][c] == target_piece) {
-            found = TRUE;
-        }
+    if (to_sq < 0) {
+        return NULL;
     }
-    return found;
+    return append_move_pairs(rook_attacks(to_sq, occupied) & board->pieces[colour][ROOK],
+            to_col, to_rank, NULL);
 }
 
 /* Find queen moves to the given square. */
-static Boolean
-find_single_queen_move(Col to_col, Rank to_rank, Colour colour, const Board *board)
+MovePair *
+find_queen_moves(Col to_col, Rank to_rank, Colour colour, const Board *board)
 {
-    int to_r = RankConvert(to_rank);
-    int to_c = ColConvert(to_col);
-    Piece target_piece = MAKE_COLOURED_PIECE(colour, QUEEN);
-    Boolean found = FALSE;
+    int to_sq = square_index(to_col, to_rank);
+    Bitboard occupied = board->occupied[WHITE] | board->occupied[BLACK];
 
-    /* Pick up pairs of offsets from to_r,to_c to look for a Queen of
-     * the right colour.
-     */
-    for (unsigned ix = 0; ix < 2 * NUM_QUEEN_MOVES && !found; ix += 2) {
-        int r = to_r, c = to_c;
-
-        /* Work backwards from the destination to find a queen of
-         * the right colour.
-         */
-        do {
-            r += Queen_moves[ix];
-            c += Queen_moves[ix + 1];
-        } while (board->board[r][c] == EMPTY);
-
-        if (board->board[r][c] == target_piece) {
-            found = TRUE;
-        }
+    if (to_sq < 0) {
+        return NULL;
     }
-    return found;
+    return append_move_pairs((bishop_attacks(to_sq, occupied) | rook_attacks(to_sq, occupied)) &
+            board->pieces[colour][QUEEN],
+            to_col, to_rank, NULL);
 }
 
 /* Find King moves to the given square. */
-static Boolean
-find_single_king_move(Col to_col, Rank to_rank, Colour colour, const Board *board)
+MovePair *
+find_king_moves(Col to_col, Rank to_rank, Colour colour, const Board *board)
 {
     int to_r = RankConvert(to_rank);
-    int to_c = ColConvert(to_col);
+    int to_sq = square_index(to_col, to_rank);
+    MovePair *move_list = NULL;
     Piece target_piece = MAKE_COLOURED_PIECE(colour, KING);
-    /* Store once the single King is found. */
+    /* Stop once the single King is found. */
     Boolean found = FALSE;
 
-    /* Pick up pairs of offsets from to_r,to_c to look for a King of
-     * the right colour.
-     */
-    for (unsigned ix = 0; ix < 2 * NUM_KING_MOVES && !found; ix += 2) {
-        int r = King_moves[ix] + to_r;
-        int c = King_moves[ix + 1] + to_c;
+    if (to_sq >= 0) {
+        Bitboard kings = King_attacks[to_sq] & board->pieces[colour][KING];
 
-        if (board->board[r][c] == target_piece) {
+        if (kings != 0) {
+            /* Take just one, in case the position has more than one king. */
+            move_list = append_move_pairs(kings & -kings, to_col, to_rank, NULL);
             found = TRUE;
         }
     }
-    return found;
+    if(!found) {
+        /* Check for possible Chess960 castling moves.
+         * Represented as a move to the position occupied by
+         * one of colour's own rooks.
+         */
+        Boolean possible_castling_move = FALSE;
+        if(colour == WHITE) {
+            if(to_rank == '1') {
+                if(to_col == board->WKingCastle || to_col == board->WQueenCastle) {
+                    possible_castling_move = TRUE;
+                }
+            }
+        }
+        else {
+            if(to_rank == '8') {
+                if(to_col == board->BKingCastle || to_col == board->BQueenCastle) {
+                    possible_castling_move = TRUE;
+                }
+            }
+        }
+        if(possible_castling_move) {
+            int c = ColConvert(COLBASE);
+            for(char col = COLBASE; col < COLBASE + BOARDSIZE && !found; col++ ) {
+                if(board->board[to_r][c] == target_piece) {
+                    move_list = append_move_pair(col, to_rank, to_col, to_rank, move_list);
+                    found = TRUE;
+                }
+                else {
+                    c++;
+                }
+            }
+        }
+    }
+    return move_list;
 }
 
 /* Return true if the king of the given colour is
@@ -984,64 +1054,50 @@ find_single_king_move(Col to_col, Rank to_rank, Colour colour, const Board *boar
 CheckStatus
 king_is_in_check(const Board *board, Colour king_colour)
 {
-    /* Assume that there is a check. */
-    CheckStatus in_check = CHECK;
-    Col king_col;
-    Rank king_rank;
-    Colour opponent_colour = OPPOSITE_COLOUR(king_colour);
+    int king_sq = king_square(board, king_colour);
+    Bitboard occupied = board->occupied[WHITE] | board->occupied[BLACK];
 
-    /* Find out where the king is now. */
-    if (king_colour == WHITE) {
-        king_col = board->WKingCol;
-        king_rank = board->WKingRank;
+    if (king_sq >= 0 &&
+            attackers_of(board, king_sq, OPPOSITE_COLOUR(king_colour), occupied, 0) != 0) {
+        return CHECK;
     }
     else {
-        king_col = board->BKingCol;
-        king_rank = board->BKingRank;
-    }
-    /* Try and find one move that leaves this king in check.
-     * There is probably an optimal order for these tests but 
-     * I don't know for sure what it is.
-     * Try the pieces with greatest mobility first.
-     * 
-     * @@@ NB: Since a single move would be enough, this could
-     * be made more efficient.
-     */
-    if (find_single_queen_move(king_col, king_rank,
-            opponent_colour, board)) {
-        /* King is in check from a queen. */
-    }
-    else if (find_single_rook_move(king_col, king_rank,
-            opponent_colour, board)) {
-        /* King is in check from a rook. */
-    }
-    else if (find_single_bishop_move(king_col, king_rank,
-            opponent_colour, board)) {
-        /* King is in check from a bishop. */
+        return NOCHECK;
     }
-    else if (find_single_knight_move(king_col, king_rank,
-            opponent_colour, board)) {
-        /* King is in check from a knight. */
-    }
-    else if ((king_col != LASTCOL) &&
-            (find_single_pawn_move(king_col + 1, 0, king_col, king_rank,
-            opponent_colour, board))) {
-        /* King is in check from a pawn to its right. */
-    }
-    else if ((king_col != FIRSTCOL) &&
-            (find_single_pawn_move(king_col - 1, 0, king_col, king_rank,
-            opponent_colour, board))) {
-        /* King is in check from a pawn. to its left */
-    }
-    else if (find_single_king_move(king_col, king_rank,
-            opponent_colour, board)) {
-        /* King is in check from a king. */
+}
+
+/* Return TRUE if moving piece of colour from from_sq to to_sq
+ * would leave colour's king in check.
+ * The move is not made: its effect on the occupied squares
+ * is used to look for attacks on the king's square.
+ */
+static Boolean
+leaves_king_in_check(Piece piece, Colour colour, int from_sq, int to_sq, const Board *board)
+{
+    int king_sq = piece == KING ? to_sq : king_square(board, colour);
+
+    if (from_sq < 0 || to_sq < 0 || king_sq < 0) {
+        /* Not a move on the board. */
+        return TRUE;
     }
     else {
-        /* King is safe. */
-        in_check = NOCHECK;
+        Bitboard from_bit = ((Bitboard) 1) << from_sq;
+        Bitboard to_bit = ((Bitboard) 1) << to_sq;
+        /* Any opponent's piece on the destination is captured. */
+        Bitboard captured = to_bit;
+        Bitboard occupied = ((board->occupied[WHITE] | board->occupied[BLACK]) & ~from_bit) |
+                to_bit;
+
+        if (piece == PAWN && board->EnPassant &&
+                to_sq == square_index(board->ep_col, board->ep_rank)) {
+            /* An en-passant capture, which removes the pawn behind the destination. */
+            Bitboard ep_bit = ((Bitboard) 1) << (to_sq - COLOUR_OFFSET(colour) * BOARDSIZE);
+
+            captured |= ep_bit;
+            occupied &= ~ep_bit;
+        }
+        return attackers_of(board, king_sq, OPPOSITE_COLOUR(colour), occupied, captured) != 0;
     }
-    return in_check;
 }
 
 /* possibles contains a list of possible moves of piece.
@@ -1051,30 +1107,17 @@ king_is_in_check(const Board *board, Colour king_colour)
  * This function should exclude all of those moves of this piece
  * which leave its own king in check.  
  * The list of remaining legal moves is returned as result.
- * This function operates by looking for at least one reply by the
- * opponent that could capture the king of the given colour.
- * Only one such move needs to be found to invalidate one of the
- * possible moves.
  */
 MovePair *
 exclude_checks(Piece piece, Colour colour, MovePair *possibles, const Board *board)
-{   /* As this function is not called recursively, it should be
-     * safe to retain a single copy of the board on the stack without risking
-     * overflow. This has been a problem in the past with the PC version.
-     */
-    Board copy_board;
+{
     MovePair *valid_move_list = NULL;
     MovePair *move;
 
-    /* For each possible move, make the move and see if it leaves the king
-     * in check.
-     */
     for (move = possibles; move != NULL;) {
-        /* Take a copy of the board before playing this next move. */
-        copy_board = *board;
-        make_move(UNKNOWN_MOVE, move->from_col, move->from_rank,
-                move->to_col, move->to_rank, piece, colour, &copy_board);
-        if (king_is_in_check(&copy_board, colour) != NOCHECK) {
+        if (leaves_king_in_check(piece, colour,
+                square_index(move->from_col, move->from_rank),
+                square_index(move->to_col, move->to_rank), board)) {
             MovePair *illegal_move = move;
             move = move->next;
             /* Free the illegal move. */
@@ -1100,26 +1143,18 @@ exclude_castling_across_checks(Col king_start_col, Col king_end_col,
         Colour colour, const Board *board)
 {
     Boolean Ok = TRUE;
-    MovePair *move = malloc_move();
     Rank rank = (colour == WHITE) ? FIRSTRANK : LASTRANK;
     int direction = king_end_col >= king_start_col ? 1 : -1;
     Col boundary = king_end_col + direction;
     Col to_col;
+    int from_sq = square_index(king_start_col, rank);
 
     /* Start where we are, because you can't castle out of check. */
     for (to_col = king_start_col; (to_col != boundary) && Ok; to_col += direction) {
-        move->from_col = king_start_col;
-        move->from_rank = rank;
-        move->to_col = to_col;
-        move->to_rank = rank;
-        move = exclude_checks(KING, colour, move, board);
-        if (move == NULL) {
+        if (leaves_king_in_check(KING, colour, from_sq, square_index(to_col, rank), board)) {
             Ok = FALSE;
         }
     }
-    if (move != NULL) {
-        free_move_pair(move);
-    }
     return Ok;
 }
 
@@ -1168,7 +1203,10 @@ exclude_moves(Piece piece, Colour colour, Col from_col, Rank from_rank,
         /* Everything is still possible. */
         move_list = possibles;
     }
-    if (move_list != NULL) {
+    /* A single candidate in a game of trusted moves must be legal,
+     * so only a choice between candidates requires checks to be excluded.
+     */
+    if (move_list != NULL && (!GlobalState.trusted_input || move_list->next != NULL)) {
         move_list = exclude_checks(piece, colour, move_list, board);
     }
     return move_list;
@@ -2041,447 +2079,291 @@ determine_move_details(Colour colour, Move *move_details, Board *board)
     return Ok;
 }
 
-/* Generate a list of moves of a king or knight from from_col,from_rank.
- * This does not include castling for the king, because it is used
- * by the code that looks for ways to escape from check for which
- * castling is illegal, of course.
+/* Add to moves the legal moves of piece of colour from from_sq to each
+ * of the squares in targets, with the given flag, while there are
+ * fewer than limit moves.
+ * A pawn move to the last rank is added once for each promoted piece.
+ * Return the new number of moves.
  */
-static MovePair *
-generate_single_moves(Colour colour, Piece piece,
-        const Board *board, Col from_col, Rank from_rank)
+static unsigned
+add_legal_moves(Piece piece, Colour colour, int from_sq, Bitboard targets, MoveFlag flag,
+        const Board *board, CompactMove *moves, unsigned num_moves, unsigned limit)
 {
-    int from_r = RankConvert(from_rank);
-    int from_c = ColConvert(from_col);
-    unsigned ix;
-    MovePair *moves = NULL;
-    Colour target_colour = OPPOSITE_COLOUR(colour);
-    unsigned num_directions = piece == KING ? NUM_KING_MOVES : NUM_KNIGHT_MOVES;
-    const int *Piece_moves = piece == KING ? King_moves : Knight_moves;
-
-    /* Pick up pairs of offsets from from_r,from_c to look for an
-     * EMPTY square, or one containing a piece of OPPOSITE_COLOUR(colour).
-     */
-    for (ix = 0; ix < 2 * num_directions; ix += 2) {
-        int r = Piece_moves[ix] + from_r;
-        int c = Piece_moves[ix + 1] + from_c;
-        Piece occupant = board->board[r][c];
-        Boolean Ok = FALSE;
-
-        if (occupant == OFF) {
-            /* Not a valid move. */
-        }
-        else if (board->board[r][c] == EMPTY) {
-            Ok = TRUE;
-        }
-        else if (EXTRACT_COLOUR(occupant) == target_colour) {
-            Ok = TRUE;
-        }
-        else {
-        }
-        if (Ok) {
-            /* Fill in the details, and add it to the list. */
-            moves = append_move_pair(from_col, from_rank, ToCol(c), ToRank(r), moves);
+    while (targets != 0 && num_moves < limit) {
+        int to_sq = lowest_square(targets);
+
+        if (!leaves_king_in_check(piece, colour, from_sq, to_sq, board)) {
+            int to_row = INDEX_ROW(to_sq);
+
+            if (piece == PAWN &&
+                    (to_row == RankConvert(FIRSTRANK) || to_row == RankConvert(LASTRANK))) {
+                for (MoveFlag promotion = QUEEN_PROMOTION;
+                        promotion >= KNIGHT_PROMOTION && num_moves < limit; promotion--) {
+                    moves[num_moves] = COMPACT_MOVE(from_sq, to_sq, promotion);
+                    num_moves++;
+                }
+            }
+            else {
+                moves[num_moves] = COMPACT_MOVE(from_sq, to_sq, flag);
+                num_moves++;
+            }
         }
+        targets &= targets - 1;
     }
-    if (moves != NULL) {
-        moves = exclude_checks(piece, colour, moves, board);
-    }
-    return moves;
+    return num_moves;
 }
 
-/* Generate a list of moves of a queen, rook or bishop from
- * from_col,from_rank.
+/* Fill moves with up to limit of the legal moves for colour on board,
+ * and return how many there are.
  */
-static MovePair *
-generate_multiple_moves(Colour colour, Piece piece,
-        const Board *board, Col from_col, Rank from_rank)
+static unsigned
+generate_moves(const Board *board, Colour colour, CompactMove *moves, unsigned limit)
 {
-    int from_r = RankConvert(from_rank);
-    int from_c = ColConvert(from_col);
-    unsigned ix;
-    MovePair *moves = NULL;
-    Colour target_colour = OPPOSITE_COLOUR(colour);
-    unsigned num_directions = piece == QUEEN ? NUM_QUEEN_MOVES :
-            piece == ROOK ? NUM_ROOK_MOVES : NUM_BISHOP_MOVES;
-    const int *Piece_moves = piece == QUEEN ? Queen_moves :
-            piece == ROOK ? Rook_moves : Bishop_moves;
-
-    /* Pick up pairs of offsets from from_r,from_c to look for an
-     * EMPTY square, or one containing a piece of OPPOSITE_COLOUR(colour).
-     */
-    for (ix = 0; ix < 2 * num_directions; ix += 2) {
-        int r = Piece_moves[ix] + from_r;
-        int c = Piece_moves[ix + 1] + from_c;
-        Piece occupant = board->board[r][c];
-
-        /* Include EMPTY squares as possible moves. */
-        while (occupant == EMPTY) {
-            /* Fill in the details, and add it to the list. */
-            moves = append_move_pair(from_col, from_rank, ToCol(c), ToRank(r), moves);
-            /* Move on to the next square in this direction. */
-            r += Piece_moves[ix];
-            c += Piece_moves[ix + 1];
-            occupant = board->board[r][c];
-        }
-        /* We have come up against an obstruction. */
-        if (occupant == OFF) {
-            /* Not a valid move. */
-        }
-        else if (EXTRACT_COLOUR(occupant) == target_colour) {
-            moves = append_move_pair(from_col, from_rank, ToCol(c), ToRank(r), moves);
-        }
-        else {
-            /* Should be a piece of our own colour. */
-        }
+    const Bitboard *pieces = board->pieces[colour];
+    Bitboard own = board->occupied[colour];
+    Bitboard opponents = board->occupied[OPPOSITE_COLOUR(colour)];
+    Bitboard occupied = own | opponents;
+    int offset = COLOUR_OFFSET(colour) * BOARDSIZE;
+    /* The row from which a pawn may advance two squares. */
+    int pawn_start_row = RankConvert(colour == WHITE ? FIRSTRANK + 1 : LASTRANK - 1);
+    unsigned num_moves = 0;
+    Bitboard squares;
+
+    /* The king first, as it is most likely to be able to escape from check. */
+    for (squares = pieces[KING]; squares != 0 && num_moves < limit; squares &= squares - 1) {
+        int sq = lowest_square(squares);
+
+        num_moves = add_legal_moves(KING, colour, sq, King_attacks[sq] & ~own,
+                ORDINARY_MOVE, board, moves, num_moves, limit);
     }
-    if (moves != NULL) {
-        moves = exclude_checks(piece, colour, moves, board);
+    for (squares = pieces[KNIGHT]; squares != 0 && num_moves < limit; squares &= squares - 1) {
+        int sq = lowest_square(squares);
+
+        num_moves = add_legal_moves(KNIGHT, colour, sq, Knight_attacks[sq] & ~own,
+                ORDINARY_MOVE, board, moves, num_moves, limit);
     }
-    return moves;
-}
+    for (squares = pieces[BISHOP]; squares != 0 && num_moves < limit; squares &= squares - 1) {
+        int sq = lowest_square(squares);
 
-/* Generate a list of moves of a pawn from from_col,from_rank. */
-static MovePair *
-generate_pawn_moves(Colour colour, const Board *board, Col from_col, Rank from_rank)
-{
-    MovePair *moves = NULL;
-    Piece piece = PAWN;
-    Colour target_colour = OPPOSITE_COLOUR(colour);
-    /* Determine the direction in which a pawn can move. */
-    int offset = colour == WHITE ? 1 : -1;
-    int to_r, to_c = ColConvert(from_col);
-    /* Reject ep attempts for the colour that has just moved. */
-    char valid_ep_rank = colour == WHITE ? '6' : '3';
-
-    /* Try single step ahead. */
-    to_r = RankConvert(from_rank) + offset;
-    if (board->board[to_r][to_c] == EMPTY) {
-        /* Fill in the details, and add it to the list. */
-        moves = append_move_pair(from_col, from_rank, ToCol(to_c), ToRank(to_r), moves);
-        if (((colour == WHITE) && (from_rank == FIRSTRANK + 1)) ||
-                ((colour == BLACK) && (from_rank == LASTRANK - 1))) {
-            /* Try two steps. */
-            to_r = RankConvert(from_rank) + 2 * offset;
-            if (board->board[to_r][to_c] == EMPTY) {
-                moves = append_move_pair(from_col, from_rank, ToCol(to_c), ToRank(to_r), moves);
-            }
-        }
-    }
-    /* Try to the left. */
-    to_r = RankConvert(from_rank + offset);
-    to_c = ColConvert(from_col - 1);
-    if (board->board[to_r][to_c] == OFF) {
-    }
-    else if (board->board[to_r][to_c] == EMPTY) {
-        if (board->EnPassant &&
-                board->ep_rank == valid_ep_rank &&
-                (ToRank(to_r) == board->ep_rank) && (ToCol(to_c) == board->ep_col)) {
-            moves = append_move_pair(from_col, from_rank, ToCol(to_c), ToRank(to_r), moves);
-        }
-    }
-    else if (EXTRACT_COLOUR(board->board[to_r][to_c]) == target_colour) {
-        moves = append_move_pair(from_col, from_rank, ToCol(to_c), ToRank(to_r), moves);
+        num_moves = add_legal_moves(BISHOP, colour, sq, bishop_attacks(sq, occupied) & ~own,
+                ORDINARY_MOVE, board, moves, num_moves, limit);
     }
-    else {
+    for (squares = pieces[ROOK]; squares != 0 && num_moves < limit; squares &= squares - 1) {
+        int sq = lowest_square(squares);
+
+        num_moves = add_legal_moves(ROOK, colour, sq, rook_attacks(sq, occupied) & ~own,
+                ORDINARY_MOVE, board, moves, num_moves, limit);
     }
+    for (squares = pieces[QUEEN]; squares != 0 && num_moves < limit; squares &= squares - 1) {
+        int sq = lowest_square(squares);
+        Bitboard targets = bishop_attacks(sq, occupied) | rook_attacks(sq, occupied);
 
-    /* Try to the right. */
-    to_r = RankConvert(from_rank) + offset;
-    to_c = ColConvert(from_col) + 1;
-    if (board->board[to_r][to_c] == OFF) {
+        num_moves = add_legal_moves(QUEEN, colour, sq, targets & ~own,
+                ORDINARY_MOVE, board, moves, num_moves, limit);
     }
-    else if (board->board[to_r][to_c] == EMPTY) {
-        if (board->EnPassant &&
-                board->ep_rank == valid_ep_rank &&
-                (ToRank(to_r) == board->ep_rank) && (ToCol(to_c) == board->ep_col)) {
-            moves = append_move_pair(from_col, from_rank, ToCol(to_c), ToRank(to_r), moves);
+    for (squares = pieces[PAWN]; squares != 0 && num_moves < limit; squares &= squares - 1) {
+        int sq = lowest_square(squares);
+        int ahead = sq + offset;
+
+        if (ahead < 0 || ahead >= NUM_SQUARES) {
+            /* A pawn on its last rank can not move. */
+            continue;
+        }
+        if ((occupied & (((Bitboard) 1) << ahead)) == 0) {
+            Bitboard targets = ((Bitboard) 1) << ahead;
+
+            if (INDEX_ROW(sq) == pawn_start_row &&
+                    (occupied & (((Bitboard) 1) << (ahead + offset))) == 0) {
+                targets |= ((Bitboard) 1) << (ahead + offset);
+            }
+            num_moves = add_legal_moves(PAWN, colour, sq, targets,
+                    ORDINARY_MOVE, board, moves, num_moves, limit);
+        }
+        num_moves = add_legal_moves(PAWN, colour, sq, Pawn_attacks[colour][sq] & opponents,
+                ORDINARY_MOVE, board, moves, num_moves, limit);
+        /* Reject ep attempts for the colour that has just moved. */
+        if (board->EnPassant && board->ep_rank == (colour == WHITE ? '6' : '3')) {
+            int ep_sq = square_index(board->ep_col, board->ep_rank);
+
+            if (ep_sq >= 0) {
+                num_moves = add_legal_moves(PAWN, colour, sq,
+                        Pawn_attacks[colour][sq] & (((Bitboard) 1) << ep_sq),
+                        EN_PASSANT_MOVE, board, moves, num_moves, limit);
+            }
         }
     }
-    else if (EXTRACT_COLOUR(board->board[to_r][to_c]) == target_colour) {
-        moves = append_move_pair(from_col, from_rank, ToCol(to_c), ToRank(to_r), moves);
-    }
-    else {
-    }
+    if (pieces[KING] != 0) {
+        Rank rank = colour == WHITE ? FIRSTRANK : LASTRANK;
+        int king_sq = king_square(board, colour);
 
-    if (moves != NULL) {
-        moves = exclude_checks(piece, colour, moves, board);
+        if (num_moves < limit && can_castle(KINGSIDE_CASTLE, colour, board)) {
+            moves[num_moves] = COMPACT_MOVE(king_sq, square_index('g', rank), KINGSIDE_CASTLING);
+            num_moves++;
+        }
+        if (num_moves < limit && can_castle(QUEENSIDE_CASTLE, colour, board)) {
+            moves[num_moves] = COMPACT_MOVE(king_sq, square_index('c', rank), QUEENSIDE_CASTLING);
+            num_moves++;
+        }
     }
-    return moves;
+    return num_moves;
 }
 
-/* See whether the king of the given colour is in checkmate.
- * Assuming that the king is in check, generate all possible moves
- * for colour on board until at least one saving move is found.
- * Excepted from this are the castling moves (not legal whilst in check)
- * and underpromotions (inadequate in thwarting a check).
+/* Return the squares strictly between from_sq and to_sq if they
+ * share a rank, file or diagonal, otherwise no squares.
  */
-Boolean
-king_is_in_checkmate(Colour colour, Board *board)
+static Bitboard
+squares_between(int from_sq, int to_sq)
 {
-    Rank rank;
-    Col col;
-    MovePair *moves = NULL;
-    Boolean in_checkmate = FALSE;
-
-    /* Search the board for pieces of the right colour.
-     * Keep going until we have exhausted all pieces, or until
-     * we have found a saving move.
-     */
-    for (rank = LASTRANK; (rank >= FIRSTRANK) && (moves == NULL); rank--) {
-        for (col = FIRSTCOL; (col <= LASTCOL) && (moves == NULL); col++) {
-            int r = RankConvert(rank);
-            int c = ColConvert(col);
-            Piece occupant = board->board[r][c];
+    Bitboard to_bit = ((Bitboard) 1) << to_sq;
 
-            if ((occupant != EMPTY) && (colour == EXTRACT_COLOUR(occupant))) {
-                /* This square is occupied by a piece of the required colour. */
-                Piece piece = EXTRACT_PIECE(occupant);
-
-                switch (piece) {
-                    case KING:
-                    case KNIGHT:
-                        moves = generate_single_moves(colour, piece, board, col, rank);
-                        break;
-                    case QUEEN:
-                    case ROOK:
-                    case BISHOP:
-                        moves = generate_multiple_moves(colour, piece, board, col, rank);
-                        break;
-                    case PAWN:
-                        moves = generate_pawn_moves(colour, board, col, rank);
-                        break;
-                    default:
-                        fprintf(GlobalState.logfile,
-                                "Internal error: unknown piece %d in king_is_in_checkmate().\n",
-                                piece);
-                }
-            }
+    for (Direction dir = NORTH; dir < NUM_DIRECTIONS; dir++) {
+        if ((Rays[dir][from_sq] & to_bit) != 0) {
+            return Rays[dir][from_sq] & ~Rays[dir][to_sq] & ~to_bit;
         }
     }
-    if (moves != NULL) {
-        /* No checkmate.  Free the move list. */
-        free_move_pair_list(moves);
-    }
-    else {
-        in_checkmate = TRUE;
-    }
-    return in_checkmate;
+    return 0;
 }
 
-#if INCLUDE_UNUSED_FUNCTIONS
+/* Return TRUE if piece of colour on from_sq has a legal move
+ * to at least one of the squares in targets.
+ */
+static Boolean
+has_legal_move_to(Piece piece, Colour colour, int from_sq, Bitboard targets,
+        const Board *board)
+{
+    for (; targets != 0; targets &= targets - 1) {
+        if (!leaves_king_in_check(piece, colour, from_sq, lowest_square(targets), board)) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
 
-/* Return an approximation of how many moves there are for
- * board->to_move on board.
- * This may be exact, but I haven't checked.
- * This is not currently used, but I found it useful at one
- * point for generating game statistics.
+/* Return TRUE if colour, whose king on king_sq is attacked by the
+ * pieces on the squares in checkers, has a legal move.
+ * The only candidates are king moves to squares that the opponent
+ * does not attack and, against a single checker, captures of it
+ * or interpositions on its line of attack.
  */
-static unsigned
-approx_how_many_moves(Board *board)
+static Boolean
+has_check_evasion(const Board *board, Colour colour, int king_sq, Bitboard checkers)
 {
-    Rank rank;
-    Col col;
-    Colour colour = board->to_move;
-    unsigned num_moves = 0;
+    Colour opponent = OPPOSITE_COLOUR(colour);
+    const Bitboard *pieces = board->pieces[colour];
+    Bitboard own = board->occupied[colour];
+    Bitboard occupied = own | board->occupied[opponent];
+    /* The king must not be able to hide behind itself from a sliding piece. */
+    Bitboard without_king = occupied & ~(((Bitboard) 1) << king_sq);
+    Bitboard targets;
+    Bitboard squares;
+    int offset = COLOUR_OFFSET(colour) * BOARDSIZE;
+    int pawn_start_row = RankConvert(colour == WHITE ? FIRSTRANK + 1 : LASTRANK - 1);
+
+    for (squares = King_attacks[king_sq] & ~own; squares != 0; squares &= squares - 1) {
+        int sq = lowest_square(squares);
+
+        if (attackers_of(board, sq, opponent, without_king, ((Bitboard) 1) << sq) == 0) {
+            return TRUE;
+        }
+    }
+    if ((checkers & (checkers - 1)) != 0) {
+        /* Only the king can escape a double check. */
+        return FALSE;
+    }
+    targets = checkers | squares_between(king_sq, lowest_square(checkers));
 
-    /* Search the board for pieces of the right colour.
-     * Keep going until we have exhausted all pieces, or until
-     * we have found a saving move.
-     */
-    for (rank = LASTRANK; rank >= FIRSTRANK; rank--) {
-        for (col = FIRSTCOL; col <= LASTCOL; col++) {
-            int r = RankConvert(rank);
-            int c = ColConvert(col);
-            Piece occupant = board->board[r][c];
-            MovePair *moves = NULL;
+    for (squares = pieces[KNIGHT]; squares != 0; squares &= squares - 1) {
+        int sq = lowest_square(squares);
+
+        if (has_legal_move_to(KNIGHT, colour, sq, Knight_attacks[sq] & targets, board)) {
+            return TRUE;
+        }
+    }
+    for (squares = pieces[BISHOP]; squares != 0; squares &= squares - 1) {
+        int sq = lowest_square(squares);
 
-            if ((occupant != EMPTY) && (colour == EXTRACT_COLOUR(occupant))) {
-                /* This square is occupied by a piece of the required colour. */
-                Piece piece = EXTRACT_PIECE(occupant);
+        if (has_legal_move_to(BISHOP, colour, sq, bishop_attacks(sq, occupied) & targets, board)) {
+            return TRUE;
+        }
+    }
+    for (squares = pieces[ROOK]; squares != 0; squares &= squares - 1) {
+        int sq = lowest_square(squares);
 
-                switch (piece) {
-                    case KING:
-                    case KNIGHT:
-                        moves = generate_single_moves(colour, piece, board, col, rank);
-                        break;
-                    case QUEEN:
-                    case ROOK:
-                    case BISHOP:
-                        moves = generate_multiple_moves(colour, piece, board, col, rank);
-                        break;
-                    case PAWN:
-                        moves = generate_pawn_moves(colour, board, col, rank);
-                        break;
-                    default:
-                        fprintf(GlobalState.logfile,
-                                "Internal error: unknown piece %d in king_is_in_checkmate().\n",
-                                piece);
-                }
-                if (moves != NULL) {
-                    /* At least one move. */
-                    MovePair *m;
-                    for (m = moves; m != NULL; m = m->next) {
-                        num_moves++;
-                    }
-                    /* Free the move list. */
-                    free_move_pair_list(moves);
-                }
-            }
+        if (has_legal_move_to(ROOK, colour, sq, rook_attacks(sq, occupied) & targets, board)) {
+            return TRUE;
         }
     }
-    return num_moves;
-}
-#endif
+    for (squares = pieces[QUEEN]; squares != 0; squares &= squares - 1) {
+        int sq = lowest_square(squares);
+        Bitboard moves = bishop_attacks(sq, occupied) | rook_attacks(sq, occupied);
 
-/* Find all moves for on the given board for colour. */
-MovePair *
-find_all_moves(const Board *board, Colour colour)
-{
-    Rank rank;
-    Col col;
-    /* All moves for colour. */
-    MovePair *all_moves = NULL;
-
-    /* Pick up each piece of the required colour. */
-    for (rank = LASTRANK; rank >= FIRSTRANK; rank--) {
-        int r = RankConvert(rank);
-        for (col = FIRSTCOL; col <= LASTCOL; col++) {
-            int c = ColConvert(col);
-            Piece occupant = board->board[r][c];
+        if (has_legal_move_to(QUEEN, colour, sq, moves & targets, board)) {
+            return TRUE;
+        }
+    }
+    for (squares = pieces[PAWN]; squares != 0; squares &= squares - 1) {
+        int sq = lowest_square(squares);
+        int ahead = sq + offset;
+        Bitboard moves = Pawn_attacks[colour][sq] & checkers;
 
-            if ((occupant != EMPTY) && (colour == EXTRACT_COLOUR(occupant))) {
-                /* This square is occupied by a piece of the required colour. */
-                Piece piece = EXTRACT_PIECE(occupant);
-                /* List of moves for this piece. */
-                MovePair *moves = NULL;
-
-                switch (piece) {
-                    case KING:
-                        moves = generate_single_moves(colour, piece, board, col, rank);
-                        /* Add any castling, as this is not covered
-                         * by GenerateSingleMoves.
-                         */
-                        if (can_castle(KINGSIDE_CASTLE, colour, board)) {
-                            MovePair *m = (MovePair *)
-                                    malloc_or_die(sizeof (MovePair));
-                            m->from_col = find_castling_king_col(colour, board);
-                            m->from_rank = rank;
-                            m->to_col = 'g';
-                            m->to_rank = rank;
-                            /* Prepend. */
-                            m->next = moves;
-                            moves = m;
-                        }
-                        if (can_castle(QUEENSIDE_CASTLE, colour, board)) {
-                            MovePair *m = (MovePair *)
-                                    malloc_or_die(sizeof (MovePair));
-                            m->from_col = find_castling_king_col(colour, board);
-                            m->from_rank = rank;
-                            m->to_col = 'c';
-                            m->to_rank = rank;
-                            /* Prepend. */
-                            m->next = moves;
-                            moves = m;
-                        }
-                        break;
-                    case KNIGHT:
-                        moves = generate_single_moves(colour, piece, board, col, rank);
-                        break;
-                    case QUEEN:
-                    case ROOK:
-                    case BISHOP:
-                        moves = generate_multiple_moves(colour, piece, board, col, rank);
-                        break;
-                    case PAWN:
-                        moves = generate_pawn_moves(colour, board, col, rank);
-                        break;
-                    default:
-                        fprintf(GlobalState.logfile,
-                                "Internal error: unknown piece %d in king_is_in_checkmate().\n",
-                                piece);
-                }
-                if (moves != NULL) {
-                    /* At least one move.
-                     * Append what we have so far to this list.
-                     * Find the last one.
-                     */
-                    MovePair *m;
-                    for (m = moves; m->next != NULL; m = m->next) {
-                    }
-                    m->next = all_moves;
-                    all_moves = moves;
-                }
+        if (ahead < 0 || ahead >= NUM_SQUARES) {
+            /* A pawn on its last rank can not move. */
+            continue;
+        }
+        if ((occupied & (((Bitboard) 1) << ahead)) == 0) {
+            moves |= (((Bitboard) 1) << ahead) & targets;
+            if (INDEX_ROW(sq) == pawn_start_row &&
+                    (occupied & (((Bitboard) 1) << (ahead + offset))) == 0) {
+                moves |= (((Bitboard) 1) << (ahead + offset)) & targets;
+            }
+        }
+        if (board->EnPassant && board->ep_rank == (colour == WHITE ? '6' : '3')) {
+            /* An en-passant capture might remove the checker or block the check. */
+            int ep_sq = square_index(board->ep_col, board->ep_rank);
+
+            if (ep_sq >= 0) {
+                moves |= Pawn_attacks[colour][sq] & (((Bitboard) 1) << ep_sq);
             }
         }
+        if (has_legal_move_to(PAWN, colour, sq, moves, board)) {
+            return TRUE;
+        }
     }
-    return all_moves;
+    return FALSE;
+}
+
+/* Fill moves with all of the legal moves for colour on board,
+ * and return how many there are.
+ */
+unsigned
+generate_legal_moves(const Board *board, Colour colour, CompactMove moves[MAX_MOVES])
+{
+    return generate_moves(board, colour, moves, MAX_MOVES);
+}
+
+/* See whether the king of the given colour is in checkmate.
+ * Assuming that the king is in check, look for at least one saving move.
+ */
+Boolean
+king_is_in_checkmate(Colour colour, Board *board)
+{
+    return !at_least_one_move(board, colour);
 }
 
 /* Return TRUE if there is at least one move on the given board for colour. */
 Boolean
 at_least_one_move(const Board *board, Colour colour)
 {
-    Boolean move_found = FALSE;
-
-    /* Pick up each piece of the required colour. */
-    for (Rank rank = LASTRANK; rank >= FIRSTRANK && !move_found; rank--) {
-        int r = RankConvert(rank);
-        for (Col col = FIRSTCOL; col <= LASTCOL && !move_found; col++) {
-            Piece occupant = board->board[r][ColConvert(col)];
-
-            if ((occupant != EMPTY) && (colour == EXTRACT_COLOUR(occupant))) {
-                /* This square is occupied by a piece of the required colour. */
-                Piece piece = EXTRACT_PIECE(occupant);
-                MovePair *moves = NULL;
-
-                switch (piece) {
-                    case KING:
-                        moves = generate_single_moves(colour, piece, board, col, rank);
-                        if (moves != NULL) {
-                            move_found = TRUE;
-                            free_move_pair_list(moves);
-                        }
-                            /* Add any castling, as this is not covered
-                             * by GenerateSingleMoves.
-                             */
-                        else if (can_castle(KINGSIDE_CASTLE, colour, board)) {
-                            move_found = TRUE;
-                        }
-                        else if (can_castle(QUEENSIDE_CASTLE, colour, board)) {
-                            move_found = TRUE;
-                        }
-                        break;
-                    case KNIGHT:
-                        moves = generate_single_moves(colour, piece, board, col, rank);
-                        if (moves != NULL) {
-                            move_found = TRUE;
-                            free_move_pair_list(moves);
-                        }
-                        break;
-                    case QUEEN:
-                    case ROOK:
-                    case BISHOP:
-                        moves = generate_multiple_moves(colour, piece, board, col, rank);
-                        if (moves != NULL) {
-                            move_found = TRUE;
-                            free_move_pair_list(moves);
-                        }
-                        break;
-                    case PAWN:
-                        moves = generate_pawn_moves(colour, board, col, rank);
-                        if (moves != NULL) {
-                            move_found = TRUE;
-                            free_move_pair_list(moves);
-                        }
-                        break;
-                    default:
-                        fprintf(GlobalState.logfile,
-                                "Internal error: unknown piece %d in king_is_in_checkmate().\n",
-                                piece);
-                }
-            }
+    int king_sq = king_square(board, colour);
+    CompactMove move;
+
+    if (king_sq >= 0 && (board->pieces[colour][KING] & (((Bitboard) 1) << king_sq)) != 0) {
+        Bitboard occupied = board->occupied[WHITE] | board->occupied[BLACK];
+        Bitboard checkers = attackers_of(board, king_sq, OPPOSITE_COLOUR(colour), occupied, 0);
+
+        if (checkers != 0) {
+            return has_check_evasion(board, colour, king_sq, checkers);
         }
     }
-    return move_found;
+    return generate_moves(board, colour, &move, 1) != 0;
 }
-
@@ -23,10 +23,17 @@
 #define MAP_H
 
 void init_hashtab(void);
+void init_bitboards(void);
+void set_bitboards(Board *board);
 Boolean determine_move_details(Colour colour,Move *move_details, Board *board);
 HashCode hash_lookup(Col col, Rank rank, Piece piece, Colour colour);
 void make_move(MoveClass class, Col from_col, Rank from_rank, Col to_col, Rank to_rank,
                 Piece piece, Colour colour,Board *board);
+void make_null_move(Colour colour, Board *board);
+void make_compact_move(CompactMove move, Board *board);
+void begin_undo_record(MoveUndo *undo, const Board *board);
+void end_undo_record(void);
+void unmake_move(const MoveUndo *undo, Board *board);
 CheckStatus king_is_in_check(const Board *board,Colour king_colour);
 MovePair *find_pawn_moves(Col from_col, Rank from_rank, Col to_col,Rank to_rank,
                 Colour colour, const Board *board);
@@ -41,7 +48,7 @@ void free_move_pair_list(MovePair *move_list);
 Boolean king_is_in_checkmate(Colour colour,Board *board);
 Col find_castling_king_col(Colour colour, const Board *board);
 Col find_castling_rook_col(Colour colour, const Board *board, MoveClass castling);
-MovePair *find_all_moves(const Board *board, Colour colour);
+unsigned generate_legal_moves(const Board *board, Colour colour, CompactMove moves[MAX_MOVES]);
 Boolean at_least_one_move(const Board *board, Colour colour);
 
 #endif	// MAP_H
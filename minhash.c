@@ -0,0 +1,382 @@
+/*
+ *  This file is part of pgn-extract: a Portable Game Notation (PGN) extractor.
+ *  Copyright (C) 1994-2026 David J. Barnes
+ *
+ *  pgn-extract is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  pgn-extract is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with pgn-extract. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  David J. Barnes may be contacted as d.j.barnes@kent.ac.uk
+ *  https://www.cs.kent.ac.uk/people/staff/djb/
+ */
+
+/* Detect games that are near duplicates of earlier ones
+ * (--nearduplicates).
+ *
+ * Each game is summarised by a MinHash signature of the set of
+ * positions reached in it: for each of SIGNATURE_LENGTH different
+ * hash functions, the minimum value over the game's positions.
+ * The proportion of values on which the signatures of two games
+ * agree estimates the Jaccard similarity of their sets of positions,
+ * i.e., the number of positions they share as a proportion of the
+ * number of positions reached in either.
+ * This is unaffected by transpositions, and degrades gradually with
+ * truncation, extra moves and small differences.
+ *
+ * To avoid comparing each game with every earlier one, the
+ * signatures of the original games are indexed by locality-sensitive
+ * hashing: the signature is divided into bands of rows_per_band values,
+ * and only games that agree on every value of at least one band are
+ * compared. The number of rows in a band is chosen from the similarity
+ * required, so that games that are similar enough are very likely
+ * to agree on at least one band.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "bool.h"
+#include "mymalloc.h"
+#include "defs.h"
+#include "typedef.h"
+#include "tokens.h"
+#include "taglist.h"
+#include "lex.h"
+#include "minhash.h"
+
+/* The number of values in a signature.
+ * This must be a power of two.
+ */
+#define SIGNATURE_LENGTH 32
+/* The probability with which games of exactly the required similarity
+ * should agree on at least one band.
+ */
+#define CANDIDATE_PERCENTAGE 95
+/* The initial number of signatures of original games stored. */
+#define INITIAL_STORED_SIGNATURES 1024
+/* The initial number of slots in BandTable.
+ * This must be a power of two.
+ */
+#define INITIAL_BAND_TABLE_SIZE (1 << 14)
+
+struct MinHashSignature {
+    uint32_t values[SIGNATURE_LENGTH];
+};
+
+/* The odd multiplier defining each of the hash functions
+ * of a signature.
+ */
+static uint64_t multipliers[SIGNATURE_LENGTH];
+static Boolean multipliers_set = FALSE;
+
+/* The number of values in each band of a signature.
+ * 0 => not yet chosen.
+ */
+static unsigned rows_per_band = 0;
+
+/* The signatures of the original games, in the order in which they
+ * were met, and the file list index of the file each was found in.
+ * A signature is identified by its number: its index plus one.
+ */
+static MinHashSignature *stored_signatures = NULL;
+static unsigned *stored_file_numbers = NULL;
+static unsigned long num_stored_signatures = 0;
+static unsigned long stored_signatures_size = 0;
+
+/* An entry in BandTable, recording that the stored signature with
+ * the given number has a band with the given key.
+ */
+typedef struct {
+    uint32_t key;
+    /* The number of the signature.
+     * 0 => the slot is not in use.
+     */
+    uint32_t signature_number;
+} BandEntry;
+
+/* An open-addressed table of the bands of the stored signatures.
+ * All the entries with the same key are found by probing from the
+ * slot for the key to the next empty slot.
+ */
+static BandEntry *BandTable = NULL;
+static size_t band_table_size = 0;
+static size_t band_table_entries = 0;
+
+/* Set the multipliers of the hash functions of a signature
+ * from a fixed sequence of pseudo-random numbers, so that
+ * results are repeatable.
+ */
+static void
+set_multipliers(void)
+{
+    uint64_t state = 0x2545F4914F6CDD1DULL;
+    unsigned i;
+
+    for (i = 0; i < SIGNATURE_LENGTH; i++) {
+        uint64_t z;
+
+        state += 0x9E3779B97F4A7C15ULL;
+        z = state;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        multipliers[i] = (z ^ (z >> 31)) | 1;
+    }
+    multipliers_set = TRUE;
+}
+
+/* Return the percentage probability that two games with the given
+ * percentage similarity agree on at least one band,
+ * if a band has the given number of rows.
+ */
+static unsigned
+candidate_percentage(unsigned similarity, unsigned rows)
+{
+    double agree_on_band = 1.0, disagree_on_all = 1.0;
+    unsigned i;
+
+    for (i = 0; i < rows; i++) {
+        agree_on_band *= similarity / 100.0;
+    }
+    for (i = 0; i < SIGNATURE_LENGTH / rows; i++) {
+        disagree_on_all *= 1.0 - agree_on_band;
+    }
+    return (unsigned) (100.0 * (1.0 - disagree_on_all));
+}
+
+/* Choose the largest number of rows per band for which games
+ * of the required similarity are likely to be compared.
+ * Fewer rows mean more games are compared.
+ */
+static void
+choose_rows_per_band(void)
+{
+    rows_per_band = SIGNATURE_LENGTH;
+    while (rows_per_band > 1 &&
+            candidate_percentage(GlobalState.near_duplicate_similarity,
+                                 rows_per_band) < CANDIDATE_PERCENTAGE) {
+        rows_per_band /= 2;
+    }
+}
+
+/*
+ * Add a position with the given hash_value to signature.
+ */
+void
+add_to_minhash_signature(MinHashSignature *signature, HashCode hash_value)
+{
+    unsigned i;
+
+    for (i = 0; i < SIGNATURE_LENGTH; i++) {
+        uint32_t value = (uint32_t) ((hash_value * multipliers[i]) >> 32);
+
+        if (value < signature->values[i]) {
+            signature->values[i] = value;
+        }
+    }
+}
+
+/*
+ * Free a signature.
+ */
+void
+free_minhash_signature(MinHashSignature *signature)
+{
+    (void) free((void *) signature);
+}
+
+/*
+ * Create a new signature, containing the position on board.
+ */
+MinHashSignature *
+new_minhash_signature(const Board *board)
+{
+    MinHashSignature *signature =
+            (MinHashSignature *) malloc_or_die(sizeof (*signature));
+    unsigned i;
+
+    if (!multipliers_set) {
+        set_multipliers();
+    }
+    for (i = 0; i < SIGNATURE_LENGTH; i++) {
+        signature->values[i] = UINT32_MAX;
+    }
+    add_to_minhash_signature(signature, board->zobrist);
+    return signature;
+}
+
+/* Return the number of bands in a signature. */
+static unsigned
+num_bands(void)
+{
+    return SIGNATURE_LENGTH / rows_per_band;
+}
+
+/* Return the key of the given band of signature. */
+static uint32_t
+band_key(const MinHashSignature *signature, unsigned band)
+{
+    const uint32_t *values = &signature->values[band * rows_per_band];
+    uint64_t key = band + 1;
+    unsigned row;
+
+    for (row = 0; row < rows_per_band; row++) {
+        key = (key ^ values[row]) * 0x9E3779B97F4A7C15ULL;
+        key ^= key >> 32;
+    }
+    return (uint32_t) key;
+}
+
+/* Return the slot in BandTable at which to start looking
+ * for an entry with the given key.
+ */
+static size_t
+band_table_slot(uint32_t key)
+{
+    return (size_t) (key & (band_table_size - 1));
+}
+
+/* Allocate a BandTable of the given size, none of whose slots
+ * are in use.
+ */
+static BandEntry *
+allocate_band_table(size_t size)
+{
+    BandEntry *table = (BandEntry *) malloc_or_die(size * sizeof (*table));
+    size_t i;
+
+    for (i = 0; i < size; i++) {
+        table[i].signature_number = 0;
+    }
+    return table;
+}
+
+/* Add an entry to BandTable, doubling its size first if it is
+ * three-quarters full.
+ */
+static void
+add_band_entry(uint32_t key, uint32_t signature_number)
+{
+    size_t ix;
+
+    if (BandTable == NULL) {
+        band_table_size = INITIAL_BAND_TABLE_SIZE;
+        BandTable = allocate_band_table(band_table_size);
+    }
+    else if ((band_table_entries + 1) * 4 > band_table_size * 3) {
+        BandEntry *old_table = BandTable;
+        size_t old_size = band_table_size;
+
+        band_table_size *= 2;
+        BandTable = allocate_band_table(band_table_size);
+        for (ix = 0; ix < old_size; ix++) {
+            if (old_table[ix].signature_number != 0) {
+                size_t slot = band_table_slot(old_table[ix].key);
+
+                while (BandTable[slot].signature_number != 0) {
+                    slot = (slot + 1) & (band_table_size - 1);
+                }
+                BandTable[slot] = old_table[ix];
+            }
+        }
+        (void) free((void *) old_table);
+    }
+    ix = band_table_slot(key);
+    while (BandTable[ix].signature_number != 0) {
+        ix = (ix + 1) & (band_table_size - 1);
+    }
+    BandTable[ix].key = key;
+    BandTable[ix].signature_number = signature_number;
+    band_table_entries++;
+}
+
+/* Store the signature of an original game found in the file with
+ * the given file list index.
+ */
+static void
+store_signature(const MinHashSignature *signature, unsigned file_number)
+{
+    unsigned band;
+
+    if (num_stored_signatures == stored_signatures_size) {
+        stored_signatures_size = stored_signatures_size == 0 ?
+                INITIAL_STORED_SIGNATURES : 2 * stored_signatures_size;
+        stored_signatures = (MinHashSignature *) realloc_or_die((void *) stored_signatures,
+                stored_signatures_size * sizeof (*stored_signatures));
+        stored_file_numbers = (unsigned *) realloc_or_die((void *) stored_file_numbers,
+                stored_signatures_size * sizeof (*stored_file_numbers));
+    }
+    stored_signatures[num_stored_signatures] = *signature;
+    stored_file_numbers[num_stored_signatures] = file_number;
+    num_stored_signatures++;
+    for (band = 0; band < num_bands(); band++) {
+        add_band_entry(band_key(signature, band), (uint32_t) num_stored_signatures);
+    }
+}
+
+/* Return TRUE if the two signatures agree on enough of their values
+ * for the games to be near duplicates.
+ */
+static Boolean
+similar_signatures(const MinHashSignature *s1, const MinHashSignature *s2)
+{
+    unsigned agreements = 0;
+    unsigned i;
+
+    for (i = 0; i < SIGNATURE_LENGTH; i++) {
+        if (s1->values[i] == s2->values[i]) {
+            agreements++;
+        }
+    }
+    return agreements * 100 >= GlobalState.near_duplicate_similarity * SIGNATURE_LENGTH;
+}
+
+/*
+ * Return the name of the file in which a near duplicate of the
+ * given game was first found, or NULL if there is none.
+ * In the latter case, the game is remembered as an original.
+ */
+const char *
+previous_near_occurance(const Game *game_details)
+{
+    const MinHashSignature *signature = game_details->near_duplicate_signature;
+    unsigned band;
+
+    if (signature == NULL) {
+        return NULL;
+    }
+    if (rows_per_band == 0) {
+        choose_rows_per_band();
+    }
+    if (BandTable != NULL) {
+        for (band = 0; band < num_bands(); band++) {
+            uint32_t key = band_key(signature, band);
+            size_t ix = band_table_slot(key);
+
+            while (BandTable[ix].signature_number != 0) {
+                if (BandTable[ix].key == key) {
+                    unsigned long original = BandTable[ix].signature_number - 1;
+
+                    if (similar_signatures(signature, &stored_signatures[original])) {
+                        const char *original_filename =
+                                input_file_name(stored_file_numbers[original]);
+
+                        /* Without a filename, suppressing duplicates on stdin does not work. */
+                        return original_filename != NULL ? original_filename : "_stdin_";
+                    }
+                }
+                ix = (ix + 1) & (band_table_size - 1);
+            }
+        }
+    }
+    store_signature(signature, current_file_number());
+    return NULL;
+}
@@ -0,0 +1,40 @@
+/*
+ *  This file is part of pgn-extract: a Portable Game Notation (PGN) extractor.
+ *  Copyright (C) 1994-2026 David J. Barnes
+ *
+ *  pgn-extract is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  pgn-extract is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with pgn-extract. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  David J. Barnes may be contacted as d.j.barnes@kent.ac.uk
+ *  https://www.cs.kent.ac.uk/people/staff/djb/
+ */
+
+        /* Detect near duplicates from MinHash signatures of the
+         * positions of games (--nearduplicates).
+         */
+#ifndef MINHASH_H
+#define MINHASH_H
+
+/*
+ * The MinHash signature of the positions reached in a game.
+ * The details are private to minhash.c.
+ */
+typedef struct MinHashSignature MinHashSignature;
+
+void add_to_minhash_signature(MinHashSignature *signature, HashCode hash_value);
+void free_minhash_signature(MinHashSignature *signature);
+MinHashSignature *new_minhash_signature(const Board *board);
+const char *previous_near_occurance(const Game *game_details);
+
+#endif	// MINHASH_H
+
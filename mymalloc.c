@@ -21,9 +21,46 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include "mymalloc.h"
 
+/* The per-game arena.
+ * While it is open, the nodes of a game's moves, variations, comments
+ * and NAGs are taken from it by game_malloc_or_die rather than being
+ * allocated individually. game_free leaves such nodes in place and
+ * they are all released together by reset_game_arena once
+ * the game has been dealt with.
+ * The arena is a list of blocks, most recent first, each twice the
+ * size of its predecessor.
+ */
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    /* The number of bytes of space following the header,
+     * and how many of them have been allocated.
+     */
+    size_t size, used;
+} ArenaBlock;
+
+/* A type whose size is a suitable alignment for anything
+ * allocated from the arena.
+ */
+typedef union {
+    long double ld;
+    long long ll;
+    void *p;
+    void (*fp)(void);
+} ArenaAlignment;
+
+#define ARENA_ALIGNMENT (sizeof(ArenaAlignment))
+#define ARENA_ROUND_UP(nbytes) \
+        (((nbytes) + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT * ARENA_ALIGNMENT)
+#define ARENA_HEADER_SIZE ARENA_ROUND_UP(sizeof(ArenaBlock))
+#define MIN_ARENA_BLOCK_SIZE (64 * 1024)
+
+static ArenaBlock *arena = NULL;
+static int arena_open = 0;
+
 /* Allocate the required space or abort the program. */
 void *
 malloc_or_die(size_t nbytes)
@@ -69,3 +106,83 @@ copy_string(const char *str)
     }
     return result;
 }
+
+/* Allocations made by game_malloc_or_die are to come from the arena. */
+void
+open_game_arena(void)
+{
+    arena_open = 1;
+}
+
+/* Allocations made by game_malloc_or_die are to come from the heap.
+ * Anything already allocated from the arena remains valid.
+ */
+void
+close_game_arena(void)
+{
+    arena_open = 0;
+}
+
+/* Allocate space for part of a game, from the arena if it is open. */
+void *
+game_malloc_or_die(size_t nbytes)
+{
+    void *result;
+
+    if (!arena_open) {
+        return malloc_or_die(nbytes);
+    }
+    nbytes = ARENA_ROUND_UP(nbytes);
+    if (arena == NULL || arena->size - arena->used < nbytes) {
+        size_t size = arena == NULL ? MIN_ARENA_BLOCK_SIZE : 2 * arena->size;
+        ArenaBlock *block;
+
+        while (size < nbytes) {
+            size *= 2;
+        }
+        block = (ArenaBlock *) malloc_or_die(ARENA_HEADER_SIZE + size);
+        block->next = arena;
+        block->size = size;
+        block->used = 0;
+        arena = block;
+    }
+    result = (char *) arena + ARENA_HEADER_SIZE + arena->used;
+    arena->used += nbytes;
+    return result;
+}
+
+/* Free space allocated by game_malloc_or_die, unless it belongs to
+ * the arena, in which case it is left for reset_game_arena.
+ */
+void
+game_free(void *space)
+{
+    ArenaBlock *block;
+
+    for (block = arena; block != NULL; block = block->next) {
+        uintptr_t start = (uintptr_t) block + ARENA_HEADER_SIZE;
+        if ((uintptr_t) space >= start && (uintptr_t) space < start + block->size) {
+            return;
+        }
+    }
+    free(space);
+}
+
+/* Release everything allocated from the arena.
+ * Only the most recent, and largest, block is retained for reuse.
+ */
+void
+reset_game_arena(void)
+{
+    if (arena != NULL) {
+        ArenaBlock *block = arena->next;
+
+        while (block != NULL) {
+            ArenaBlock *next = block->next;
+            free((void *) block);
+            block = next;
+        }
+        arena->next = NULL;
+        arena->used = 0;
+    }
+}
@@ -25,6 +25,11 @@
 char *copy_string(const char *str);
 void *malloc_or_die(size_t nbytes);
 void *realloc_or_die(void *space,size_t nbytes);
+void close_game_arena(void);
+void game_free(void *space);
+void *game_malloc_or_die(size_t nbytes);
+void open_game_arena(void);
+void reset_game_arena(void);
 
 #endif	// MYMALLOC_H
 
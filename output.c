@@ -1862,7 +1862,7 @@ static CommentList *create_line_number_comment(const Game *game)
 	exit(1);
     }
     StringList *current_comment = save_string_list_item(NULL, line_number_comment);
-    CommentList *comment = (CommentList*) malloc_or_die(sizeof (*comment));
+    CommentList *comment = (CommentList*) game_malloc_or_die(sizeof (*comment));
 
     comment->comment = current_comment;
     comment->next = NULL;
@@ -0,0 +1,509 @@
+/*
+ *  This file is part of pgn-extract: a Portable Game Notation (PGN) extractor.
+ *  Copyright (C) 1994-2026 David J. Barnes
+ *
+ *  pgn-extract is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  pgn-extract is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with pgn-extract. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  David J. Barnes may be contacted as d.j.barnes@kent.ac.uk
+ *  https://www.cs.kent.ac.uk/people/staff/djb/
+ */
+
+/* Process the input files in parallel, where the other options
+ * in use allow this (--threads).
+ *
+ * Each input file, or section of a large file (--splitsize), is
+ * dealt with by a separate worker process, forked once the ECO file
+ * (if any) and any check files have been read, so that each has its
+ * own copy of the lexical analyser, board and hash tables.
+ * A worker checks each of its games against the selection criteria,
+ * and writes a GameRecord of the outcome, along with the game's output
+ * text, to a temporary file. Anything written to the log goes to a
+ * second temporary file.
+ *
+ * The parent merges the workers' records strictly in the order
+ * of the input, so that the output is the same as it would be if
+ * the files were processed one at a time. Duplicate detection and
+ * the counting of games processed and matched are carried out by
+ * the parent during the merge, so they cover all of the input, and
+ * options such as --firstgame and --selectonly work as usual.
+ */
+
+#if defined(__unix__) || defined(__linux__) || defined(__APPLE__)
+#define PARALLEL_INPUT
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef PARALLEL_INPUT
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+#include "bool.h"
+#include "mymalloc.h"
+#include "defs.h"
+#include "typedef.h"
+#include "tokens.h"
+#include "taglist.h"
+#include "lex.h"
+#include "grammar.h"
+#include "parallel.h"
+
+/* The file to which a worker writes its GameRecords.
+ * NULL if this is not a worker.
+ */
+static FILE *worker_record_file = NULL;
+/* Where the record currently being written starts in worker_record_file. */
+static long record_start = 0;
+/* How much had been written to the log when the current record was begun. */
+static long record_log_start = 0;
+
+/* Return TRUE if this process is a worker. */
+Boolean
+is_parallel_worker(void)
+{
+    return worker_record_file != NULL;
+}
+
+/* Start a new record of a game in the worker's record file, once
+ * the game has been parsed, and return the file so that the game's
+ * text can be written after it.
+ */
+FILE *
+begin_game_record(void)
+{
+    GameRecord placeholder;
+
+    memset((void *) &placeholder, 0, sizeof(placeholder));
+    record_log_start = worker_log_position();
+    record_start = ftell(worker_record_file);
+    (void) fwrite((void *) &placeholder, sizeof(placeholder), 1, worker_record_file);
+    return worker_record_file;
+}
+
+/* Complete the record started by begin_game_record, once
+ * the text of the game has been written.
+ */
+void
+end_game_record(GameRecord *record)
+{
+    long end = ftell(worker_record_file);
+
+    record->parsed_log_offset = record_log_start;
+    record->log_offset = worker_log_position();
+    if (fseek(worker_record_file, record_start, SEEK_SET) != 0 ||
+            fwrite((void *) record, sizeof(*record), 1, worker_record_file) != 1 ||
+            fseek(worker_record_file, end, SEEK_SET) != 0) {
+        fprintf(GlobalState.logfile, "Unable to write a game record.\n");
+        exit(1);
+    }
+}
+
+/* Return the current position in the worker's log. */
+long
+worker_log_position(void)
+{
+    fflush(GlobalState.logfile);
+    return ftell(GlobalState.logfile);
+}
+
+/* Move whatever has been written to the worker's log since start
+ * to the end of the record file, and return its length.
+ * This keeps messages that arise from formatting a game out of
+ * the log unless the parent chooses to output the game.
+ */
+long
+move_worker_log(long start)
+{
+    long end = worker_log_position();
+
+    if (end > start) {
+        copy_record_text(GlobalState.logfile, start, end - start, worker_record_file);
+        if (fseek(GlobalState.logfile, start, SEEK_SET) != 0 ||
+                ftruncate(fileno(GlobalState.logfile), (off_t) start) != 0) {
+            fprintf(stderr, "Unable to rewind the log of a worker.\n");
+            exit(1);
+        }
+        return end - start;
+    }
+    else {
+        return 0;
+    }
+}
+
+/* Copy length bytes, starting at offset in record_file, to outfp. */
+void
+copy_record_text(FILE *record_file, long offset, long length, FILE *outfp)
+{
+    char buffer[BUFSIZ];
+
+    if (fseek(record_file, offset, SEEK_SET) != 0) {
+        fprintf(GlobalState.logfile, "Unable to read a game record.\n");
+        exit(1);
+    }
+    while (length > 0) {
+        size_t wanted = length < (long) sizeof(buffer) ? (size_t) length : sizeof(buffer);
+        size_t got = fread((void *) buffer, 1, wanted, record_file);
+
+        if (got == 0) {
+            fprintf(GlobalState.logfile, "Unable to read a game record.\n");
+            exit(1);
+        }
+        (void) fwrite((void *) buffer, 1, got, outfp);
+        length -= got;
+    }
+}
+
+/* Return TRUE if the other options in use allow the input files
+ * to be processed in parallel. Those that depend on state shared
+ * between games, other than duplicate detection and the numbering
+ * of games, prevent it.
+ */
+Boolean
+parallel_processing_possible(void)
+{
+    unsigned num_normal_files = 0;
+    unsigned file_number;
+
+    if (GlobalState.num_threads <= 1) {
+        return FALSE;
+    }
+    for (file_number = 0; file_number < num_input_files(); file_number++) {
+        if (input_file_type(file_number) == NORMALFILE) {
+            num_normal_files++;
+        }
+    }
+    if (num_normal_files == 0) {
+        /* Standard input is always read serially. */
+        return FALSE;
+    }
+#ifdef PARALLEL_INPUT
+    if (GlobalState.json_format ||
+            GlobalState.ECO_level > DONT_DIVIDE ||
+            GlobalState.delete_same_setup ||
+            GlobalState.external_duplicates ||
+            GlobalState.near_duplicate_similarity > 0 ||
+            GlobalState.duplicate_database != NULL) {
+        fprintf(GlobalState.logfile,
+                "--threads cannot be used with the other options given, so the files will be processed one at a time.\n");
+        return FALSE;
+    }
+    else {
+        return TRUE;
+    }
+#else
+    fprintf(GlobalState.logfile,
+            "--threads is not supported on this system, so the files will be processed one at a time.\n");
+    return FALSE;
+#endif
+}
+
+#ifdef PARALLEL_INPUT
+/* The processing of a single input file, or section of one, by a worker. */
+typedef struct {
+    unsigned file_number;
+    /* Whether just a section of the file is to be processed. */
+    Boolean is_section;
+    InputSection section;
+    /* Where the worker writes its records and log. */
+    FILE *record_file;
+    FILE *log_file;
+    /* How much of log_file has been copied to the real log. */
+    long log_copied;
+    pid_t pid;
+    Boolean finished;
+    /* Whether the worker exited normally. */
+    Boolean ok;
+} WorkUnit;
+
+/* How far the merging of the workers' records has got.
+ * Once the parent has all the games it needs (finished_processing),
+ * the log of the next game to be parsed must still be copied,
+ * because the game would have been parsed when processing serially.
+ */
+typedef enum {
+    MERGING, STOPPING, STOPPED
+} MergeState;
+
+/* The maximum number of units to have started but not yet
+ * merged, per worker. This limits the number of temporary
+ * files in use when an early unit takes a long time.
+ */
+#define UNITS_IN_HAND_PER_WORKER 4
+
+/* Copy the worker's log up to the given offset to the real log. */
+static void
+copy_worker_log(WorkUnit *unit, long offset)
+{
+    if (offset > unit->log_copied) {
+        copy_record_text(unit->log_file, unit->log_copied,
+                offset - unit->log_copied, GlobalState.logfile);
+        unit->log_copied = offset;
+    }
+}
+
+/* Run as a worker on the given unit, and exit once it is done. */
+static void
+run_worker(WorkUnit *unit)
+{
+    GameRecord end_record;
+    Boolean opened;
+
+    worker_record_file = unit->record_file;
+    GlobalState.logfile = unit->log_file;
+    /* The running count is left to the parent. */
+    GlobalState.verbosity &= ~RUNNING_STATUS;
+
+    memset((void *) &end_record, 0, sizeof(end_record));
+    end_record.end_of_records = TRUE;
+    if (unit->is_section) {
+        opened = open_input_section(unit->file_number, &unit->section);
+    }
+    else {
+        opened = open_single_input_file(unit->file_number);
+    }
+    if (opened) {
+        end_record.input_abandoned = yyparse(NORMALFILE) != 0;
+    }
+    else {
+        fprintf(GlobalState.logfile, "Unable to open the PGN file: %s\n",
+                input_file_name(unit->file_number));
+        end_record.input_abandoned = TRUE;
+    }
+
+    (void) begin_game_record();
+    end_game_record(&end_record);
+    if (fflush(worker_record_file) != 0 || fflush(GlobalState.logfile) != 0) {
+        _exit(1);
+    }
+    _exit(0);
+}
+
+/* Fork a worker for the given unit. */
+static void
+start_unit(WorkUnit *unit)
+{
+    unit->record_file = tmpfile();
+    unit->log_file = tmpfile();
+    unit->log_copied = 0;
+    unit->finished = FALSE;
+    unit->ok = FALSE;
+    if (unit->record_file == NULL || unit->log_file == NULL) {
+        fprintf(GlobalState.logfile, "Unable to create a temporary file for --threads.\n");
+        exit(1);
+    }
+    /* Ensure that nothing buffered is output twice. */
+    fflush(NULL);
+    unit->pid = fork();
+    if (unit->pid < 0) {
+        perror("fork");
+        exit(1);
+    }
+    else if (unit->pid == 0) {
+        run_worker(unit);
+    }
+}
+
+/* Release the temporary files of a unit. */
+static void
+close_unit(WorkUnit *unit)
+{
+    (void) fclose(unit->record_file);
+    (void) fclose(unit->log_file);
+    unit->record_file = unit->log_file = NULL;
+}
+
+/* Merge the records of a finished unit into the output,
+ * updating *state accordingly.
+ */
+static void
+merge_unit(WorkUnit *unit, MergeState *state)
+{
+    GameRecord record;
+    Boolean at_end = FALSE;
+    long position = 0;
+
+    /* Make the unit's file the current one, for duplicate detection
+     * and for the naming of files in the duplicates file.
+     */
+    select_input_file(unit->file_number);
+    while (!at_end) {
+        if (fseek(unit->record_file, position, SEEK_SET) != 0 ||
+                fread((void *) &record, sizeof(record), 1, unit->record_file) != 1) {
+            /* The worker must have failed. */
+            at_end = TRUE;
+            unit->ok = FALSE;
+            if (fseek(unit->log_file, 0, SEEK_END) == 0) {
+                copy_worker_log(unit, ftell(unit->log_file));
+            }
+        }
+        else {
+            long text_start = position + sizeof(record);
+
+            if (record.end_of_records) {
+                copy_worker_log(unit, record.log_offset);
+                if (record.input_abandoned) {
+                    *state = STOPPED;
+                }
+                at_end = TRUE;
+            }
+            else if (*state == STOPPING) {
+                /* Only the parsing of this game is needed. */
+                copy_worker_log(unit, record.parsed_log_offset);
+                *state = STOPPED;
+                at_end = TRUE;
+            }
+            else {
+                copy_worker_log(unit, record.log_offset);
+                if (!merge_game_record(&record, unit->record_file, text_start)) {
+                    *state = STOPPING;
+                }
+            }
+            position = text_start +
+                    record.text_length + record.text_log_length +
+                    record.result_text_length + record.result_text_log_length +
+                    record.details_length;
+        }
+    }
+    close_unit(unit);
+    if (!unit->ok) {
+        fprintf(GlobalState.logfile, "Processing of %s failed.\n",
+                input_file_name(unit->file_number));
+        fflush(NULL);
+        exit(1);
+    }
+}
+
+/* Add a unit for the given file, or section of it, to *units. */
+static void
+add_unit(WorkUnit **units, unsigned *num_units, unsigned *space,
+         unsigned file_number, const InputSection *section)
+{
+    WorkUnit *unit;
+
+    if (*num_units == *space) {
+        *space = *space == 0 ? 16 : 2 * *space;
+        *units = (WorkUnit *) realloc_or_die((void *) *units,
+                *space * sizeof(**units));
+    }
+    unit = &(*units)[*num_units];
+    unit->file_number = file_number;
+    unit->is_section = section != NULL;
+    if (section != NULL) {
+        unit->section = *section;
+    }
+    (*num_units)++;
+}
+
+/* Process the input files, in parallel where possible.
+ * Check files are processed first, one at a time, so that their
+ * games are available for duplicate detection in all of the others.
+ * Large files are divided into sections at game boundaries.
+ */
+void
+process_files_in_parallel(void)
+{
+    unsigned num_files = num_input_files();
+    WorkUnit *units = NULL;
+    unsigned num_units = 0, space = 0;
+    unsigned next_to_start = 0, next_to_merge = 0, running = 0;
+    unsigned file_number;
+    MergeState state = MERGING;
+
+    for (file_number = 0; file_number < num_files; file_number++) {
+        if (input_file_type(file_number) == CHECKFILE) {
+            if (open_single_input_file(file_number)) {
+                yyparse(CHECKFILE);
+            }
+            else {
+                fprintf(GlobalState.logfile, "Unable to open the PGN file: %s\n",
+                        input_file_name(file_number));
+                exit(1);
+            }
+        }
+        else {
+            InputSection *sections = NULL;
+            unsigned num_sections = divide_input_file(file_number,
+                    GlobalState.split_size, &sections);
+
+            if (num_sections == 0) {
+                add_unit(&units, &num_units, &space, file_number, NULL);
+            }
+            else {
+                unsigned s;
+
+                for (s = 0; s < num_sections; s++) {
+                    add_unit(&units, &num_units, &space, file_number, &sections[s]);
+                }
+                (void) free((void *) sections);
+            }
+        }
+    }
+
+    while (next_to_merge < num_units && state != STOPPED) {
+        while (next_to_start < num_units && running < GlobalState.num_threads &&
+                next_to_start - next_to_merge <
+                    UNITS_IN_HAND_PER_WORKER * GlobalState.num_threads) {
+            start_unit(&units[next_to_start]);
+            next_to_start++;
+            running++;
+        }
+        if (units[next_to_merge].finished) {
+            merge_unit(&units[next_to_merge], &state);
+            next_to_merge++;
+        }
+        else {
+            /* Wait for one of the workers to finish. */
+            int status;
+            pid_t pid = waitpid(-1, &status, 0);
+            unsigned u;
+
+            if (pid < 0) {
+                perror("waitpid");
+                exit(1);
+            }
+            for (u = next_to_merge; u < next_to_start; u++) {
+                if (units[u].pid == pid) {
+                    units[u].finished = TRUE;
+                    units[u].ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+                    running--;
+                }
+            }
+        }
+    }
+
+    /* Abandon any units that are no longer needed. */
+    for (; next_to_merge < next_to_start; next_to_merge++) {
+        WorkUnit *unit = &units[next_to_merge];
+
+        if (!unit->finished) {
+            (void) kill(unit->pid, SIGKILL);
+            (void) waitpid(unit->pid, NULL, 0);
+        }
+        close_unit(unit);
+    }
+    (void) free((void *) units);
+}
+#else
+/* Parallel processing is not possible, so this should never be called. */
+void
+process_files_in_parallel(void)
+{
+    fprintf(GlobalState.logfile,
+            "Internal error: process_files_in_parallel called on an unsupported system.\n");
+    exit(1);
+}
+#endif
@@ -0,0 +1,77 @@
+/*
+ *  This file is part of pgn-extract: a Portable Game Notation (PGN) extractor.
+ *  Copyright (C) 1994-2026 David J. Barnes
+ *
+ *  pgn-extract is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  pgn-extract is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with pgn-extract. If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  David J. Barnes may be contacted as d.j.barnes@kent.ac.uk
+ *  https://www.cs.kent.ac.uk/people/staff/djb/
+ */
+
+        /* Process several input files at once in separate worker
+         * processes, and merge the results in the original order.
+         */
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+/* What a worker records about each game it deals with.
+ * The text of the game follows the record in the worker's
+ * record file, in the order: text, text_log, result_text,
+ * result_text_log, details.
+ * It is up to the parent to decide what to do with the game,
+ * once all of the games before it have been dealt with.
+ */
+typedef struct {
+    /* Whether this marks the end of the worker's records. */
+    Boolean end_of_records;
+    /* Whether the game met all of the selection criteria. */
+    Boolean matched;
+    /* Whether the game has neither moves nor a Result tag. */
+    Boolean no_moves_or_result;
+    /* Whether the game is fit to be output as a non-matching game. */
+    Boolean non_matching_ok;
+    /* The hash values needed for duplicate detection. */
+    HashCode final_hash_value, cumulative_hash_value, fuzzy_duplicate_hash;
+    unsigned plycount;
+    /* Whether the worker gave up before the end of its input.
+     * Only set in the end_of_records record.
+     */
+    Boolean input_abandoned;
+    /* How much had been written to the worker's log by the time
+     * this game had been parsed, and by the time it had been dealt with.
+     */
+    long parsed_log_offset, log_offset;
+    /* The length of the game's text in the output format. */
+    long text_length;
+    /* The length of what was written to the log while formatting it. */
+    long text_log_length;
+    /* The length of its text if it is given a Result tag of *. */
+    long result_text_length;
+    /* The length of what was written to the log while formatting that. */
+    long result_text_log_length;
+    /* The length of the output of report_details for the game. */
+    long details_length;
+} GameRecord;
+
+FILE *begin_game_record(void);
+void copy_record_text(FILE *record_file, long offset, long length, FILE *outfp);
+void end_game_record(GameRecord *record);
+Boolean is_parallel_worker(void);
+long move_worker_log(long start);
+Boolean merge_game_record(const GameRecord *record, FILE *record_file, long text_start);
+Boolean parallel_processing_possible(void);
+void process_files_in_parallel(void);
+long worker_log_position(void);
+
+#endif	// PARALLEL_H
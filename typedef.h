@@ -173,6 +173,10 @@ typedef struct {
      * Used for repetition detection, if required.
      */
     struct PositionCount *position_counts;
+    /* The MinHash signature of the positions reached in the main line.
+     * Used for near duplicate detection, if required.
+     */
+    struct MinHashSignature *near_duplicate_signature;
     /* Line numbers of the start and end of the game in the input file. */
     unsigned long start_line, end_line;
 } Game;
@@ -221,6 +225,16 @@ typedef struct game_number {
     struct game_number *next;
 } game_number;
 
+/* A section of an input file that starts at the beginning of a game.
+ * Used to divide large files between parallel workers (--threads).
+ */
+typedef struct {
+    /* Byte offsets of the start and (exclusive) end of the section. */
+    size_t start, end;
+    /* The number of lines in the file before the start. */
+    unsigned long first_line;
+} InputSection;
+
 /* This structure holds details of the program state.
  * Most of these fields are set from the program's arguments.
  */
@@ -255,6 +269,10 @@ typedef struct {
     Boolean fuzzy_match_duplicates;
     /* At what depth to use fuzzy matching. */
     unsigned fuzzy_match_depth;
+    /* The percentage similarity at which games are treated as
+     * near duplicates. 0 => not looking for near duplicates.
+     */
+    unsigned near_duplicate_similarity;
     /* Whether to check the tags for matches. */
     Boolean check_tags;
     /* Whether to add ECO codes. */
@@ -352,6 +370,14 @@ typedef struct {
     unsigned check_for_N_move_rule;
     /* Number of pieces to look for in a piece-count match. */
     unsigned piece_count;
+    /* Maximum number of input files to process in parallel. */
+    unsigned num_threads;
+    /* The approximate size, in bytes, of the sections into which
+     * large input files are divided for parallel processing.
+     */
+    size_t split_size;
+    /* Whether to use, or build, an index of each input file (--index). */
+    Boolean use_game_index;
     
     /* Whether to output a FEN string. Either at the end of the game
      * or replacing a matching comment (see FEN_comment_pattern). */
@@ -406,6 +432,14 @@ typedef struct {
      * in a game.
      */
     Boolean variation_match_anywhere;
+    /* Whether the games are known to contain only legal moves,
+     * so that checks not needed to resolve them can be skipped.
+     */
+    Boolean trusted_input;
+    /* Whether to detect duplicates by sorting in two passes over
+     * the input, rather than with a table in memory.
+     */
+    Boolean external_duplicates;
     
     /* The depth limit for splitting variations.
      * 0 => no limit.
@@ -432,6 +466,12 @@ typedef struct {
     const char *current_input_file;
     /* File of ECO lines. */
     const char *eco_file;
+    /* File of the compiled ECO table (--ecotable). */
+    const char *eco_table_file;
+    /* File of the hash values of games met in earlier runs, for
+     * duplicate detection (--dupdb).
+     */
+    const char *duplicate_database;
     /* Where to write the extracted games. */
     FILE *outputfile;
     /* Output file name. */
@@ -457,6 +497,8 @@ typedef struct {
  */
 extern StateInfo GlobalState;
 FILE *must_open_file(const char *filename,const char *mode);
+char *replacement_file_name(const char *filename);
+Boolean replace_file(const char *new_filename, const char *filename);
 
 #endif	// TYPEDEF_H
 
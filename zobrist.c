@@ -621,8 +621,17 @@ generate_zobrist_hash_from_board(const Board *board)
     if(board->to_move == WHITE) {
 	hash ^= white_to_move_element[0];
     }
+    hash ^= zobrist_castling_value(board);
+    hash ^= zobrist_ep_value(board, board->to_move);
+    return hash;
+}
+
+/* Return the hash value for the castling rights of board. */
+uint64_t
+zobrist_castling_value(const Board *board)
+{
+    uint64_t hash = 0;
 
-    /* Castling details. */
     /* Chess960 requirements not yet dealt with. */
     if (board->WKingCastle != '\0') {
 	hash ^= castling_section[0];
@@ -636,8 +645,16 @@ generate_zobrist_hash_from_board(const Board *board)
     if (board->BQueenCastle != '\0') {
 	hash ^= castling_section[3];
     }
+    return hash;
+}
 
-    /* En passant. */
+/* Return the hash value for the en-passant status of board when
+ * to_move is the player to move.
+ * This is zero unless to_move has a pawn in position to make the capture.
+ */
+uint64_t
+zobrist_ep_value(const Board *board, Colour to_move)
+{
     if (board->EnPassant) {
         /* Suppress redundant ep info.
 	 * Determine whether the ep indication is redundant or not.
@@ -648,7 +665,7 @@ generate_zobrist_hash_from_board(const Board *board)
 	Col ep_col = board->ep_col;
 	Rank from_rank;
 	Piece pawn;
-	if (board->to_move == WHITE) {
+	if (to_move == WHITE) {
 	    /* White pawn on the fifth rank capturing a black pawn. */
 	    from_rank = '5';
 	    pawn = W(PAWN);
@@ -667,8 +684,15 @@ generate_zobrist_hash_from_board(const Board *board)
 	    redundant = FALSE;
 	}
         if (!redundant) {
-	    hash ^= en_passant_section[ep_col - FIRSTCOL];
+	    return en_passant_section[ep_col - FIRSTCOL];
         }
     }
-    return hash;
+    return 0;
+}
+
+/* Return the hash value for white being the player to move. */
+uint64_t
+zobrist_white_to_move_value(void)
+{
+    return white_to_move_element[0];
 }
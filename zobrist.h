@@ -25,5 +25,8 @@
 uint64_t generate_zobrist_hash_from_board(const Board *board);
 uint64_t generate_zobrist_hash_from_fen(const char *fen);
 uint64_t piece_hash(char piece, int rank, int col);
+uint64_t zobrist_castling_value(const Board *board);
+uint64_t zobrist_ep_value(const Board *board, Colour to_move);
+uint64_t zobrist_white_to_move_value(void);
 #endif
 